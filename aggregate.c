@@ -2,10 +2,15 @@
 
 #include <math.h>
 
+#include "catalog/pg_type.h"
 #include "funcapi.h"
 #include "builtins.h"
 
 #include "lib/stringinfo.h"
+#include "libpq/pqformat.h"
+#include "miscadmin.h"
+#include "storage/buffile.h"
+#include "utils/memutils.h"
 #include "utils/builtins.h"
 
 #include "orafce.h"
@@ -14,26 +19,70 @@ PG_FUNCTION_INFO_V1(orafce_listagg1_transfn);
 PG_FUNCTION_INFO_V1(orafce_wm_concat_transfn);
 PG_FUNCTION_INFO_V1(orafce_listagg2_transfn);
 PG_FUNCTION_INFO_V1(orafce_listagg_finalfn);
+PG_FUNCTION_INFO_V1(orafce_listagg_combinefn);
+PG_FUNCTION_INFO_V1(orafce_listagg_serialize);
+PG_FUNCTION_INFO_V1(orafce_listagg_deserialize);
 
 PG_FUNCTION_INFO_V1(orafce_median4_transfn);
 PG_FUNCTION_INFO_V1(orafce_median4_finalfn);
 PG_FUNCTION_INFO_V1(orafce_median8_transfn);
 PG_FUNCTION_INFO_V1(orafce_median8_finalfn);
+PG_FUNCTION_INFO_V1(orafce_median4_combinefn);
+PG_FUNCTION_INFO_V1(orafce_median4_serialize);
+PG_FUNCTION_INFO_V1(orafce_median4_deserialize);
+PG_FUNCTION_INFO_V1(orafce_median8_combinefn);
+PG_FUNCTION_INFO_V1(orafce_median8_serialize);
+PG_FUNCTION_INFO_V1(orafce_median8_deserialize);
+PG_FUNCTION_INFO_V1(orafce_percentile4_transfn);
+PG_FUNCTION_INFO_V1(orafce_percentile4_finalfn);
+PG_FUNCTION_INFO_V1(orafce_percentile8_transfn);
+PG_FUNCTION_INFO_V1(orafce_percentile8_finalfn);
+PG_FUNCTION_INFO_V1(orafce_quantile4_finalfn);
+PG_FUNCTION_INFO_V1(orafce_quantile8_finalfn);
+PG_FUNCTION_INFO_V1(orafce_median_transfn);
+PG_FUNCTION_INFO_V1(orafce_percentile_transfn);
+PG_FUNCTION_INFO_V1(orafce_approx_median_transfn);
+PG_FUNCTION_INFO_V1(orafce_approx_percentile_transfn);
+PG_FUNCTION_INFO_V1(orafce_approx_percentile_finalfn);
+PG_FUNCTION_INFO_V1(orafce_approx_combinefn);
+PG_FUNCTION_INFO_V1(orafce_approx_serialize);
+PG_FUNCTION_INFO_V1(orafce_approx_deserialize);
+
+/*
+ * The values are stored as unsigned integer keys with same ordering as
+ * original values, so values of all supported types can be processed
+ * by same code. The keys are stored in chunks of fixed size, so there
+ * is not a copy of all values when the state grows. When the values use
+ * more than work_mem, then the chunks are written to temporary file and
+ * are reused for next values.
+ */
+typedef enum
+{
+	MEDIAN_FLOAT4,
+	MEDIAN_FLOAT8,
+	MEDIAN_INT4,
+	MEDIAN_INT8
+} MedianType;
+
+#define MEDIAN_CHUNK_NELEMS		1024
 
 typedef struct
 {
-	int	alen;		/* allocated length */
-	int	nextlen;	/* next allocated length */
-	int	nelems;		/* number of valid entries */
-	union
-	{
-		float4	*float4_values;
-		float8  *float8_values;
-	} d;
+	MedianType	type;
+	int		keysize;	/* size of key, 4 or 8 bytes */
+	int64	nelems;		/* number of values in memory */
+	int		nchunks;	/* number of allocated chunks */
+	int		maxchunks;	/* allocated length of chunks */
+	char  **chunks;
+	float8	fraction;	/* requested fraction for percentile and quantile */
+	MemoryContext context;	/* memory context of state */
+	int64	nspilled;	/* number of values in file */
+	BufFile	   *file;	/* temporary file or NULL */
+	int		fileno;		/* end of file - position for next write */
+	off_t	offset;
 } MedianState;
 
-int orafce_float4_cmp(const void *a, const void *b);
-int orafce_float8_cmp(const void *a, const void *b);
+typedef void (*median_scan_callback) (char *keys, int nkeys, void *arg);
 
 /****************************************************************
  * listagg
@@ -46,6 +95,10 @@ int orafce_float8_cmp(const void *a, const void *b);
  *
  * Note: any NULL value is ignored.
  *
+ * The delimiter is appended before any value, and the length of first
+ * delimiter is stored in cursor field of state. So the states can be
+ * simply concatenated by combine function.
+ *
  ****************************************************************/
 /* subroutine to initialize state */
 static StringInfo
@@ -111,10 +164,12 @@ orafce_wm_concat_transfn(PG_FUNCTION_ARGS)
 	if (!PG_ARGISNULL(1))
 	{
 		if (state == NULL)
+		{
 			state = makeStringAggState(fcinfo);
-		else
-			appendStringInfoChar(state, ',');
+			state->cursor = 1;
+		}
 
+		appendStringInfoChar(state, ',');
 		appendStringInfoText(state, PG_GETARG_TEXT_PP(1));		/* value */
 	}
 
@@ -129,246 +184,1482 @@ orafce_wm_concat_transfn(PG_FUNCTION_ARGS)
 Datum
 orafce_listagg2_transfn(PG_FUNCTION_ARGS)
 {
-	return string_agg_transfn(fcinfo);
+	StringInfo	state;
+
+	state = PG_ARGISNULL(0) ? NULL : (StringInfo) PG_GETARG_POINTER(0);
+
+	/* Append the value unless null. */
+	if (!PG_ARGISNULL(1))
+	{
+		bool	isfirst = state == NULL;
+
+		if (isfirst)
+			state = makeStringAggState(fcinfo);
+
+		/* Append the delimiter unless null, and remember length of first one */
+		if (!PG_ARGISNULL(2))
+		{
+			text   *delim = PG_GETARG_TEXT_PP(2);
+
+			appendStringInfoText(state, delim);
+			if (isfirst)
+				state->cursor = VARSIZE_ANY_EXHDR(delim);
+		}
+
+		appendStringInfoText(state, PG_GETARG_TEXT_PP(1));		/* value */
+	}
+
+	PG_RETURN_POINTER(state);
 }
 
 Datum
 orafce_listagg_finalfn(PG_FUNCTION_ARGS)
 {
-	return string_agg_finalfn(fcinfo);
+	StringInfo	state;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	state = PG_ARGISNULL(0) ? NULL : (StringInfo) PG_GETARG_POINTER(0);
+
+	if (state != NULL)
+		PG_RETURN_TEXT_P(cstring_to_text_with_len(state->data + state->cursor,
+												  state->len - state->cursor));
+	else
+		PG_RETURN_NULL();
 }
 
-static MedianState *
-accumFloat4(MedianState *mstate, float4 value, MemoryContext aggcontext)
+Datum
+orafce_listagg_combinefn(PG_FUNCTION_ARGS)
 {
-	MemoryContext oldcontext;
+	StringInfo	state1;
+	StringInfo	state2;
+	MemoryContext	aggcontext;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+	{
+		/* cannot be called directly because of internal-type argument */
+		elog(ERROR, "listagg_combinefn called in non-aggregate context");
+	}
 
-	if (mstate == NULL)
+	state1 = PG_ARGISNULL(0) ? NULL : (StringInfo) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (StringInfo) PG_GETARG_POINTER(1);
+
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
+
+	if (state1 == NULL)
 	{
-		/* First call - initialize */
-		oldcontext = MemoryContextSwitchTo(aggcontext);
-		mstate = palloc(sizeof(MedianState));
-		mstate->alen = 1024;
-		mstate->nextlen = 2 * 1024;
-		mstate->nelems = 0;
-		mstate->d.float4_values = palloc(mstate->alen * sizeof(float4));
+		MemoryContext oldcontext = MemoryContextSwitchTo(aggcontext);
+
+		state1 = makeStringInfo();
+		state1->cursor = state2->cursor;
 		MemoryContextSwitchTo(oldcontext);
 	}
-	else
+
+	/* the leading delimiter of second state separates the values */
+	appendBinaryStringInfo(state1, state2->data, state2->len);
+
+	PG_RETURN_POINTER(state1);
+}
+
+Datum
+orafce_listagg_serialize(PG_FUNCTION_ARGS)
+{
+	StringInfo	state;
+	StringInfoData buf;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	state = (StringInfo) PG_GETARG_POINTER(0);
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, state->cursor, 4);
+	pq_sendbytes(&buf, state->data, state->len);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+Datum
+orafce_listagg_deserialize(PG_FUNCTION_ARGS)
+{
+	bytea	   *sstate;
+	StringInfoData buf;
+	StringInfo	result;
+	int			cursor;
+	int			datalen;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	sstate = PG_GETARG_BYTEA_PP(0);
+
+	buf.data = VARDATA_ANY(sstate);
+	buf.len = VARSIZE_ANY_EXHDR(sstate);
+	buf.maxlen = buf.len;
+	buf.cursor = 0;
+
+	cursor = pq_getmsgint(&buf, 4);
+	datalen = buf.len - buf.cursor;
+
+	result = makeStringInfo();
+	appendBinaryStringInfo(result, pq_getmsgbytes(&buf, datalen), datalen);
+	result->cursor = cursor;
+
+	pq_getmsgend(&buf);
+
+	PG_RETURN_POINTER(result);
+}
+
+/****************************************************************
+ * median, percentile, quantile
+ *
+ * Returns median, continuous (interpolated) or discrete percentile.
+ * All functions use same state. The values of type real, double
+ * precision, integer and bigint are supported.
+ *
+ * Syntax:
+ *     FUNCTION median(value)
+ *     FUNCTION percentile(value, fraction double precision)
+ *     FUNCTION quantile(value, fraction double precision)
+ *
+ * Note: any NULL value is ignored, the fraction of first row is used.
+ *
+ ****************************************************************/
+#define KEY32_SIGN_BIT		((uint32) 1 << 31)
+#define KEY64_SIGN_BIT		(UINT64CONST(1) << 63)
+
+/*
+ * Transformation of float to unsigned integer with same order. NaN is
+ * bigger than any other value.
+ */
+static inline uint64
+float4_key(float4 value)
+{
+	uint32	bits;
+
+	memcpy(&bits, &value, sizeof(uint32));
+
+	/* all NaNs are positive */
+	if (isnan(value))
+		bits &= ~KEY32_SIGN_BIT;
+
+	return (bits & KEY32_SIGN_BIT) ? (uint32) ~bits : bits | KEY32_SIGN_BIT;
+}
+
+static inline uint64
+float8_key(float8 value)
+{
+	uint64	bits;
+
+	memcpy(&bits, &value, sizeof(uint64));
+
+	/* all NaNs are positive */
+	if (isnan(value))
+		bits &= ~KEY64_SIGN_BIT;
+
+	return (bits & KEY64_SIGN_BIT) ? ~bits : bits | KEY64_SIGN_BIT;
+}
+
+static float8
+key_value(MedianState *mstate, uint64 key)
+{
+	switch (mstate->type)
 	{
-		/* enlarge float4_values if needed */
-		if (mstate->nelems >= mstate->alen)
-		{
-			int	newlen = mstate->nextlen;
+		case MEDIAN_FLOAT4:
+			{
+				uint32	bits = (uint32) key;
+				float4	value;
 
-			oldcontext = MemoryContextSwitchTo(aggcontext);
-			mstate->nextlen += mstate->alen;
-			mstate->alen = newlen;
-			mstate->d.float4_values = repalloc(mstate->d.float4_values,
-									    mstate->alen * sizeof(float4));
-			MemoryContextSwitchTo(oldcontext);
-		}
+				bits = (bits & KEY32_SIGN_BIT) ? bits & ~KEY32_SIGN_BIT : ~bits;
+				memcpy(&value, &bits, sizeof(float4));
+
+				return (float8) value;
+			}
+
+		case MEDIAN_FLOAT8:
+			{
+				uint64	bits = (key & KEY64_SIGN_BIT) ? key & ~KEY64_SIGN_BIT : ~key;
+				float8	value;
+
+				memcpy(&value, &bits, sizeof(float8));
+
+				return value;
+			}
+
+		case MEDIAN_INT4:
+			return (float8) (int32) ((uint32) key ^ KEY32_SIGN_BIT);
+
+		case MEDIAN_INT8:
+			return (float8) (int64) (key ^ KEY64_SIGN_BIT);
 	}
 
-	mstate->d.float4_values[mstate->nelems++] = value;
+	return 0.0;				/* keep compiler quiet */
+}
 
-	return mstate;
+static inline uint64
+get_key(char *keys, int64 i, int keysize)
+{
+	if (keysize == sizeof(uint32))
+		return ((uint32 *) keys)[i];
+
+	return ((uint64 *) keys)[i];
 }
 
 static MedianState *
-accumFloat8(MedianState *mstate, float8 value, MemoryContext aggcontext)
+makeMedianState(MedianType type, float8 fraction, MemoryContext ctx)
 {
-	MemoryContext oldcontext;
+	MemoryContext oldcontext = MemoryContextSwitchTo(ctx);
+	MedianState *mstate;
+
+	mstate = palloc(sizeof(MedianState));
+	mstate->type = type;
+	mstate->keysize = (type == MEDIAN_FLOAT4 || type == MEDIAN_INT4) ?
+										sizeof(uint32) : sizeof(uint64);
+	mstate->nelems = 0;
+	mstate->nchunks = 0;
+	mstate->maxchunks = 16;
+	mstate->chunks = palloc(mstate->maxchunks * sizeof(char *));
+	mstate->fraction = fraction;
+	mstate->context = ctx;
+	mstate->nspilled = 0;
+	mstate->file = NULL;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return mstate;
+}
+
+static void
+closeMedianFile(void *arg)
+{
+	MedianState *mstate = (MedianState *) arg;
+
+	if (mstate->file != NULL)
+	{
+		BufFileClose(mstate->file);
+		mstate->file = NULL;
+	}
+}
+
+static void
+writeMedianFile(MedianState *mstate, char *keys, int nkeys)
+{
+	Size	size = (Size) nkeys * mstate->keysize;
 
-	if (mstate == NULL)
+	if (mstate->file == NULL)
 	{
-		/* First call - initialize */
-		oldcontext = MemoryContextSwitchTo(aggcontext);
-		mstate = palloc(sizeof(MedianState));
-		mstate->alen = 1024;
-		mstate->nextlen = 2 * 1024;
-		mstate->nelems = 0;
-		mstate->d.float8_values = palloc(mstate->alen * sizeof(float8));
+		MemoryContext oldcontext = MemoryContextSwitchTo(mstate->context);
+		MemoryContextCallback *cb;
+
+		/*
+		 * The file is not closed by resource owner (it is not possible to
+		 * close it before the state is released). It is closed when
+		 * memory of state is released, or at session end.
+		 */
+		mstate->file = BufFileCreateTemp(true);
+		mstate->fileno = 0;
+		mstate->offset = 0;
+
+		cb = palloc(sizeof(MemoryContextCallback));
+		cb->func = closeMedianFile;
+		cb->arg = mstate;
+		MemoryContextRegisterResetCallback(mstate->context, cb);
+
 		MemoryContextSwitchTo(oldcontext);
 	}
-	else
+
+	if (BufFileSeek(mstate->file, mstate->fileno, mstate->offset, SEEK_SET) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in temporary file: %m")));
+
+	if (BufFileWrite(mstate->file, keys, size) != size)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to temporary file: %m")));
+
+	BufFileTell(mstate->file, &mstate->fileno, &mstate->offset);
+	mstate->nspilled += nkeys;
+}
+
+/*
+ * Move values from memory to temporary file. The chunks are reused.
+ */
+static void
+spillMedianState(MedianState *mstate)
+{
+	int		i;
+
+	for (i = 0; (int64) i * MEDIAN_CHUNK_NELEMS < mstate->nelems; i++)
+		writeMedianFile(mstate, mstate->chunks[i],
+						(int) Min(mstate->nelems - (int64) i * MEDIAN_CHUNK_NELEMS,
+								  MEDIAN_CHUNK_NELEMS));
+
+	mstate->nelems = 0;
+}
+
+/*
+ * Returns free space in last chunk. New chunk is allocated when there is
+ * not free space, or the values are moved to temporary file, when the
+ * memory limit is reached.
+ */
+static char *
+getMedianSpace(MedianState *mstate, int *nfree)
+{
+	int64	capacity = (int64) mstate->nchunks * MEDIAN_CHUNK_NELEMS;
+	int		pos;
+
+	if (mstate->nelems == capacity)
 	{
-		/* enlarge float4_values if needed */
-		if (mstate->nelems >= mstate->alen)
+		if ((Size) capacity * mstate->keysize >= (Size) work_mem * 1024L)
+			spillMedianState(mstate);
+		else
 		{
-			int	newlen = mstate->nextlen;
+			MemoryContext oldcontext = MemoryContextSwitchTo(mstate->context);
+
+			if (mstate->nchunks == mstate->maxchunks)
+			{
+				mstate->maxchunks *= 2;
+				mstate->chunks = repalloc(mstate->chunks,
+										  mstate->maxchunks * sizeof(char *));
+			}
+
+			mstate->chunks[mstate->nchunks++] =
+						palloc(MEDIAN_CHUNK_NELEMS * mstate->keysize);
 
-			oldcontext = MemoryContextSwitchTo(aggcontext);
-			mstate->nextlen += mstate->alen;
-			mstate->alen = newlen;
-			mstate->d.float8_values = repalloc(mstate->d.float8_values,
-									    mstate->alen * sizeof(float8));
 			MemoryContextSwitchTo(oldcontext);
 		}
 	}
 
-	mstate->d.float8_values[mstate->nelems++] = value;
+	pos = (int) (mstate->nelems % MEDIAN_CHUNK_NELEMS);
+	*nfree = MEDIAN_CHUNK_NELEMS - pos;
 
-	return mstate;
+	return mstate->chunks[mstate->nelems / MEDIAN_CHUNK_NELEMS] +
+		   pos * mstate->keysize;
 }
 
-Datum
-orafce_median4_transfn(PG_FUNCTION_ARGS)
+static void
+addMedianKey(MedianState *mstate, uint64 key)
 {
-	MemoryContext	aggcontext;
-	MedianState *state = NULL;
-	float4 elem;
+	int		nfree;
+	char   *ptr = getMedianSpace(mstate, &nfree);
 
-	if (!AggCheckCallContext(fcinfo, &aggcontext))
+	if (mstate->keysize == sizeof(uint32))
+		*((uint32 *) ptr) = (uint32) key;
+	else
+		*((uint64 *) ptr) = key;
+
+	mstate->nelems += 1;
+}
+
+static void
+addMedianKeys(MedianState *mstate, char *keys, int64 nkeys)
+{
+	while (nkeys > 0)
 	{
-		/* cannot be called directly because of internal-type argument */
-		elog(ERROR, "median4_transfn called in non-aggregate context");
+		int		nfree;
+		char   *ptr = getMedianSpace(mstate, &nfree);
+		int		n = (int) Min((int64) nfree, nkeys);
+
+		memcpy(ptr, keys, (Size) n * mstate->keysize);
+		mstate->nelems += n;
+
+		keys += (Size) n * mstate->keysize;
+		nkeys -= n;
 	}
+}
 
-	state = PG_ARGISNULL(0) ? NULL : (MedianState *) PG_GETARG_POINTER(0);
-	if (PG_ARGISNULL(1))
-		PG_RETURN_POINTER(state);
+/*
+ * Call callback for all keys of state - for keys in file (by chunks)
+ * and for keys in memory.
+ */
+#define MEDIAN_SCAN_CHUNK		(64 * 1024)
+
+static void
+scanMedianState(MedianState *mstate, median_scan_callback callback, void *arg)
+{
+	int		i;
+
+	if (mstate->file != NULL && mstate->nspilled > 0)
+	{
+		char   *buffer = palloc(MEDIAN_SCAN_CHUNK);
+		int64	toread = mstate->nspilled;
+		int		chunk = MEDIAN_SCAN_CHUNK / mstate->keysize;
 
-	elem = PG_GETARG_FLOAT4(1);
-	state = accumFloat4(state, elem, aggcontext);
+		if (BufFileSeek(mstate->file, 0, 0, SEEK_SET) != 0)
+			ereport(ERROR,
+					(errcode_for_file_access(),
+					 errmsg("could not seek in temporary file: %m")));
 
-	PG_RETURN_POINTER(state);
+		while (toread > 0)
+		{
+			int		n = (int) Min(toread, (int64) chunk);
+			Size	size = (Size) n * mstate->keysize;
+
+			if (BufFileRead(mstate->file, buffer, size) != size)
+				ereport(ERROR,
+						(errcode_for_file_access(),
+						 errmsg("could not read from temporary file: %m")));
+
+			callback(buffer, n, arg);
+			toread -= n;
+		}
+
+		pfree(buffer);
+	}
+
+	for (i = 0; (int64) i * MEDIAN_CHUNK_NELEMS < mstate->nelems; i++)
+		callback(mstate->chunks[i],
+				 (int) Min(mstate->nelems - (int64) i * MEDIAN_CHUNK_NELEMS,
+						   MEDIAN_CHUNK_NELEMS),
+				 arg);
 }
 
-int
-orafce_float4_cmp(const void *_a, const void *_b)
+/*
+ * LSD radix sort by bytes, the passes, where all keys have same byte,
+ * are skipped. The keys are sorted in their own width, so 4 bytes keys
+ * use only 4 bytes per value for keys and for scratch buffer.
+ */
+static void
+sort_keys32(uint32 *keys, int64 n)
 {
-	float4 a = *((float4 *) _a);
-	float4 b = *((float4 *) _b);
+	uint32 *tmp;
+	uint32 *data = keys;
+	int64	i;
+	int		shift;
 
-	if (isnan(a))
+	/* insert sort is faster for small arrays */
+	if (n < 64)
 	{
-		if (isnan(b))
-			return 0;
-		else
-			return 1;
+		for (i = 1; i < n; i++)
+		{
+			uint32	key = keys[i];
+			int64	j = i;
+
+			while (j > 0 && keys[j - 1] > key)
+			{
+				keys[j] = keys[j - 1];
+				j--;
+			}
+			keys[j] = key;
+		}
+
+		return;
 	}
-	else if (isnan(b))
+
+	tmp = MemoryContextAllocHuge(CurrentMemoryContext, n * sizeof(uint32));
+
+	for (shift = 0; shift < 32; shift += 8)
 	{
-		return -1;
+		int64	counts[256];
+		int64	pos = 0;
+		uint32 *swap;
+		int		d;
+
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < n; i++)
+			counts[(data[i] >> shift) & 0xFF]++;
+
+		if (counts[(data[0] >> shift) & 0xFF] == n)
+			continue;
+
+		for (d = 0; d < 256; d++)
+		{
+			int64	c = counts[d];
+
+			counts[d] = pos;
+			pos += c;
+		}
+
+		for (i = 0; i < n; i++)
+			tmp[counts[(data[i] >> shift) & 0xFF]++] = data[i];
+
+		swap = data;
+		data = tmp;
+		tmp = swap;
 	}
-	else
+
+	/* result should be in keys */
+	if (data != keys)
 	{
-		if (a > b)
-			return 1;
-		else if (a < b)
-			return -1;
-		else
-			return 0;
+		memcpy(keys, data, n * sizeof(uint32));
+		tmp = data;
 	}
+
+	pfree(tmp);
 }
 
-Datum
-orafce_median4_finalfn(PG_FUNCTION_ARGS)
+static void
+sort_keys64(uint64 *keys, int64 n)
 {
-	MedianState *state = NULL;
-	int	lidx;
-	int	hidx;
-	float4 result;
+	uint64 *tmp;
+	uint64 *data = keys;
+	int64	i;
+	int		shift;
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	if (n < 64)
+	{
+		for (i = 1; i < n; i++)
+		{
+			uint64	key = keys[i];
+			int64	j = i;
+
+			while (j > 0 && keys[j - 1] > key)
+			{
+				keys[j] = keys[j - 1];
+				j--;
+			}
+			keys[j] = key;
+		}
 
-	state = (MedianState *) PG_GETARG_POINTER(0);
+		return;
+	}
 
-	if (state == NULL)
-		PG_RETURN_NULL();
+	tmp = MemoryContextAllocHuge(CurrentMemoryContext, n * sizeof(uint64));
 
-	qsort(state->d.float4_values, state->nelems, sizeof(float4), orafce_float4_cmp);
+	for (shift = 0; shift < 64; shift += 8)
+	{
+		int64	counts[256];
+		int64	pos = 0;
+		uint64 *swap;
+		int		d;
 
-	lidx = state->nelems / 2 + 1 - 1;
-	hidx = (state->nelems + 1) / 2 - 1;
+		memset(counts, 0, sizeof(counts));
+		for (i = 0; i < n; i++)
+			counts[(data[i] >> shift) & 0xFF]++;
 
-	if (lidx == hidx)
-		result = state->d.float4_values[lidx];
-	else
-		result = (state->d.float4_values[lidx] + state->d.float4_values[hidx]) / 2.0f;
+		if (counts[(data[0] >> shift) & 0xFF] == n)
+			continue;
 
-	PG_RETURN_FLOAT4(result);
-}
+		for (d = 0; d < 256; d++)
+		{
+			int64	c = counts[d];
 
-Datum
-orafce_median8_transfn(PG_FUNCTION_ARGS)
-{
-	MemoryContext	aggcontext;
-	MedianState *state = NULL;
-	float8 elem;
+			counts[d] = pos;
+			pos += c;
+		}
 
-	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		for (i = 0; i < n; i++)
+			tmp[counts[(data[i] >> shift) & 0xFF]++] = data[i];
+
+		swap = data;
+		data = tmp;
+		tmp = swap;
+	}
+
+	if (data != keys)
 	{
-		/* cannot be called directly because of internal-type argument */
-		elog(ERROR, "median4_transfn called in non-aggregate context");
+		memcpy(keys, data, n * sizeof(uint64));
+		tmp = data;
 	}
 
-	state = PG_ARGISNULL(0) ? NULL : (MedianState *) PG_GETARG_POINTER(0);
-	if (PG_ARGISNULL(1))
-		PG_RETURN_POINTER(state);
+	pfree(tmp);
+}
 
-	elem = PG_GETARG_FLOAT8(1);
-	state = accumFloat8(state, elem, aggcontext);
+/*
+ * Returns sorted keys of values in memory. The keys have keysize of
+ * state, use get_key for access.
+ */
+static char *
+sortedMedianKeys(MedianState *mstate)
+{
+	int64	n = mstate->nelems;
+	Size	chunksize = (Size) MEDIAN_CHUNK_NELEMS * mstate->keysize;
+	char   *keys;
+	int		i;
+
+	keys = MemoryContextAllocHuge(CurrentMemoryContext, n * mstate->keysize);
+	for (i = 0; (int64) i * MEDIAN_CHUNK_NELEMS < n; i++)
+		memcpy(keys + i * chunksize, mstate->chunks[i],
+			   Min((Size) (n - (int64) i * MEDIAN_CHUNK_NELEMS) * mstate->keysize,
+				   chunksize));
+
+	if (mstate->keysize == sizeof(uint32))
+		sort_keys32((uint32 *) keys, n);
+	else
+		sort_keys64((uint64 *) keys, n);
 
-	PG_RETURN_POINTER(state);
+	return keys;
 }
 
-int
-orafce_float8_cmp(const void *_a, const void *_b)
+/*
+ * Selection of k-th key of spilled state. The keys are not sorted,
+ * but k-th key is found by radix selection, that reads the keys
+ * (keysize / 2) times - any pass finds next 16 bits of k-th key.
+ */
+#define RADIX_BITS		16
+#define RADIX_SIZE		(1 << RADIX_BITS)
+
+typedef struct
 {
-	float8 a = *((float8 *) _a);
-	float8 b = *((float8 *) _b);
+	uint64	prefix;		/* already known bits of k-th key */
+	uint64	mask;
+	int		shift;
+	int		keysize;
+	int64  *counts;
+} RadixPass;
 
-	if (isnan(a))
-	{
-		if (isnan(b))
-			return 0;
-		else
-			return 1;
-	}
-	else if (isnan(b))
+static void
+radix_count(char *keys, int nkeys, void *arg)
+{
+	RadixPass  *pass = (RadixPass *) arg;
+	int		i;
+
+	for (i = 0; i < nkeys; i++)
 	{
-		return -1;
+		uint64	key = get_key(keys, i, pass->keysize);
+
+		if ((key & pass->mask) == pass->prefix)
+			pass->counts[(key >> pass->shift) & (RADIX_SIZE - 1)]++;
 	}
-	else
+}
+
+static uint64
+spilled_kth(MedianState *mstate, int64 k)
+{
+	RadixPass	pass;
+	int		shift;
+
+	pass.prefix = 0;
+	pass.mask = 0;
+	pass.keysize = mstate->keysize;
+	pass.counts = palloc(RADIX_SIZE * sizeof(int64));
+
+	for (shift = mstate->keysize * 8 - RADIX_BITS; shift >= 0; shift -= RADIX_BITS)
 	{
-		if (a > b)
-			return 1;
-		else if (a < b)
-			return -1;
-		else
-			return 0;
+		int		d;
+
+		memset(pass.counts, 0, RADIX_SIZE * sizeof(int64));
+		pass.shift = shift;
+
+		scanMedianState(mstate, radix_count, &pass);
+
+		for (d = 0; d < RADIX_SIZE - 1; d++)
+		{
+			if (k < pass.counts[d])
+				break;
+			k -= pass.counts[d];
+		}
+
+		pass.prefix |= (uint64) d << shift;
+		pass.mask |= (uint64) (RADIX_SIZE - 1) << shift;
 	}
-}
 
+	pfree(pass.counts);
 
-Datum
-orafce_median8_finalfn(PG_FUNCTION_ARGS)
+	return pass.prefix;
+}
+
+/*
+ * Returns k-th value (from zero). The keys are sorted keys of values
+ * in memory or NULL, when state is spilled.
+ */
+static float8
+kth_value(MedianState *mstate, char *keys, int64 k)
 {
-	MedianState *state = NULL;
-	int	lidx;
-	int	hidx;
-	float8 result;
+	if (keys != NULL)
+		return key_value(mstate, get_key(keys, k, mstate->keysize));
 
-	if (PG_ARGISNULL(0))
-		PG_RETURN_NULL();
+	return key_value(mstate, spilled_kth(mstate, k));
+}
 
-	state = (MedianState *) PG_GETARG_POINTER(0);
+static float8
+median_value(MedianState *mstate)
+{
+	int64	n = mstate->nspilled + mstate->nelems;
+	char   *keys = mstate->file == NULL ? sortedMedianKeys(mstate) : NULL;
+	float8	result;
 
-	if (state == NULL)
-		PG_RETURN_NULL();
+	result = kth_value(mstate, keys, (n + 1) / 2 - 1);
+	if (n % 2 == 0)
+	{
+		float8	hval = kth_value(mstate, keys, n / 2);
 
-	qsort(state->d.float8_values, state->nelems, sizeof(float8), orafce_float8_cmp);
+		if (mstate->type == MEDIAN_FLOAT4)
+			result = ((float4) result + (float4) hval) / 2.0f;
+		else
+			result = (result + hval) / 2.0;
+	}
 
-	lidx = state->nelems / 2 + 1 - 1;
-	hidx = (state->nelems + 1) / 2 - 1;
+	if (keys != NULL)
+		pfree(keys);
 
-	if (lidx == hidx)
-		result = state->d.float8_values[lidx];
+	return result;
+}
+
+/*
+ * Continuous percentile - linear interpolation between two neighbour
+ * values.
+ */
+static float8
+percentile_value(MedianState *mstate)
+{
+	int64	n = mstate->nspilled + mstate->nelems;
+	char   *keys = mstate->file == NULL ? sortedMedianKeys(mstate) : NULL;
+	float8	pos = mstate->fraction * (n - 1);
+	int64	lo = (int64) floor(pos);
+	float8	result;
+
+	result = kth_value(mstate, keys, lo);
+	if (pos > lo)
+		result += (pos - lo) * (kth_value(mstate, keys, lo + 1) - result);
+
+	if (keys != NULL)
+		pfree(keys);
+
+	return result;
+}
+
+/*
+ * Discrete percentile (quantile) - first value, for which cumulative
+ * distribution is greater or equal to fraction.
+ */
+static float8
+quantile_value(MedianState *mstate)
+{
+	int64	n = mstate->nspilled + mstate->nelems;
+	int64	k = (int64) ceil(mstate->fraction * n) - 1;
+	float8	result;
+
+	if (k < 0)
+		k = 0;
+
+	if (mstate->file == NULL)
+	{
+		char   *keys = sortedMedianKeys(mstate);
+
+		result = key_value(mstate, get_key(keys, k, mstate->keysize));
+		pfree(keys);
+	}
+	else
+		result = key_value(mstate, spilled_kth(mstate, k));
+
+	return result;
+}
+
+static float8
+check_fraction(FunctionCallInfo fcinfo, int argno)
+{
+	float8		fraction;
+
+	if (PG_ARGISNULL(argno))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("fraction is NULL")));
+
+	fraction = PG_GETARG_FLOAT8(argno);
+	if (isnan(fraction) || fraction < 0 || fraction > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+				 errmsg("percentile value %g is not between 0 and 1",
+						fraction)));
+
+	return fraction;
+}
+
+static MedianType
+median_type(FunctionCallInfo fcinfo)
+{
+	Oid		typid = get_fn_expr_argtype(fcinfo->flinfo, 1);
+
+	switch (typid)
+	{
+		case FLOAT4OID:
+			return MEDIAN_FLOAT4;
+		case FLOAT8OID:
+			return MEDIAN_FLOAT8;
+		case INT4OID:
+			return MEDIAN_INT4;
+		case INT8OID:
+			return MEDIAN_INT8;
+		default:
+			elog(ERROR, "unsupported type %u of median aggregate", typid);
+	}
+
+	return MEDIAN_FLOAT8;	/* keep compiler quiet */
+}
+
+/*
+ * Common transition function. The fraction is read only for first
+ * not NULL value.
+ */
+static Datum
+median_transfn(FunctionCallInfo fcinfo, MedianType type, bool has_fraction)
+{
+	MemoryContext	aggcontext;
+	MedianState *state;
+	uint64	key = 0;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+	{
+		/* cannot be called directly because of internal-type argument */
+		elog(ERROR, "median_transfn called in non-aggregate context");
+	}
+
+	state = PG_ARGISNULL(0) ? NULL : (MedianState *) PG_GETARG_POINTER(0);
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
+
+	if (state == NULL)
+		state = makeMedianState(type,
+								has_fraction ? check_fraction(fcinfo, 2) : 0.5,
+								aggcontext);
+
+	switch (type)
+	{
+		case MEDIAN_FLOAT4:
+			key = float4_key(PG_GETARG_FLOAT4(1));
+			break;
+		case MEDIAN_FLOAT8:
+			key = float8_key(PG_GETARG_FLOAT8(1));
+			break;
+		case MEDIAN_INT4:
+			key = (uint32) PG_GETARG_INT32(1) ^ KEY32_SIGN_BIT;
+			break;
+		case MEDIAN_INT8:
+			key = (uint64) PG_GETARG_INT64(1) ^ KEY64_SIGN_BIT;
+			break;
+	}
+
+	addMedianKey(state, key);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+orafce_median4_transfn(PG_FUNCTION_ARGS)
+{
+	return median_transfn(fcinfo, MEDIAN_FLOAT4, false);
+}
+
+Datum
+orafce_median8_transfn(PG_FUNCTION_ARGS)
+{
+	return median_transfn(fcinfo, MEDIAN_FLOAT8, false);
+}
+
+Datum
+orafce_percentile4_transfn(PG_FUNCTION_ARGS)
+{
+	return median_transfn(fcinfo, MEDIAN_FLOAT4, true);
+}
+
+Datum
+orafce_percentile8_transfn(PG_FUNCTION_ARGS)
+{
+	return median_transfn(fcinfo, MEDIAN_FLOAT8, true);
+}
+
+/*
+ * Transition functions for any supported type, the type is detected
+ * from function expression.
+ */
+Datum
+orafce_median_transfn(PG_FUNCTION_ARGS)
+{
+	return median_transfn(fcinfo, median_type(fcinfo), false);
+}
+
+Datum
+orafce_percentile_transfn(PG_FUNCTION_ARGS)
+{
+	return median_transfn(fcinfo, median_type(fcinfo), true);
+}
+
+/*
+ * The final functions with double precision result can be used for
+ * state of any type.
+ */
+Datum
+orafce_median4_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT4((float4) median_value((MedianState *) PG_GETARG_POINTER(0)));
+}
+
+Datum
+orafce_median8_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(median_value((MedianState *) PG_GETARG_POINTER(0)));
+}
+
+Datum
+orafce_percentile4_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT4((float4) percentile_value((MedianState *) PG_GETARG_POINTER(0)));
+}
+
+Datum
+orafce_percentile8_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(percentile_value((MedianState *) PG_GETARG_POINTER(0)));
+}
+
+Datum
+orafce_quantile4_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT4((float4) quantile_value((MedianState *) PG_GETARG_POINTER(0)));
+}
+
+Datum
+orafce_quantile8_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_FLOAT8(quantile_value((MedianState *) PG_GETARG_POINTER(0)));
+}
+
+static void
+append_keys(char *keys, int nkeys, void *arg)
+{
+	addMedianKeys((MedianState *) arg, keys, nkeys);
+}
+
+static void
+send_keys(char *keys, int nkeys, void *arg)
+{
+	StringInfo	buf = (StringInfo) arg;
+	int		keysize = buf->cursor;
+
+	pq_sendbytes(buf, keys, nkeys * keysize);
+}
+
+/*
+ * The state holds type of values, so the support functions are same
+ * for all types.
+ */
+static Datum
+median_combine(FunctionCallInfo fcinfo)
+{
+	MemoryContext	aggcontext;
+	MedianState *state1;
+	MedianState *state2;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+	{
+		/* cannot be called directly because of internal-type argument */
+		elog(ERROR, "median_combinefn called in non-aggregate context");
+	}
+
+	state1 = PG_ARGISNULL(0) ? NULL : (MedianState *) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (MedianState *) PG_GETARG_POINTER(1);
+
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
+
+	if (state1 == NULL)
+		state1 = makeMedianState(state2->type, state2->fraction, aggcontext);
+
+	scanMedianState(state2, append_keys, state1);
+
+	PG_RETURN_POINTER(state1);
+}
+
+static Datum
+median_serialize(FunctionCallInfo fcinfo)
+{
+	MedianState *state;
+	StringInfoData buf;
+	int64	nelems;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	state = (MedianState *) PG_GETARG_POINTER(0);
+	nelems = state->nspilled + state->nelems;
+
+	/*
+	 * The partial state is passed to the leader as one bytea value. A state
+	 * that has spilled to a temporary file is larger than work_mem, so it
+	 * is not copied back to memory, and this query has to run serially.
+	 */
+	if (state->nspilled > 0 ||
+		nelems > (int64) (MaxAllocSize / state->keysize))
+		ereport(ERROR,
+				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+				 errmsg("too many values for partial aggregation"),
+				 errdetail("The state of median, percentile or quantile exceeded work_mem in a parallel worker."),
+				 errhint("Increase work_mem, or disable parallel query by setting max_parallel_workers_per_gather to 0.")));
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, (int) state->type, 4);
+	pq_sendint64(&buf, nelems);
+	pq_sendfloat8(&buf, state->fraction);
+
+	/* cursor is not used by send functions, so it can hold keysize */
+	buf.cursor = state->keysize;
+	scanMedianState(state, send_keys, &buf);
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+static Datum
+median_deserialize(FunctionCallInfo fcinfo)
+{
+	bytea	   *sstate;
+	StringInfoData buf;
+	MedianType	type;
+	int64		nelems;
+	float8		fraction;
+	MedianState *result;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	sstate = PG_GETARG_BYTEA_PP(0);
+
+	buf.data = VARDATA_ANY(sstate);
+	buf.len = VARSIZE_ANY_EXHDR(sstate);
+	buf.maxlen = buf.len;
+	buf.cursor = 0;
+
+	type = (MedianType) pq_getmsgint(&buf, 4);
+	nelems = pq_getmsgint64(&buf);
+	fraction = pq_getmsgfloat8(&buf);
+
+	result = makeMedianState(type, fraction, CurrentMemoryContext);
+	addMedianKeys(result,
+				  (char *) pq_getmsgbytes(&buf, (int) (nelems * result->keysize)),
+				  nelems);
+
+	pq_getmsgend(&buf);
+
+	PG_RETURN_POINTER(result);
+}
+
+Datum
+orafce_median4_combinefn(PG_FUNCTION_ARGS)
+{
+	return median_combine(fcinfo);
+}
+
+Datum
+orafce_median4_serialize(PG_FUNCTION_ARGS)
+{
+	return median_serialize(fcinfo);
+}
+
+Datum
+orafce_median4_deserialize(PG_FUNCTION_ARGS)
+{
+	return median_deserialize(fcinfo);
+}
+
+Datum
+orafce_median8_combinefn(PG_FUNCTION_ARGS)
+{
+	return median_combine(fcinfo);
+}
+
+Datum
+orafce_median8_serialize(PG_FUNCTION_ARGS)
+{
+	return median_serialize(fcinfo);
+}
+
+Datum
+orafce_median8_deserialize(PG_FUNCTION_ARGS)
+{
+	return median_deserialize(fcinfo);
+}
+
+/****************************************************************
+ * approx_median, approx_percentile
+ *
+ * Approximate median and percentile calculated by t-digest. The
+ * digest has fixed size, so memory doesn't depend on number of
+ * aggregated rows. The accuracy is compression parameter of digest -
+ * higher accuracy means more precise result and more memory.
+ *
+ * Syntax:
+ *     FUNCTION approx_median(value double precision [, accuracy int = 100])
+ *     FUNCTION approx_percentile(value double precision, fraction double precision
+ *                                [, accuracy int = 100])
+ *
+ * Note: NULL and NaN values are ignored.
+ *
+ ****************************************************************/
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define TDIGEST_DEFAULT_ACCURACY		100
+#define TDIGEST_MIN_ACCURACY			10
+#define TDIGEST_MAX_ACCURACY			10000
+
+typedef struct
+{
+	float8	mean;
+	float8	weight;
+} Centroid;
+
+typedef struct
+{
+	int		accuracy;
+	int		ncentroids;		/* number of centroids, buffered too */
+	int		nmerged;		/* number of merged centroids */
+	int		maxcentroids;	/* size of centroids array */
+	float8	fraction;
+	float8	count;			/* sum of weights */
+	float8	min;
+	float8	max;
+	Centroid *centroids;
+} TDigestState;
+
+static TDigestState *
+makeTDigestState(int accuracy, float8 fraction, MemoryContext ctx)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(ctx);
+	TDigestState *state;
+
+	if (accuracy < TDIGEST_MIN_ACCURACY || accuracy > TDIGEST_MAX_ACCURACY)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("accuracy %d is not between %d and %d",
+						accuracy, TDIGEST_MIN_ACCURACY, TDIGEST_MAX_ACCURACY)));
+
+	state = palloc(sizeof(TDigestState));
+	state->accuracy = accuracy;
+	state->ncentroids = 0;
+	state->nmerged = 0;
+
+	/*
+	 * After compression there are about accuracy centroids, the rest
+	 * of array is used as buffer for new values.
+	 */
+	state->maxcentroids = 6 * accuracy + 10;
+	state->fraction = fraction;
+	state->count = 0;
+	state->min = 0;
+	state->max = 0;
+	state->centroids = palloc(state->maxcentroids * sizeof(Centroid));
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return state;
+}
+
+static int
+centroid_cmp(const void *_a, const void *_b)
+{
+	float8 a = ((Centroid *) _a)->mean;
+	float8 b = ((Centroid *) _b)->mean;
+
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+/*
+ * Scale function k1 of t-digest. The centroids near to the tails are
+ * smaller, so extreme percentiles are more precise.
+ */
+static float8
+tdigest_scale(TDigestState *state, float8 q)
+{
+	q = Max(0.0, Min(1.0, q));
+
+	return state->accuracy / (2.0 * M_PI) * asin(2.0 * q - 1.0);
+}
+
+/*
+ * Merge buffered centroids to sorted digest
+ */
+static void
+tdigest_compress(TDigestState *state)
+{
+	Centroid   *c = state->centroids;
+	Centroid	cur;
+	float8		wsofar = 0;
+	float8		kleft;
+	int			n = 0;
+	int			i;
+
+	if (state->ncentroids == state->nmerged)
+		return;
+
+	qsort(c, state->ncentroids, sizeof(Centroid), centroid_cmp);
+
+	cur = c[0];
+	kleft = tdigest_scale(state, 0.0);
+
+	for (i = 1; i < state->ncentroids; i++)
+	{
+		float8	proposed = cur.weight + c[i].weight;
+
+		if (tdigest_scale(state, (wsofar + proposed) / state->count) - kleft <= 1.0)
+		{
+			cur.mean += (c[i].mean - cur.mean) * c[i].weight / proposed;
+			cur.weight = proposed;
+		}
+		else
+		{
+			wsofar += cur.weight;
+			c[n++] = cur;
+			kleft = tdigest_scale(state, wsofar / state->count);
+			cur = c[i];
+		}
+	}
+
+	c[n++] = cur;
+
+	state->ncentroids = state->nmerged = n;
+}
+
+static void
+tdigest_add(TDigestState *state, float8 mean, float8 weight)
+{
+	if (state->ncentroids >= state->maxcentroids)
+		tdigest_compress(state);
+
+	state->centroids[state->ncentroids].mean = mean;
+	state->centroids[state->ncentroids].weight = weight;
+	state->ncentroids += 1;
+	state->count += weight;
+}
+
+/*
+ * Returns estimation of percentile. The centroid's mean is used as value
+ * in the center of centroid, and the values between centers are linearly
+ * interpolated.
+ */
+static float8
+tdigest_percentile(TDigestState *state)
+{
+	Centroid   *c = state->centroids;
+	float8		target;
+	float8		wsofar = 0;
+	int			n;
+	int			i;
+
+	tdigest_compress(state);
+	n = state->ncentroids;
+
+	target = state->fraction * state->count;
+
+	if (n == 1)
+		return c[0].mean;
+	if (target <= 0)
+		return state->min;
+	if (target >= state->count)
+		return state->max;
+
+	if (target < c[0].weight / 2.0)
+		return state->min + (c[0].mean - state->min) * target / (c[0].weight / 2.0);
+
+	for (i = 0; i < n - 1; i++)
+	{
+		float8	lcenter = wsofar + c[i].weight / 2.0;
+		float8	rcenter = wsofar + c[i].weight + c[i + 1].weight / 2.0;
+
+		if (target < rcenter)
+			return c[i].mean + (c[i + 1].mean - c[i].mean) *
+				(target - lcenter) / (rcenter - lcenter);
+
+		wsofar += c[i].weight;
+	}
+
+	/* between center of last centroid and maximum */
+	wsofar = state->count - c[n - 1].weight / 2.0;
+
+	return c[n - 1].mean + (state->max - c[n - 1].mean) *
+		(target - wsofar) / (state->count - wsofar);
+}
+
+static Datum
+approx_transfn(FunctionCallInfo fcinfo, bool has_fraction)
+{
+	MemoryContext	aggcontext;
+	TDigestState *state;
+	int		accuracy_argno = has_fraction ? 3 : 2;
+	float8	value;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+	{
+		/* cannot be called directly because of internal-type argument */
+		elog(ERROR, "approx_transfn called in non-aggregate context");
+	}
+
+	state = PG_ARGISNULL(0) ? NULL : (TDigestState *) PG_GETARG_POINTER(0);
+	if (PG_ARGISNULL(1))
+		PG_RETURN_POINTER(state);
+
+	value = PG_GETARG_FLOAT8(1);
+	if (isnan(value))
+		PG_RETURN_POINTER(state);
+
+	if (state == NULL)
+	{
+		int		accuracy = TDIGEST_DEFAULT_ACCURACY;
+		float8	fraction = has_fraction ? check_fraction(fcinfo, 2) : 0.5;
+
+		if (PG_NARGS() > accuracy_argno && !PG_ARGISNULL(accuracy_argno))
+			accuracy = PG_GETARG_INT32(accuracy_argno);
+
+		state = makeTDigestState(accuracy, fraction, aggcontext);
+	}
+
+	if (state->count == 0)
+		state->min = state->max = value;
 	else
-		result = (state->d.float8_values[lidx] + state->d.float8_values[hidx]) / 2.0;
+	{
+		state->min = Min(state->min, value);
+		state->max = Max(state->max, value);
+	}
+
+	tdigest_add(state, value, 1.0);
+
+	PG_RETURN_POINTER(state);
+}
+
+Datum
+orafce_approx_median_transfn(PG_FUNCTION_ARGS)
+{
+	return approx_transfn(fcinfo, false);
+}
+
+Datum
+orafce_approx_percentile_transfn(PG_FUNCTION_ARGS)
+{
+	return approx_transfn(fcinfo, true);
+}
+
+Datum
+orafce_approx_percentile_finalfn(PG_FUNCTION_ARGS)
+{
+	TDigestState *state;
+
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	state = (TDigestState *) PG_GETARG_POINTER(0);
+
+	PG_RETURN_FLOAT8(tdigest_percentile(state));
+}
+
+Datum
+orafce_approx_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext	aggcontext;
+	TDigestState *state1;
+	TDigestState *state2;
+	int		i;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+	{
+		/* cannot be called directly because of internal-type argument */
+		elog(ERROR, "approx_combinefn called in non-aggregate context");
+	}
+
+	state1 = PG_ARGISNULL(0) ? NULL : (TDigestState *) PG_GETARG_POINTER(0);
+	state2 = PG_ARGISNULL(1) ? NULL : (TDigestState *) PG_GETARG_POINTER(1);
+
+	if (state2 == NULL)
+		PG_RETURN_POINTER(state1);
+
+	if (state1 == NULL)
+		state1 = makeTDigestState(state2->accuracy, state2->fraction, aggcontext);
+
+	if (state1->count == 0)
+	{
+		state1->min = state2->min;
+		state1->max = state2->max;
+	}
+	else if (state2->count > 0)
+	{
+		state1->min = Min(state1->min, state2->min);
+		state1->max = Max(state1->max, state2->max);
+	}
+
+	for (i = 0; i < state2->ncentroids; i++)
+		tdigest_add(state1, state2->centroids[i].mean, state2->centroids[i].weight);
+
+	PG_RETURN_POINTER(state1);
+}
+
+Datum
+orafce_approx_serialize(PG_FUNCTION_ARGS)
+{
+	TDigestState *state;
+	StringInfoData buf;
+	int		i;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	state = (TDigestState *) PG_GETARG_POINTER(0);
+
+	tdigest_compress(state);
+
+	pq_begintypsend(&buf);
+	pq_sendint(&buf, state->accuracy, 4);
+	pq_sendfloat8(&buf, state->fraction);
+	pq_sendfloat8(&buf, state->min);
+	pq_sendfloat8(&buf, state->max);
+	pq_sendint(&buf, state->ncentroids, 4);
+	for (i = 0; i < state->ncentroids; i++)
+	{
+		pq_sendfloat8(&buf, state->centroids[i].mean);
+		pq_sendfloat8(&buf, state->centroids[i].weight);
+	}
+
+	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+}
+
+Datum
+orafce_approx_deserialize(PG_FUNCTION_ARGS)
+{
+	bytea	   *sstate;
+	StringInfoData buf;
+	TDigestState *result;
+	int		accuracy;
+	float8	fraction;
+	int		n;
+	int		i;
+
+	/* cannot be called directly because of internal-type argument */
+	Assert(AggCheckCallContext(fcinfo, NULL));
+
+	sstate = PG_GETARG_BYTEA_PP(0);
+
+	buf.data = VARDATA_ANY(sstate);
+	buf.len = VARSIZE_ANY_EXHDR(sstate);
+	buf.maxlen = buf.len;
+	buf.cursor = 0;
+
+	accuracy = pq_getmsgint(&buf, 4);
+	fraction = pq_getmsgfloat8(&buf);
+
+	result = makeTDigestState(accuracy, fraction, CurrentMemoryContext);
+	result->min = pq_getmsgfloat8(&buf);
+	result->max = pq_getmsgfloat8(&buf);
+
+	n = pq_getmsgint(&buf, 4);
+	for (i = 0; i < n; i++)
+	{
+		float8	mean = pq_getmsgfloat8(&buf);
+		float8	weight = pq_getmsgfloat8(&buf);
+
+		tdigest_add(result, mean, weight);
+	}
+
+	pq_getmsgend(&buf);
 
-	PG_RETURN_FLOAT8(result);
+	PG_RETURN_POINTER(result);
 }
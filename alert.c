@@ -2,12 +2,15 @@
 #include "executor/spi.h"
 
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "commands/trigger.h"
 #include "funcapi.h"
 #include "miscadmin.h"
 #include "string.h"
+#include "storage/latch.h"
 #include "storage/lwlock.h"
+#include "storage/proc.h"
 #include "utils/timestamp.h"
 
 #include "orafce.h"
@@ -27,7 +30,7 @@ PG_FUNCTION_INFO_V1(dbms_alert_defered_signal);
 
 extern int sid;
 float8 sensitivity = 250.0;
-extern LWLockId shmem_lockid;
+extern LWLockId alerts_lockid;
 
 #ifndef _GetCurrentTimestamp
 #define _GetCurrentTimestamp()		GetCurrentTimestamp()
@@ -45,12 +48,15 @@ extern LWLockId shmem_lockid;
 
 
 /*
- * There are maximum 30 events and 255 collaborating sessions
+ * There are maximum orafce.max_events events and orafce.max_locks
+ * collaborating sessions
  *
  */
 
 alert_event *events;
 alert_lock  *locks;
+ora_shash *events_index;
+ora_shash *locks_index;
 
 alert_lock *session_lock = NULL;
 
@@ -88,6 +94,27 @@ textcmpm(text *txt, char *str)
 }
 
 
+/*
+ * find session lock via hash index
+ */
+
+static alert_lock*
+lookup_lock(int sid)
+{
+	int i;
+
+	for (i = ora_shash_first(locks_index, ora_shash_int(sid));
+		 i != ORA_SHASH_NONE;
+		 i = ora_shash_next(locks_index, i))
+	{
+		if (locks[i].sid == sid)
+			return &locks[i];
+	}
+
+	return NULL;
+}
+
+
 /*
  * find or create event rec
  *
@@ -96,35 +123,31 @@ textcmpm(text *txt, char *str)
 static alert_lock*
 find_lock(int sid, bool create)
 {
+	alert_lock *result;
 	int i;
-	int first_free = NOT_FOUND;
 
 	if (session_lock != NULL)
 		return session_lock;
 
-	for (i = 0; i < MAX_LOCKS; i++)
-	{
-		if (locks[i].sid == sid)
-			return &locks[i];
-		else if (locks[i].sid == NOT_USED && first_free == NOT_FOUND)
-			first_free = i;
-	}
+	if (NULL != (result = lookup_lock(sid)))
+		return result;
 
 	if (create)
 	{
-		if (first_free != NOT_FOUND)
+		if (ORA_SHASH_NONE != (i = ora_shash_insert(locks_index, ora_shash_int(sid))))
 		{
-			locks[first_free].sid = sid;
-			locks[first_free].echo = NULL;
-			session_lock = &locks[first_free];
-			return &locks[first_free];
+			locks[i].sid = sid;
+			locks[i].echo = NULL;
+			locks[i].latch = &MyProc->procLatch;
+			session_lock = &locks[i];
+			return &locks[i];
 		}
 		else
 			ereport(ERROR,
 				(errcode(ERRCODE_ORA_PACKAGES_LOCK_REQUEST_ERROR),
 				 errmsg("lock request error"),
 					 errdetail("Failed to create session lock."),
-				 errhint("There are too many collaborating sessions. Increase MAX_LOCKS in 'pipe.h'.")));
+				 errhint("There are too many collaborating sessions. Increase orafce.max_locks configuration parameter.")));
 	}
 
 	return NULL;
@@ -135,8 +158,13 @@ static alert_event*
 find_event(text *event_name, bool create, int *event_id)
 {
 	int i;
+	uint32 hash;
 
-	for (i = 0; i < MAX_EVENTS;i++)
+	hash = ora_shash_bytes(VARDATA(event_name), VARSIZE(event_name) - VARHDRSZ);
+
+	for (i = ora_shash_first(events_index, hash);
+		 i != ORA_SHASH_NONE;
+		 i = ora_shash_next(events_index, i))
 	{
 		if (events[i].event_name != NULL && textcmpm(event_name,events[i].event_name) == 0)
 		{
@@ -148,28 +176,30 @@ find_event(text *event_name, bool create, int *event_id)
 
 	if (create)
 	{
-		for (i=0; i < MAX_EVENTS; i++)
+		if (events_index->free_slot != ORA_SHASH_NONE)
 		{
-			if (events[i].event_name == NULL)
-			{
-				events[i].event_name = ora_scstring(event_name);
+			char *name = ora_scstring(event_name);
 
-				events[i].max_receivers = 0;
-				events[i].receivers = NULL;
-				events[i].messages = NULL;
-				events[i].receivers_number = 0;
+			i = ora_shash_insert(events_index, hash);
 
-				if (event_id != NULL)
-					*event_id = i;
-				return &events[i];
-			}
+			events[i].event_name = name;
+
+			events[i].max_receivers = 0;
+			events[i].receivers = NULL;
+			events[i].messages = NULL;
+			events[i].receivers_number = 0;
+			events[i].signals = 0;
+
+			if (event_id != NULL)
+				*event_id = i;
+			return &events[i];
 		}
 
 		ereport(ERROR,
 				(errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
 				 errmsg("event registeration error"),
 				 errdetail("Too many registered events."),
-				 errhint("There are too many collaborating sessions. Increase MAX_EVENTS in 'pipe.h'.")));
+				 errhint("There are too many collaborating sessions. Increase orafce.max_events configuration parameter.")));
 	}
 
 	return NULL;
@@ -207,7 +237,7 @@ register_event(text *event_name)
 				(errcode(ERRCODE_ORA_PACKAGES_LOCK_REQUEST_ERROR),
 				 errmsg("lock request error"),
 					 errdetail("Failed to create session lock."),
-				 errhint("There are too many collaborating sessions. Increase MAX_LOCKS in 'pipe.h'.")));
+				 errhint("There are too many collaborating sessions. Increase orafce.max_locks configuration parameter.")));
 
 		/* increase receiver's array */
 
@@ -259,6 +289,7 @@ unregister_event(int event_id, int sid)
 		}
 		if (ev->receivers_number == 0)
 		{
+			ora_shash_delete(events_index, event_id);
 			ora_sfree(ev->receivers);
 			ora_sfree(ev->event_name);
 			ev->receivers = NULL;
@@ -415,13 +446,15 @@ create_message(text *event_name, text *message)
 	int event_id;
 	alert_event *ev;
 	message_item *msg_item = NULL;
-	int i,j,k;
+	int i,j;
 
 	find_event(event_name, false, &event_id);
 
 	/* process event only when any recipient exitsts */
 	if (NULL != (ev = find_event(event_name, false, &event_id)))
 	{
+		ev->signals += 1;
+
 		if (ev->receivers_number > 0)
 		{
 			msg_item = ev->messages;
@@ -451,31 +484,35 @@ create_message(text *event_name, text *message)
 			{
 				if (ev->receivers[j] != NOT_USED)
 				{
+					alert_lock *alck;
+
 					msg_item->receivers[i++] = ev->receivers[j];
-					for (k = 0; k < MAX_LOCKS; k++)
-						if (locks[k].sid == ev->receivers[j])
+					if (NULL != (alck = lookup_lock(ev->receivers[j])))
+					{
+						/* create echo */
+
+						message_echo *echo = salloc(sizeof(message_echo));
+						echo->message = msg_item;
+						echo->message_id = event_id;
+						echo->next_echo = NULL;
+
+						if (alck->echo == NULL)
+							alck->echo = echo;
+						else
 						{
-							/* create echo */
-
-							message_echo *echo = salloc(sizeof(message_echo));
-							echo->message = msg_item;
-							echo->message_id = event_id;
-							echo->next_echo = NULL;
+							message_echo *p;
+							p = alck->echo;
 
-							if (locks[k].echo == NULL)
-								locks[k].echo = echo;
-							else
-							{
-								message_echo *p;
-								p = locks[k].echo;
+							while (p->next_echo != NULL)
+								p = p->next_echo;
 
-								while (p->next_echo != NULL)
-									p = p->next_echo;
-
-								p->next_echo = echo;
-							}
+							p->next_echo = echo;
 						}
 
+						/* wake up the receiver */
+						if (alck->latch != NULL)
+							SetLatch(alck->latch);
+					}
 				}
 			}
 
@@ -532,10 +569,10 @@ dbms_alert_register(PG_FUNCTION_ARGS)
 	float8 timeout = 2;
 
 	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+	if (ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 	{
 		register_event(name);
-		LWLockRelease(shmem_lockid);
+		LWLockRelease(alerts_lockid);
 		PG_RETURN_VOID();
 	}
 	WATCH_POST(timeout, endtime, cycle);
@@ -565,7 +602,7 @@ dbms_alert_remove(PG_FUNCTION_ARGS)
 	float8 timeout = 2;
 
 	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES,MAX_EVENTS,MAX_LOCKS,false))
+	if (ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 	{
 		ev = find_event(name, false, &ev_id);
 		if (NULL != ev)
@@ -574,7 +611,7 @@ dbms_alert_remove(PG_FUNCTION_ARGS)
 							 false, true, true, NULL, NULL);
 			unregister_event(ev_id, sid);
 		}
-		LWLockRelease(shmem_lockid);
+		LWLockRelease(alerts_lockid);
 		PG_RETURN_VOID();
 	}
 	WATCH_POST(timeout, endtime, cycle);
@@ -600,7 +637,7 @@ dbms_alert_removeall(PG_FUNCTION_ARGS)
 	float8 timeout = 2;
 
 	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES,MAX_EVENTS,MAX_LOCKS,false))
+	if (ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 	{
 		for (i = 0; i < MAX_EVENTS; i++)
 			if (events[i].event_name != NULL)
@@ -610,7 +647,7 @@ dbms_alert_removeall(PG_FUNCTION_ARGS)
 				unregister_event(i, sid);
 
 			}
-		LWLockRelease(shmem_lockid);
+		LWLockRelease(alerts_lockid);
 		PG_RETURN_VOID();
 	}
 	WATCH_POST(timeout, endtime, cycle);
@@ -642,7 +679,6 @@ dbms_alert_waitany(PG_FUNCTION_ARGS)
 	HeapTuple   tuple;
 	Datum       result;
 	char *str[3] = {NULL, NULL, "1"};
-	int cycle = 0;
 	float8 endtime;
 	TupleDesc	btupdesc;
 
@@ -651,20 +687,31 @@ dbms_alert_waitany(PG_FUNCTION_ARGS)
 	else
 		timeout = PG_GETARG_FLOAT8(0);
 
-	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+	/*
+	 * The signal path sets the latch of every receiver of the message,
+	 * so we can sleep until some message arrives or timeout.
+	 */
+	endtime = GetNowFloat() + timeout;
+	for (;;)
 	{
-		str[1]  = find_and_remove_message_item(-1, sid,
-							   true, false, false, NULL, &str[0]);
-		if (str[0])
+		ResetLatch(MyLatch);
+
+		if (ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 		{
-			str[2] = "0";
-			LWLockRelease(shmem_lockid);
-			break;
+			str[1]  = find_and_remove_message_item(-1, sid,
+								   true, false, false, NULL, &str[0]);
+			if (str[0])
+			{
+				str[2] = "0";
+				LWLockRelease(alerts_lockid);
+				break;
+			}
+			LWLockRelease(alerts_lockid);
 		}
-		LWLockRelease(shmem_lockid);
+
+		if (!ora_wait_latch(endtime, true))
+			break;
 	}
-	WATCH_POST(timeout, endtime, cycle);
 
 	get_call_result_type(fcinfo, NULL, &tupdesc);
 	btupdesc = BlessTupleDesc(tupdesc);
@@ -706,7 +753,6 @@ dbms_alert_waitone(PG_FUNCTION_ARGS)
 	int message_id;
 	char *str[2] = {NULL,"1"};
 	char *event_name;
-	int cycle = 0;
 	float8 endtime;
 	TupleDesc	btupdesc;
 
@@ -723,24 +769,31 @@ dbms_alert_waitone(PG_FUNCTION_ARGS)
 
 	name = PG_GETARG_TEXT_P(0);
 
-	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+	endtime = GetNowFloat() + timeout;
+	for (;;)
 	{
-		if (NULL != find_event(name, false, &message_id))
+		ResetLatch(MyLatch);
+
+		if (ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 		{
-			str[0] = find_and_remove_message_item(message_id, sid,
-								  false, false, false, NULL, &event_name);
-			if (event_name != NULL)
+			if (NULL != find_event(name, false, &message_id))
 			{
-				str[1] = "0";
-				pfree(event_name);
-				LWLockRelease(shmem_lockid);
-				break;
+				str[0] = find_and_remove_message_item(message_id, sid,
+									  false, false, false, NULL, &event_name);
+				if (event_name != NULL)
+				{
+					str[1] = "0";
+					pfree(event_name);
+					LWLockRelease(alerts_lockid);
+					break;
+				}
 			}
+			LWLockRelease(alerts_lockid);
 		}
-		LWLockRelease(shmem_lockid);
+
+		if (!ora_wait_latch(endtime, true))
+			break;
 	}
-	WATCH_POST(timeout, endtime, cycle);
 
 	get_call_result_type(fcinfo, NULL, &tupdesc);
 	btupdesc = BlessTupleDesc(tupdesc);
@@ -794,6 +847,11 @@ END;
 $$ LANGUAGE plpgsql SECURITY DEFINER VOLATILE;
 */
 
+/*
+ * dbms_alert.signal doesn't use ora_alerts table any more. This trigger
+ * function is kept for SQL compatibility only.
+ */
+
 #define DatumGetItemPointer(X)   ((ItemPointer) DatumGetPointer(X))
 #define ItemPointerGetDatum(X)   PointerGetDatum(X)
 
@@ -864,7 +922,7 @@ dbms_alert_defered_signal(PG_FUNCTION_ARGS)
 		message = DatumGetTextP(datum);
 
 	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+	if (ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 	{
 		ItemPointer tid;
 		Oid argtypes[1] = {TIDOID};
@@ -873,7 +931,7 @@ dbms_alert_defered_signal(PG_FUNCTION_ARGS)
 		void *plan;
 
 		create_message(name, message);
-		LWLockRelease(shmem_lockid);
+		LWLockRelease(alerts_lockid);
 
 		tid = &rettuple->t_data->t_ctid;
 
@@ -910,37 +968,105 @@ dbms_alert_defered_signal(PG_FUNCTION_ARGS)
  */
 
 /*
+ * Signals are queued in backend local memory and they are published to
+ * shared memory by pre-commit callback. Signals of aborted transaction
+ * or aborted subtransaction are dropped.
+ */
+typedef struct _pending_signal {
+	text *event_name;
+	text *message;
+	int nest_level;			/* subtransaction nesting level of signal */
+	struct _pending_signal *next;
+} pending_signal;
 
-CREATE OR REPLACE FUNCTION dbms_alert.signal(_event text, _message text) RETURNS void AS $$
-BEGIN
-  PERFORM 1 FROM pg_catalog.pg_class c
-            WHERE pg_catalog.pg_table_is_visible(c.oid)
-            AND c.relkind='r' AND c.relname = 'ora_alerts';
-  IF NOT FOUND THEN
-    CREATE TEMP TABLE ora_alerts(event text, message text) WITH OIDS;
-    REVOKE ALL ON TABLE ora_alerts FROM PUBLIC;
-    CREATE CONSTRAINT TRIGGER ora_alert_signal AFTER INSERT ON ora_alerts
-      INITIALLY DEFERRED FOR EACH ROW EXECUTE PROCEDURE dbms_alert._defered_signal();
-  END IF;
-  INSERT INTO ora_alerts(event, message) VALUES(_event, _message);
-END;
-$$ LANGUAGE plpgsql VOLATILE SECURITY DEFINER;
-*/
+static pending_signal *pending_signals = NULL;
+static pending_signal *pending_signals_tail = NULL;
+
+static void
+publish_signals(void)
+{
+	pending_signal *ps;
+
+	if (!ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
+		LOCK_ERROR();
+
+	for (ps = pending_signals; ps != NULL; ps = ps->next)
+		create_message(ps->event_name, ps->message);
+
+	LWLockRelease(alerts_lockid);
+}
+
+static void
+alert_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_PRE_COMMIT:
+			if (pending_signals != NULL)
+				publish_signals();
+			break;
+
+		case XACT_EVENT_PRE_PREPARE:
+			if (pending_signals != NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("cannot PREPARE a transaction that has signaled alerts")));
+			break;
+
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+			/* memory is released with TopTransactionContext */
+			pending_signals = NULL;
+			pending_signals_tail = NULL;
+			break;
+
+		default:
+			break;
+	}
+}
+
+static void
+alert_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
+					   SubTransactionId parentSubid, void *arg)
+{
+	int nest_level = GetCurrentTransactionNestLevel();
+	pending_signal *ps;
+
+	if (event == SUBXACT_EVENT_COMMIT_SUB)
+	{
+		/* signals are inherited by parent transaction */
+		for (ps = pending_signals; ps != NULL; ps = ps->next)
+			if (ps->nest_level >= nest_level)
+				ps->nest_level = nest_level - 1;
+	}
+	else if (event == SUBXACT_EVENT_ABORT_SUB)
+	{
+		pending_signal *prev = NULL;
+
+		/* signals are ordered by time, so only tail can be removed */
+		for (ps = pending_signals; ps != NULL; prev = ps, ps = ps->next)
+		{
+			if (ps->nest_level >= nest_level)
+			{
+				if (prev != NULL)
+					prev->next = NULL;
+				else
+					pending_signals = NULL;
 
-#define SPI_EXEC(cmd,_type_) \
-if (SPI_OK_##_type_ != SPI_exec(cmd, 1)) \
-		ereport(ERROR, \
-    			(errcode(ERRCODE_INTERNAL_ERROR), \
-        		 errmsg("SPI execute error"), \
-			 errdetail("Can't execute %s.", cmd)));
+				pending_signals_tail = prev;
+				break;
+			}
+		}
+	}
+}
 
 Datum
 dbms_alert_signal(PG_FUNCTION_ARGS)
 {
-	void *plan;
-	Oid argtypes[] = {TEXTOID, TEXTOID};
-	Datum values[2];
-	char nulls[2] = {' ',' '};
+	static bool callbacks_registered = false;
+	MemoryContext oldcxt;
+	pending_signal *ps;
 
 	if (PG_ARGISNULL(0))
 		ereport(ERROR,
@@ -948,41 +1074,29 @@ dbms_alert_signal(PG_FUNCTION_ARGS)
 			 errmsg("event name is NULL"),
 			 errdetail("Eventname may not be NULL.")));
 
-	if (PG_ARGISNULL(1))
-		nulls[1] = 'n';
+	if (!callbacks_registered)
+	{
+		RegisterXactCallback(alert_xact_callback, NULL);
+		RegisterSubXactCallback(alert_subxact_callback, NULL);
+		callbacks_registered = true;
+	}
 
-	values[0] = PG_GETARG_DATUM(0);
-	values[1] = PG_GETARG_DATUM(1);
+	oldcxt = MemoryContextSwitchTo(TopTransactionContext);
 
-	if (SPI_connect() < 0)
-		ereport(ERROR,
-			(errcode(ERRCODE_INTERNAL_ERROR),
-			 errmsg("SPI_connect failed")));
+	ps = palloc(sizeof(pending_signal));
+	ps->event_name = PG_GETARG_TEXT_P_COPY(0);
+	ps->message = PG_ARGISNULL(1) ? NULL : PG_GETARG_TEXT_P_COPY(1);
+	ps->nest_level = GetCurrentTransactionNestLevel();
+	ps->next = NULL;
 
-	SPI_EXEC("SELECT 1 FROM pg_catalog.pg_class c "
-                    "WHERE pg_catalog.pg_table_is_visible(c.oid) "
-                            "AND c.relkind='r' AND c.relname = 'ora_alerts'", SELECT);
-	if (0 == SPI_processed)
-	{
-		SPI_EXEC("CREATE TEMP TABLE ora_alerts(event text, message text)", UTILITY);
-		SPI_EXEC("REVOKE ALL ON TABLE ora_alerts FROM PUBLIC", UTILITY);
-		SPI_EXEC("CREATE CONSTRAINT TRIGGER ora_alert_signal AFTER INSERT ON ora_alerts "
-		"INITIALLY DEFERRED FOR EACH ROW EXECUTE PROCEDURE dbms_alert.defered_signal()", UTILITY);
-	}
+	MemoryContextSwitchTo(oldcxt);
 
-	if (!(plan = SPI_prepare(
-			"INSERT INTO ora_alerts(event,message) VALUES($1, $2)",
-			2,
-			argtypes)))
-			ereport(ERROR,
-				(errcode(ERRCODE_INTERNAL_ERROR),
-				 errmsg("SPI_prepare failed")));
+	if (pending_signals_tail != NULL)
+		pending_signals_tail->next = ps;
+	else
+		pending_signals = ps;
 
-	if (SPI_OK_INSERT != SPI_execute_plan(plan, values, nulls, false, 1))
-			ereport(ERROR,
-				(errcode(ERRCODE_INTERNAL_ERROR),
-				errmsg("can't execute sql")));
+	pending_signals_tail = ps;
 
-	SPI_finish();
 	PG_RETURN_VOID();
 }
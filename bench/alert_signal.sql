@@ -0,0 +1 @@
+SELECT dbms_alert.signal('bench_alert', clock_timestamp()::text);
@@ -0,0 +1,5 @@
+SELECT dbms_alert.register('bench_alert');
+INSERT INTO bench_latency
+	SELECT 'alert', clock_timestamp() - message::timestamptz
+	  FROM dbms_alert.waitone('bench_alert', 1)
+	 WHERE status = 0;
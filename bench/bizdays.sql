@@ -0,0 +1,2 @@
+\set days random(1, 36500)
+SELECT plvdate.bizdays_between(DATE '2000-01-01', DATE '2000-01-01' + :days);
@@ -0,0 +1 @@
+SELECT sum(instr(t, 'orafce', 1, 1)) FROM :table;
@@ -0,0 +1 @@
+SELECT sum(length(l)) FROM (SELECT listagg(s, ',') AS l FROM bench_numbers GROUP BY g) x;
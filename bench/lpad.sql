@@ -0,0 +1 @@
+SELECT sum(length(oracle.lpad(t, 300, '*'))) FROM :table;
@@ -0,0 +1 @@
+SELECT median(v) FROM bench_numbers;
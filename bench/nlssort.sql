@@ -0,0 +1 @@
+SELECT max(n) FROM (SELECT row_number() OVER (ORDER BY nlssort(t, (SELECT locale FROM bench_config))) AS n FROM :table) x;
@@ -0,0 +1,3 @@
+INSERT INTO bench_latency
+	SELECT 'pipe', clock_timestamp() - dbms_pipe.unpack_message_timestamp()
+	 WHERE dbms_pipe.receive_message('bench_pipe', 1) = 0;
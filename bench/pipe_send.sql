@@ -0,0 +1,2 @@
+SELECT dbms_pipe.pack_message(clock_timestamp());
+SELECT dbms_pipe.send_message('bench_pipe', 1);
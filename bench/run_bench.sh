@@ -0,0 +1,174 @@
+#!/bin/sh
+#
+# Performance benchmarks of orafce, driven by pgbench.
+#
+# The benchmark needs a running server with orafce installed (orafce has to
+# be in shared_preload_libraries for bigger orafce.pipe_shmem_size) and a
+# superuser connection, because utl_file.utl_file_dir is modified. The usual
+# libpq environment variables (PGHOST, PGPORT, PGUSER) are used.
+#
+# Settings (environment variables):
+#
+#   BENCH_DB       database, created when it doesn't exist (orafce_bench)
+#   BENCH_TIME     duration of every test in seconds (30)
+#   BENCH_CLIENTS  number of clients, for pipes the number of producers
+#                  and the number of consumers (4)
+#   BENCH_ROWS     rows aggregated by median and listagg tests (1000000)
+#   BENCH_SEED     seed of pgbench random generator (42)
+#   BENCH_RATE     signals per second in alert test (100)
+#   BENCH_LOCALE   locale used by nlssort test (C)
+#   BENCH_FILEDIR  directory used by utl_file tests (/tmp)
+#   BENCH_OUT      directory for pgbench logs (bench_results)
+#   BENCH_TESTS    list of tests, all except optional ones by default
+#
+# The default tests use only API available in older orafce releases too,
+# so the results of different releases can be compared. The optional
+# tests utl_file_write_bulk and utl_file_read_bulk use the bulk utl_file
+# API (write buffer size of fopen, put_lines, read_lines) of orafce 3.14.
+#
+# Every test prints transactions per second and 50th, 90th and 99th
+# percentile of transaction latency in milliseconds. The pipe and alert
+# tests print the delivery latency (from send or signal to receive) too.
+# The data are generated with fixed seed, and pgbench uses fixed seed
+# (when it supports --random-seed), so the runs are comparable.
+#
+
+set -e
+
+BENCH_SRC=$(cd "$(dirname "$0")" && pwd)
+
+PSQL=${PSQL:-psql}
+PGBENCH=${PGBENCH:-pgbench}
+
+BENCH_DB=${BENCH_DB:-orafce_bench}
+BENCH_TIME=${BENCH_TIME:-30}
+BENCH_CLIENTS=${BENCH_CLIENTS:-4}
+BENCH_ROWS=${BENCH_ROWS:-1000000}
+BENCH_SEED=${BENCH_SEED:-42}
+BENCH_RATE=${BENCH_RATE:-100}
+BENCH_LOCALE=${BENCH_LOCALE:-C}
+BENCH_FILEDIR=${BENCH_FILEDIR:-/tmp}
+BENCH_OUT=${BENCH_OUT:-bench_results}
+BENCH_TESTS=${BENCH_TESTS:-"pipe alert median listagg instr_ascii instr_utf8 substr_ascii substr_utf8 lpad_ascii lpad_utf8 bizdays nlssort utl_file_write utl_file_read"}
+
+mkdir -p "$BENCH_OUT"
+BENCH_OUT=$(cd "$BENCH_OUT" && pwd)
+
+PGBENCH_OPTS="-n -l -T $BENCH_TIME"
+if "$PGBENCH" --help | grep -q -- --random-seed; then
+	PGBENCH_OPTS="$PGBENCH_OPTS --random-seed=$BENCH_SEED"
+fi
+
+if ! "$PSQL" -X -q -d "$BENCH_DB" -c "SELECT 1" > /dev/null 2>&1; then
+	"$PSQL" -X -q -d postgres -c "CREATE DATABASE $BENCH_DB"
+fi
+
+"$PSQL" -X -q -d "$BENCH_DB" \
+	-v rows="$BENCH_ROWS" -v locale="$BENCH_LOCALE" -v filedir="$BENCH_FILEDIR" \
+	-f "$BENCH_SRC/setup.sql" > /dev/null
+
+# prints tps and latency percentiles of pgbench run in directory $1
+report()
+{
+	tps=$(grep -m 1 '^tps = ' "$1/pgbench.out" | awk '{ printf "%.1f", $3 }')
+
+	cat "$1"/pgbench_log.* | awk '{ print $3 }' | sort -n | \
+		awk -v name="$2" -v clients="$3" -v tps="$tps" '
+			function pct(p,		i) {
+				i = int(NR * p + 0.5);
+				return lat[i < 1 ? 1 : i] / 1000.0;
+			}
+			{ lat[NR] = $1 }
+			END {
+				if (NR > 0)
+					printf "%-16s %7d %12s %10.3f %10.3f %10.3f\n",
+						name, clients, tps, pct(0.50), pct(0.90), pct(0.99);
+			}'
+}
+
+# prints percentiles of delivery latency stored by pipe and alert tests
+report_latency()
+{
+	"$PSQL" -X -q -A -t -F ' ' -d "$BENCH_DB" -c "
+		SELECT count(*),
+			   round(percentile_cont(0.50) WITHIN GROUP (ORDER BY ms)::numeric, 3),
+			   round(percentile_cont(0.90) WITHIN GROUP (ORDER BY ms)::numeric, 3),
+			   round(percentile_cont(0.99) WITHIN GROUP (ORDER BY ms)::numeric, 3)
+		  FROM (SELECT extract(epoch FROM latency) * 1000 AS ms
+				  FROM bench_latency WHERE test = '$1') x" | \
+		awk -v name="$2" '{ printf "%-16s %7s %12s %10s %10s %10s\n", name, "", $1 " msgs", $2, $3, $4 }'
+}
+
+# run_pgbench name clients script [pgbench options]
+run_pgbench()
+{
+	name=$1
+	clients=$2
+	script=$3
+	shift 3
+
+	rm -rf "$BENCH_OUT/$name"
+	mkdir -p "$BENCH_OUT/$name"
+
+	(cd "$BENCH_OUT/$name" && \
+	 "$PGBENCH" $PGBENCH_OPTS -c "$clients" -j "$clients" \
+		-f "$BENCH_SRC/$script" "$@" "$BENCH_DB" > pgbench.out 2>&1) || \
+		{ cat "$BENCH_OUT/$name/pgbench.out"; exit 1; }
+}
+
+printf "%-16s %7s %12s %10s %10s %10s\n" test clients tps "p50 ms" "p90 ms" "p99 ms"
+
+for test in $BENCH_TESTS
+do
+	case $test in
+		pipe)
+			"$PSQL" -X -q -d "$BENCH_DB" -c "TRUNCATE bench_latency"
+			run_pgbench pipe_receive "$BENCH_CLIENTS" pipe_receive.sql &
+			consumers=$!
+			run_pgbench pipe_send "$BENCH_CLIENTS" pipe_send.sql
+			wait $consumers
+			report "$BENCH_OUT/pipe_send" pipe_send "$BENCH_CLIENTS"
+			report "$BENCH_OUT/pipe_receive" pipe_receive "$BENCH_CLIENTS"
+			report_latency pipe pipe_delivery
+			;;
+
+		alert)
+			"$PSQL" -X -q -d "$BENCH_DB" -c "TRUNCATE bench_latency"
+			run_pgbench alert_wait "$BENCH_CLIENTS" alert_wait.sql &
+			waiters=$!
+			run_pgbench alert_signal 1 alert_signal.sql -R "$BENCH_RATE"
+			wait $waiters
+			report "$BENCH_OUT/alert_signal" alert_signal 1
+			report_latency alert alert_wakeup
+			;;
+
+		median|listagg|bizdays)
+			run_pgbench $test "$BENCH_CLIENTS" $test.sql
+			report "$BENCH_OUT/$test" $test "$BENCH_CLIENTS"
+			;;
+
+		instr_*|substr_*|lpad_*)
+			# instr_ascii runs instr.sql on table bench_ascii
+			run_pgbench $test "$BENCH_CLIENTS" ${test%_*}.sql -D table=bench_${test##*_}
+			report "$BENCH_OUT/$test" $test "$BENCH_CLIENTS"
+			;;
+
+		nlssort)
+			run_pgbench $test "$BENCH_CLIENTS" nlssort.sql -D table=bench_utf8
+			report "$BENCH_OUT/$test" $test "$BENCH_CLIENTS"
+			;;
+
+		utl_file_write|utl_file_read|utl_file_write_bulk|utl_file_read_bulk)
+			# every transaction writes or reads 8MB file
+			run_pgbench $test 1 $test.sql
+			report "$BENCH_OUT/$test" $test 1
+			tps=$(grep -m 1 '^tps = ' "$BENCH_OUT/$test/pgbench.out" | awk '{ print $3 }')
+			echo "$tps" | awk -v name="$test" '{ printf "%-16s %7s %12.1f MB/s\n", name, "", $1 * 8 }'
+			;;
+
+		*)
+			echo "unknown test \"$test\"" >&2
+			exit 1
+			;;
+	esac
+done
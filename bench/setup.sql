@@ -0,0 +1,91 @@
+-- Data for orafce benchmarks, used by run_bench.sh
+--
+-- psql variables: rows (rows of bench_numbers), locale (used by nlssort)
+-- and filedir (directory for utl_file tests).
+\set ON_ERROR_STOP on
+SET client_min_messages TO warning;
+
+CREATE EXTENSION IF NOT EXISTS orafce;
+
+DROP TABLE IF EXISTS bench_config, bench_numbers, bench_ascii, bench_utf8,
+	bench_file, bench_latency;
+
+-- same data for every run
+SELECT setseed(0.5);
+
+CREATE TABLE bench_config(locale text);
+INSERT INTO bench_config VALUES(:'locale');
+
+CREATE TABLE bench_numbers AS
+	SELECT i % 1000 AS g, random() * 1000000 AS v, 'item' || (i % 10000) AS s
+	  FROM generate_series(1, :rows) i;
+
+CREATE TABLE bench_ascii AS
+	SELECT i AS id, repeat(md5(i::text), 4) || ' orafce ' || md5(i::text) AS t
+	  FROM generate_series(1, 10000) i;
+
+CREATE TABLE bench_utf8 AS
+	SELECT i AS id, repeat('Příliš žluťoučký kůň ', 6) || ' orafce ' || i AS t
+	  FROM generate_series(1, 10000) i;
+
+-- 8MB of lines of 1023 characters
+CREATE TABLE bench_file AS
+	SELECT array_agg(left(repeat(md5(i::text), 32), 1023)) AS lines
+	  FROM generate_series(1, 8192) i;
+
+CREATE UNLOGGED TABLE bench_latency(test text, latency interval);
+
+INSERT INTO utl_file.utl_file_dir(dir, dirname) VALUES(:'filedir', 'bench')
+	ON CONFLICT (dirname) DO UPDATE SET dir = EXCLUDED.dir;
+
+-- line by line API, available in all orafce releases
+CREATE OR REPLACE FUNCTION bench_utl_file_write(filename text)
+RETURNS void AS $$
+DECLARE
+	f utl_file.file_type;
+	l text;
+BEGIN
+	f := utl_file.fopen('bench', filename, 'w', 32767);
+	FOREACH l IN ARRAY (SELECT lines FROM bench_file)
+	LOOP
+		PERFORM utl_file.put_line(f, l);
+	END LOOP;
+	PERFORM utl_file.fclose(f);
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE OR REPLACE FUNCTION bench_utl_file_read(filename text)
+RETURNS int AS $$
+DECLARE
+	f utl_file.file_type;
+	n int := 0;
+BEGIN
+	f := utl_file.fopen('bench', filename, 'r', 32767);
+	BEGIN
+		LOOP
+			PERFORM utl_file.get_line(f);
+			n := n + 1;
+		END LOOP;
+	EXCEPTION WHEN no_data_found THEN
+		PERFORM utl_file.fclose(f);
+	END;
+	RETURN n;
+END;
+$$ LANGUAGE plpgsql;
+
+-- bulk API (write buffer size, put_lines, read_lines) of orafce 3.14,
+-- used only by optional tests utl_file_write_bulk and utl_file_read_bulk
+CREATE OR REPLACE FUNCTION bench_utl_file_write_bulk(filename text)
+RETURNS void AS $$
+DECLARE
+	f utl_file.file_type;
+BEGIN
+	f := utl_file.fopen('bench', filename, 'w', 32767, NULL, 1024 * 1024);
+	PERFORM utl_file.put_lines(f, (SELECT lines FROM bench_file));
+	PERFORM utl_file.fclose(f);
+END;
+$$ LANGUAGE plpgsql;
+
+SELECT bench_utl_file_write('bench_read.txt');
+
+VACUUM ANALYZE;
@@ -0,0 +1 @@
+SELECT sum(length(oracle.substr(t, 20, 40))) FROM :table;
@@ -0,0 +1 @@
+SELECT bench_utl_file_read('bench_read.txt');
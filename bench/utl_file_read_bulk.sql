@@ -0,0 +1 @@
+SELECT count(*) FROM utl_file.read_lines('bench', 'bench_read.txt');
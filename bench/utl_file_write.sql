@@ -0,0 +1 @@
+SELECT bench_utl_file_write('bench_write.txt');
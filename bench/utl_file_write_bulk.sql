@@ -0,0 +1 @@
+SELECT bench_utl_file_write_bulk('bench_write.txt');
@@ -43,10 +43,33 @@ extern PGDLLEXPORT Datum orafce_listagg1_transfn(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_wm_concat_transfn(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_listagg2_transfn(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_listagg_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_listagg_combinefn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_listagg_serialize(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_listagg_deserialize(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_median4_transfn(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_median4_finalfn(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_median8_transfn(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_median8_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median4_combinefn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median4_serialize(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median4_deserialize(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median8_combinefn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median8_serialize(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median8_deserialize(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_percentile4_transfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_percentile4_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_percentile8_transfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_percentile8_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_quantile4_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_quantile8_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_median_transfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_percentile_transfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_approx_median_transfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_approx_percentile_transfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_approx_percentile_finalfn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_approx_combinefn(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_approx_serialize(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_approx_deserialize(PG_FUNCTION_ARGS);
 
 /* from alert.c */
 extern PGDLLEXPORT Datum dbms_alert_register(PG_FUNCTION_ARGS);
@@ -91,6 +114,7 @@ extern PGDLLEXPORT Datum ora_timestamptz_trunc(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_timestamptz_round(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_timestamp_trunc(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_timestamp_round(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_date_trunc_transform(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_sysdate(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_sessiontimezone(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_dbtimezone(PG_FUNCTION_ARGS);
@@ -100,8 +124,11 @@ extern PGDLLEXPORT Datum utl_file_fopen(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_is_open(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_get_line(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_get_nextline(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum utl_file_get_lines(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum utl_file_read_lines(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_put(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_put_line(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum utl_file_put_lines(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_new_line(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_putf(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum utl_file_fflush(PG_FUNCTION_ARGS);
@@ -121,6 +148,10 @@ extern PGDLLEXPORT Datum ora_nlssort(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_set_nls_sort(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_lnnvl(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_decode(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_nvl_transform(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_nvl2_transform(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_lnnvl_transform(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum orafce_decode_transform(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum orafce_dump(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_get_major_version(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum ora_get_major_version_num(PG_FUNCTION_ARGS);
@@ -133,8 +164,11 @@ extern PGDLLEXPORT Datum dbms_pipe_pack_message_text(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_unpack_message_text(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_send_message(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_receive_message(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_pipe_send_messages(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_pipe_receive_messages(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_unique_session_name(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_list_pipes(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_pipe_shmem_stats(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_next_item_type(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_create_pipe(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_pipe_create_pipe_2(PG_FUNCTION_ARGS);
@@ -193,6 +227,8 @@ extern PGDLLEXPORT Datum plvdate_using_great_friday(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum plvdate_include_start(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum plvdate_including_start(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum plvdate_default_holidays(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum plvdate_save_calendar(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum plvdate_use_calendar(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum plvdate_version(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum plvdate_days_inmonth(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum plvdate_isleapyear(PG_FUNCTION_ARGS);
@@ -241,11 +277,13 @@ extern PGDLLEXPORT Datum dbms_output_enable(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_enable_default(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_disable(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_serveroutput(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_output_serveroutput_batch(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_put(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_put_line(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_new_line(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_get_line(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_output_get_lines(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_output_get_lines_set(PG_FUNCTION_ARGS);
 
 /* from random.c */
 extern PGDLLEXPORT Datum dbms_random_initialize(PG_FUNCTION_ARGS);
@@ -257,6 +295,8 @@ extern PGDLLEXPORT Datum dbms_random_string(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_random_terminate(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_random_value(PG_FUNCTION_ARGS);
 extern PGDLLEXPORT Datum dbms_random_value_range(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_random_values(PG_FUNCTION_ARGS);
+extern PGDLLEXPORT Datum dbms_random_strings(PG_FUNCTION_ARGS);
 
 /* from utility.c */
 extern PGDLLEXPORT Datum dbms_utility_format_call_stack0(PG_FUNCTION_ARGS);
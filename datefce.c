@@ -2,6 +2,15 @@
 #include "access/xact.h"
 #include "commands/variable.h"
 #include "mb/pg_wchar.h"
+#include "nodes/pg_list.h"
+#include "nodes/primnodes.h"
+
+#if PG_VERSION_NUM >= 120000
+
+#include "nodes/supportnodes.h"
+
+#endif
+
 #include "utils/date.h"
 #include "utils/builtins.h"
 #include "utils/numeric.h"
@@ -83,6 +92,24 @@ STRING_PTR_FIELD_TYPE date_fmt[] =
 STRING_PTR_FIELD_TYPE ora_days[] = {"Sunday", "Monday", "Tuesday", "Wednesday",
 "Thursday", "Friday", "Saturday", NULL};
 
+/* longer than any item of date_fmt */
+#define DATE_FMT_MAXLEN		8
+
+/*
+ * Cache stored in fn_extra of round and trunc functions. The format is
+ * almost always the same for all rows, so the last format string and
+ * its position in date_fmt are remembered, and date_fmt is searched only
+ * when the format changes. On WIN32 the session timezone is cached here
+ * too.
+ */
+typedef struct DateFmtCache
+{
+	int			fmt;			/* position in date_fmt or -1 */
+	int			fmtlen;
+	char		fmtstr[DATE_FMT_MAXLEN];
+	pg_tz	   *tz;
+} DateFmtCache;
+
 #define CHECK_SEQ_SEARCH(_l, _s) \
 do { \
 	if ((_l) < 0) { \
@@ -104,6 +131,7 @@ PG_FUNCTION_INFO_V1(ora_timestamptz_trunc);
 PG_FUNCTION_INFO_V1(ora_timestamptz_round);
 PG_FUNCTION_INFO_V1(ora_timestamp_trunc);
 PG_FUNCTION_INFO_V1(ora_timestamp_round);
+PG_FUNCTION_INFO_V1(orafce_date_trunc_transform);
 PG_FUNCTION_INFO_V1(orafce_sysdate);
 PG_FUNCTION_INFO_V1(orafce_sessiontimezone);
 PG_FUNCTION_INFO_V1(orafce_dbtimezone);
@@ -146,6 +174,59 @@ ora_seq_prefix_search(const char *name, STRING_PTR_FIELD_TYPE array[], int max)
 	return -1;	/* not found */
 }
 
+static DateFmtCache *
+get_date_fmt_cache(FunctionCallInfo fcinfo)
+{
+	DateFmtCache *cache = (DateFmtCache *) fcinfo->flinfo->fn_extra;
+
+	if (cache == NULL)
+	{
+		cache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+									   sizeof(DateFmtCache));
+		cache->fmt = -1;
+		fcinfo->flinfo->fn_extra = cache;
+	}
+
+	return cache;
+}
+
+/*
+ * Returns position of round/trunc format in date_fmt. Raises an error
+ * when the format is not valid.
+ */
+static int
+get_date_fmt(FunctionCallInfo fcinfo, text *fmt)
+{
+	const char *str = VARDATA_ANY(fmt);
+	int			len = VARSIZE_ANY_EXHDR(fmt);
+	DateFmtCache *cache;
+	int			f;
+
+	if (fcinfo->flinfo == NULL || len >= DATE_FMT_MAXLEN)
+	{
+		f = len > 0 ? ora_seq_search(str, date_fmt, len) : -1;
+		CHECK_SEQ_SEARCH(f, "round/trunc format string");
+
+		return f;
+	}
+
+	cache = get_date_fmt_cache(fcinfo);
+
+	if (cache->fmt >= 0 &&
+		cache->fmtlen == len &&
+		memcmp(cache->fmtstr, str, len) == 0)
+		return cache->fmt;
+
+	f = len > 0 ? ora_seq_search(str, date_fmt, len) : -1;
+	CHECK_SEQ_SEARCH(f, "round/trunc format string");
+
+	memcpy(cache->fmtstr, str, len);
+	cache->fmtlen = len;
+	cache->fmt = f;
+
+	return f;
+}
+
 /********************************************************************
  *
  * next_day
@@ -627,8 +708,7 @@ ora_date_trunc(PG_FUNCTION_ARGS)
 
 	DateADT result;
 
-	int f = ora_seq_search(VARDATA_ANY(fmt), date_fmt, VARSIZE_ANY_EXHDR(fmt));
-	CHECK_SEQ_SEARCH(f, "round/trunc format string");
+	int f = get_date_fmt(fcinfo, fmt);
 
 	result = _ora_date_trunc(day, f);
 	PG_RETURN_DATEADT(result);
@@ -646,7 +726,8 @@ get_session_timezone(FunctionCallInfo fcinfo)
 {
 #if defined(WIN32)
 
-	pg_tz *result = (pg_tz *) fcinfo->flinfo->fn_extra;
+	DateFmtCache *cache = get_date_fmt_cache(fcinfo);
+	pg_tz *result = cache->tz;
 
 	if (result == NULL)
 	{
@@ -657,7 +738,7 @@ get_session_timezone(FunctionCallInfo fcinfo)
 			elog(ERROR, "cannot to parse timezone \"%s\"", tzn);
 
 		result = *((pg_tz **) extra);
-		fcinfo->flinfo->fn_extra = result;
+		cache->tz = result;
 
 		/*
 		 * check_timezone allocates small block of pg_tz * size. This block
@@ -686,13 +767,8 @@ get_session_timezone(FunctionCallInfo fcinfo)
  * redotz is used only for timestamp with time zone
  */
 static void
-tm_trunc(struct pg_tm *tm, text *fmt, bool *redotz)
+tm_trunc(struct pg_tm *tm, int f, bool *redotz)
 {
-	int f;
-
-	f = ora_seq_search(VARDATA_ANY(fmt), date_fmt, VARSIZE_ANY_EXHDR(fmt));
-	CHECK_SEQ_SEARCH(f, "round/trunc format string");
-
 	tm->tm_sec = 0;
 
 	switch (f)
@@ -756,7 +832,7 @@ ora_timestamptz_trunc(PG_FUNCTION_ARGS)
 					(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
 					 errmsg("timestamp out of range")));
 
-	tm_trunc(tm, fmt, &redotz);
+	tm_trunc(tm, get_date_fmt(fcinfo, fmt), &redotz);
 	fsec = 0;
 
 	if (redotz)
@@ -794,8 +870,7 @@ ora_date_round(PG_FUNCTION_ARGS)
 
 	DateADT result;
 
-	int f = ora_seq_search(VARDATA_ANY(fmt), date_fmt, VARSIZE_ANY_EXHDR(fmt));
-	CHECK_SEQ_SEARCH(f, "round/trunc format string");
+	int f = get_date_fmt(fcinfo, fmt);
 
 	result = _ora_date_round(day, f);
 	PG_RETURN_DATEADT(result);
@@ -807,14 +882,10 @@ ora_date_round(PG_FUNCTION_ARGS)
 	do { if (rounded) _tm_->tm_mday += _tm_->tm_hour >= 12?1:0; } while(0)
 
 static void
-tm_round(struct pg_tm *tm, text *fmt, bool *redotz)
+tm_round(struct pg_tm *tm, int f, bool *redotz)
 {
-	int 	f;
 	bool	rounded = true;
 
-	f = ora_seq_search(VARDATA_ANY(fmt), date_fmt, VARSIZE_ANY_EXHDR(fmt));
-	CHECK_SEQ_SEARCH(f, "round/trunc format string");
-
 	/* set rounding rule */
 	switch (f)
 	{
@@ -913,7 +984,7 @@ ora_timestamptz_round(PG_FUNCTION_ARGS)
 					(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
 					 errmsg("timestamp out of range")));
 
-	tm_round(tm, fmt, &redotz);
+	tm_round(tm, get_date_fmt(fcinfo, fmt), &redotz);
 	fsec = 0;
 
 	if (redotz)
@@ -945,7 +1016,7 @@ ora_timestamp_trunc(PG_FUNCTION_ARGS)
 					(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
 					 errmsg("timestamp out of range")));
 
-	tm_trunc(tm, fmt, &redotz);
+	tm_trunc(tm, get_date_fmt(fcinfo, fmt), &redotz);
 	fsec = 0;
 
 	if (tm2timestamp(tm, fsec, NULL, &result) != 0)
@@ -974,7 +1045,7 @@ ora_timestamp_round(PG_FUNCTION_ARGS)
 					(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
 					 errmsg("timestamp out of range")));
 
-	tm_round(tm, fmt, &redotz);
+	tm_round(tm, get_date_fmt(fcinfo, fmt), &redotz);
 
 	if (tm2timestamp(tm, fsec, NULL, &result) != 0)
 		ereport(ERROR,
@@ -984,6 +1055,64 @@ ora_timestamp_round(PG_FUNCTION_ARGS)
 	PG_RETURN_TIMESTAMP(result);
 }
 
+/*
+ * Planner support function for trunc(date, text) and round(date, text).
+ *
+ * date has no time part, so truncating or rounding to the day, hour or
+ * minute returns the argument unchanged. Such calls are replaced by
+ * the date argument itself, and for example trunc(col, 'DD') = const
+ * can be used as an index condition on col. On PostgreSQL 12 and newer
+ * the function is used as prosupport, on older releases as protransform.
+ */
+Datum
+orafce_date_trunc_transform(PG_FUNCTION_ARGS)
+{
+	Node	   *rawreq = (Node *) PG_GETARG_POINTER(0);
+	FuncExpr   *expr;
+	Node	   *fmtarg;
+	Node	   *result = NULL;
+
+#if PG_VERSION_NUM >= 120000
+
+	if (!IsA(rawreq, SupportRequestSimplify))
+		PG_RETURN_POINTER(NULL);
+
+	expr = ((SupportRequestSimplify *) rawreq)->fcall;
+
+#else
+
+	Assert(IsA(rawreq, FuncExpr));
+
+	expr = (FuncExpr *) rawreq;
+
+#endif
+
+	if (list_length(expr->args) != 2)
+		PG_RETURN_POINTER(NULL);
+
+	fmtarg = (Node *) lsecond(expr->args);
+
+	if (IsA(fmtarg, Const) && !((Const *) fmtarg)->constisnull)
+	{
+		text	   *fmt = DatumGetTextPP(((Const *) fmtarg)->constvalue);
+		int			len = VARSIZE_ANY_EXHDR(fmt);
+		int			f;
+
+		f = len > 0 ? ora_seq_search(VARDATA_ANY(fmt), date_fmt, len) : -1;
+
+		switch (f)
+		{
+		CASE_fmt_DDD
+		CASE_fmt_HH
+		CASE_fmt_MI
+			result = (Node *) linitial(expr->args);
+			break;
+		}
+	}
+
+	PG_RETURN_POINTER(result);
+}
+
 /********************************************************************
  *
  * ora_sysdate - sysdate
@@ -14,8 +14,12 @@
 #include "postgres.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 
 #include "executor/spi.h"
 
@@ -23,12 +27,15 @@
 #include "catalog/pg_type.h"
 #include "fmgr.h"
 #include "funcapi.h"
+#include "lib/ilist.h"
 #include "mb/pg_wchar.h"
 #include "miscadmin.h"
 #include "port.h"
 #include "storage/fd.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/memutils.h"
+#include "utils/tuplestore.h"
 #include "orafce.h"
 #include "builtins.h"
 
@@ -49,8 +56,11 @@ PG_FUNCTION_INFO_V1(utl_file_fopen);
 PG_FUNCTION_INFO_V1(utl_file_is_open);
 PG_FUNCTION_INFO_V1(utl_file_get_line);
 PG_FUNCTION_INFO_V1(utl_file_get_nextline);
+PG_FUNCTION_INFO_V1(utl_file_get_lines);
+PG_FUNCTION_INFO_V1(utl_file_read_lines);
 PG_FUNCTION_INFO_V1(utl_file_put);
 PG_FUNCTION_INFO_V1(utl_file_put_line);
+PG_FUNCTION_INFO_V1(utl_file_put_lines);
 PG_FUNCTION_INFO_V1(utl_file_new_line);
 PG_FUNCTION_INFO_V1(utl_file_putf);
 PG_FUNCTION_INFO_V1(utl_file_fflush);
@@ -93,25 +103,90 @@ PG_FUNCTION_INFO_V1(utl_file_tmpdir);
 
 #define MAX_LINESIZE		32767
 
+/* fcopy copies files by blocks of this size */
+#define COPY_BUFFER_SIZE	(1024 * 1024)
+
+/*
+ * On Linux the whole file is copied inside kernel by copy_file_range
+ * (glibc 2.27 and higher) or by sendfile.
+ */
+#ifdef __linux__
+#define USE_KERNEL_COPY		1
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define USE_COPY_FILE_RANGE	1
+#endif
+#define KERNEL_COPY_CHUNK	(16 * 1024 * 1024)
+#endif
+
 #define CHECK_LINESIZE(max_linesize) \
 	do { \
 		if ((max_linesize) < 1 || (max_linesize) > MAX_LINESIZE) \
 			CUSTOM_EXCEPTION(INVALID_MAXLINESIZE, "maxlinesize is out of range"); \
 	} while(0)
 
+/*
+ * Lines are read from read ahead buffer rbuf. It is allocated only for
+ * files that are read. wbuf is stdio buffer of size specified by fopen.
+ *
+ * When nocache is true, then written data are removed from page cache
+ * after every NOCACHE_CHUNK_SIZE bytes, so big exports don't evict more
+ * useful pages.
+ */
 typedef struct FileSlot
 {
+	dlist_node	node;		/* in open_slots or free_slots list */
+	int		index;			/* position in slots array */
+	int		generation;		/* incremented when slot is reused */
 	FILE   *file;
 	int		max_linesize;
 	int		encoding;
 	int32	id;
+	char   *rbuf;
+	int		rbuf_len;		/* number of bytes in rbuf */
+	int		rbuf_pos;		/* position of first unread byte */
+	char   *wbuf;
+	bool	nocache;
+	off_t	nocache_offset;		/* data before are not cached */
+	size_t	nocache_pending;	/* bytes written after last drop */
 } FileSlot;
 
-#define MAX_SLOTS		50			/* Oracle 10g supports 50 files */
+#define READ_BUFFER_SIZE	(64 * 1024)
+
+#define MIN_BUFFER_SIZE		1024
+#define MAX_BUFFER_SIZE		(64 * 1024 * 1024)
+
+#define NOCACHE_CHUNK_SIZE	(8 * 1024 * 1024)
+
+/*
+ * get_lines and read_lines verify and convert encoding of lines
+ * in batches of this size.
+ */
+#define LINES_BATCH_SIZE	(64 * 1024)
+
+/*
+ * File handle is composed from index of slot and generation of slot,
+ * so the slot is found without searching, and the handle of closed file
+ * is not valid, although the same slot is used by another file. The
+ * index bits should to cover maximum of orafce.utl_file_max_files.
+ * Generation is never zero, so handle is never INVALID_SLOTID.
+ */
+#define SLOT_INDEX_BITS			14
+#define SLOT_INDEX_MASK			((1 << SLOT_INDEX_BITS) - 1)
+#define SLOT_MAX_GENERATION		((1 << (31 - SLOT_INDEX_BITS)) - 1)
+
+#define MAKE_SLOTID(index, generation)	(((generation) << SLOT_INDEX_BITS) | (index))
+#define SLOTID_INDEX(d)					((d) & SLOT_INDEX_MASK)
+
 #define INVALID_SLOTID	0			/* invalid slot id */
 
-static FileSlot	slots[MAX_SLOTS];	/* initilaized with zeros */
-static int32	slotid = 0;			/* next slot id */
+#define INITIAL_SLOTS	16
+
+static FileSlot **slots = NULL;		/* allocated in TopMemoryContext */
+static int		nslots = 0;			/* size of slots array */
+static int		nopened = 0;		/* number of opened files */
+
+static dlist_head open_slots = DLIST_STATIC_INIT(open_slots);
+static dlist_head free_slots = DLIST_STATIC_INIT(free_slots);
 
 static void check_secure_locality(const char *path);
 static char *get_safe_path(text *location, text *filename);
@@ -119,55 +194,134 @@ static int copy_text_file(FILE *srcfile, FILE *dstfile,
 						  int start_line, int end_line);
 
 /*
- * get_descriptor(FILE *file) find any free slot for FILE pointer.
- * If isn't realloc array slots and add 32 new free slots.
- *
+ * Enlarge slots array. New slots are added to free_slots list.
  */
-static int
-get_descriptor(FILE *file, int max_linesize, int encoding)
+static void
+add_slots(void)
 {
-	int i;
+	int			newsize;
+	int			i;
+
+	newsize = nslots > 0 ? nslots * 2 : INITIAL_SLOTS;
+	if (newsize > SLOT_INDEX_MASK + 1)
+		newsize = SLOT_INDEX_MASK + 1;
+
+	if (slots)
+		slots = repalloc(slots, newsize * sizeof(FileSlot *));
+	else
+		slots = MemoryContextAlloc(TopMemoryContext, newsize * sizeof(FileSlot *));
 
-	for (i = 0; i < MAX_SLOTS; i++)
+	for (i = nslots; i < newsize; i++)
 	{
-		if (slots[i].id == INVALID_SLOTID)
-		{
-			slots[i].id = ++slotid;
-			if (slots[i].id == INVALID_SLOTID)
-				slots[i].id = ++slotid;	/* skip INVALID_SLOTID */
-			slots[i].file = file;
-			slots[i].max_linesize = max_linesize;
-			slots[i].encoding = encoding;
-			return slots[i].id;
-		}
+		slots[i] = MemoryContextAllocZero(TopMemoryContext, sizeof(FileSlot));
+		slots[i]->index = i;
+		dlist_push_tail(&free_slots, &slots[i]->node);
 	}
 
-	return INVALID_SLOTID;
+	nslots = newsize;
+}
+
+/*
+ * get_descriptor(FILE *file) find any free slot for FILE pointer.
+ * When there are not free slot, then slots array is enlarged. Returns
+ * INVALID_SLOTID when orafce.utl_file_max_files files are opened.
+ */
+static int
+get_descriptor(FILE *file, int max_linesize, int encoding,
+			   char *wbuf, bool nocache)
+{
+	FileSlot   *slot;
+
+	if (nopened >= orafce_utl_file_max_files)
+		return INVALID_SLOTID;
+
+	if (dlist_is_empty(&free_slots))
+		add_slots();
+
+	slot = dlist_container(FileSlot, node, dlist_pop_head_node(&free_slots));
+	dlist_push_tail(&open_slots, &slot->node);
+	nopened += 1;
+
+	if (++slot->generation > SLOT_MAX_GENERATION)
+		slot->generation = 1;
+
+	slot->id = MAKE_SLOTID(slot->index, slot->generation);
+	slot->file = file;
+	slot->max_linesize = max_linesize;
+	slot->encoding = encoding;
+	slot->rbuf = NULL;
+	slot->rbuf_len = 0;
+	slot->rbuf_pos = 0;
+	slot->wbuf = wbuf;
+	slot->nocache = nocache;
+	slot->nocache_offset = 0;
+	slot->nocache_pending = 0;
+
+	return slot->id;
+}
+
+/* returns slot of file handle or NULL */
+static FileSlot *
+find_slot(int d)
+{
+	int		index;
+
+	if (d <= INVALID_SLOTID)
+		return NULL;
+
+	index = SLOTID_INDEX(d);
+	if (index < nslots && slots[index]->id == d)
+		return slots[index];
+
+	return NULL;
+}
+
+/* return slot of file handle */
+static FileSlot *
+get_slot(int d)
+{
+	FileSlot   *slot = find_slot(d);
+
+	if (!slot)
+		INVALID_FILEHANDLE_EXCEPTION();
+
+	return slot;
 }
 
 /* return stored pointer to FILE */
 static FILE *
 get_stream(int d, size_t *max_linesize, int *encoding)
 {
-	int i;
+	FileSlot   *slot = get_slot(d);
 
-	if (d == INVALID_SLOTID)
-		INVALID_FILEHANDLE_EXCEPTION();
+	if (max_linesize)
+		*max_linesize = slot->max_linesize;
+	if (encoding)
+		*encoding = slot->encoding;
 
-	for (i = 0; i < MAX_SLOTS; i++)
-	{
-		if (slots[i].id == d)
-		{
-			if (max_linesize)
-				*max_linesize = slots[i].max_linesize;
-			if (encoding)
-				*encoding = slots[i].encoding;
-			return slots[i].file;
-		}
-	}
+	return slot->file;
+}
 
-	INVALID_FILEHANDLE_EXCEPTION();
-	return NULL;	/* keep compiler quiet */
+/* release buffers of closed file */
+static void
+free_slot(FileSlot *slot)
+{
+	if (slot->rbuf)
+		pfree(slot->rbuf);
+	if (slot->wbuf)
+		pfree(slot->wbuf);
+
+	slot->rbuf = NULL;
+	slot->wbuf = NULL;
+	slot->nocache = false;
+	slot->rbuf_len = 0;
+	slot->rbuf_pos = 0;
+	slot->file = NULL;
+	slot->id = INVALID_SLOTID;
+
+	dlist_delete(&slot->node);
+	dlist_push_tail(&free_slots, &slot->node);
+	nopened -= 1;
 }
 
 static void
@@ -191,12 +345,17 @@ IO_EXCEPTION(void)
  * FUNCTION UTL_FILE.FOPEN(location text,
  *			   filename text,
  *			   open_mode text,
- *			   max_linesize integer)
+ *			   max_linesize integer
+ *			   [, encoding name
+ *			   [, buffer_size integer
+ *			   [, nocache boolean]]])
  *          RETURNS UTL_FILE.FILE_TYPE;
  *
  * The FOPEN function opens specified file and returns file handle.
  *  open_mode: ['R', 'W', 'A']
  *  max_linesize: [1 .. 32767]
+ *  buffer_size: [1024 .. 64MB], size of write buffer (NULL is default)
+ *  nocache: written data are removed from page cache
  *
  * Exceptions:
  *  INVALID_MODE, INVALID_OPERATION, INVALID_PATH, INVALID_MAXLINESIZE
@@ -211,6 +370,9 @@ utl_file_fopen(PG_FUNCTION_ARGS)
 	FILE	   *file;
 	char	   *fullname;
 	int			d;
+	int			buffer_size = 0;
+	bool		nocache = false;
+	char	   *wbuf = NULL;
 
 	NOT_NULL_ARG(0);
 	NOT_NULL_ARG(1);
@@ -236,6 +398,18 @@ utl_file_fopen(PG_FUNCTION_ARGS)
 	else
 		encoding = GetDatabaseEncoding();
 
+	if (PG_NARGS() > 5 && !PG_ARGISNULL(5))
+	{
+		buffer_size = PG_GETARG_INT32(5);
+		if (buffer_size < MIN_BUFFER_SIZE || buffer_size > MAX_BUFFER_SIZE)
+			ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("buffer_size must be between %d and %d (%d passed)",
+						MIN_BUFFER_SIZE, MAX_BUFFER_SIZE, buffer_size)));
+	}
+
+	nocache = PG_GETARG_IF_EXISTS(6, BOOL, false);
+
 	if (VARSIZE(open_mode) - VARHDRSZ != 1)
 		CUSTOM_EXCEPTION(INVALID_MODE, "open mode is different than [R,W,A]");
 
@@ -275,15 +449,33 @@ utl_file_fopen(PG_FUNCTION_ARGS)
 	if (!file)
 		IO_EXCEPTION();
 
-	d = get_descriptor(file, max_linesize, encoding);
+	/*
+	 * glibc ignores the size, when setvbuf allocates the buffer, so the
+	 * buffer is allocated here. It should to live until fclose.
+	 */
+	if (buffer_size > 0)
+	{
+		wbuf = MemoryContextAlloc(TopMemoryContext, buffer_size);
+		if (setvbuf(file, wbuf, _IOFBF, buffer_size) != 0)
+		{
+			fclose(file);
+			pfree(wbuf);
+			IO_EXCEPTION();
+		}
+	}
+
+	d = get_descriptor(file, max_linesize, encoding, wbuf, nocache);
 	if (d == INVALID_SLOTID)
 	{
 		fclose(file);
+		if (wbuf)
+			pfree(wbuf);
 		ereport(ERROR,
 		    (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
 		     errmsg("program limit exceeded"),
 		     errdetail("Too much concurent opened files"),
-		     errhint("You can only open a maximum of ten files for each session")));
+		     errhint("You can only open a maximum of %d files for each session (orafce.utl_file_max_files).",
+					 orafce_utl_file_max_files)));
 	}
 
 	PG_RETURN_INT32(d);
@@ -294,14 +486,10 @@ utl_file_is_open(PG_FUNCTION_ARGS)
 {
 	if (!PG_ARGISNULL(0))
 	{
-		int	i;
-		int	d = PG_GETARG_INT32(0);
+		FileSlot   *slot = find_slot(PG_GETARG_INT32(0));
 
-		for (i = 0; i < MAX_SLOTS; i++)
-		{
-			if (slots[i].id == d)
-				PG_RETURN_BOOL(slots[i].file != NULL);
-		}
+		if (slot)
+			PG_RETURN_BOOL(slot->file != NULL);
 	}
 
 	PG_RETURN_BOOL(false);
@@ -311,82 +499,262 @@ utl_file_is_open(PG_FUNCTION_ARGS)
 	if (l > max_linesize) \
 		CUSTOM_EXCEPTION(VALUE_ERROR, "buffer is too short");
 
-/* read line from file. set eof if is EOF */
-
-static text *
-get_line(FILE *f, size_t max_linesize, int encoding, bool *iseof)
+/*
+ * Fill read ahead buffer. Returns false on EOF.
+ */
+static bool
+fill_read_buffer(FileSlot *slot)
 {
-	int c;
-	char *buffer = NULL;
-	char *bpt;
-	size_t csize = 0;
-	text *result = NULL;
-	bool eof = true;
+	size_t		n;
 
-	buffer = palloc(max_linesize + 2);
-	bpt = buffer;
+	if (!slot->rbuf)
+		slot->rbuf = MemoryContextAlloc(TopMemoryContext, READ_BUFFER_SIZE);
 
 	errno = 0;
 
-	while (csize < max_linesize && (c = fgetc(f)) != EOF)
+	n = fread(slot->rbuf, 1, READ_BUFFER_SIZE, slot->file);
+
+	slot->rbuf_len = (int) n;
+	slot->rbuf_pos = 0;
+
+	if (n == 0)
 	{
-		eof = false; 	/* I was able read one char */
+		if (ferror(slot->file))
+		{
+			switch (errno)
+			{
+				case EBADF:
+					CUSTOM_EXCEPTION(INVALID_OPERATION, "file descriptor isn't valid for reading");
+					break;
+
+				default:
+					STRERROR_EXCEPTION(READ_ERROR);
+					break;
+			}
+		}
+
+		return false;
+	}
+
+	return true;
+}
 
-		if (c == '\r')  /* lookin ahead \n */
+/*
+ * Append one line (max max_linesize bytes) to buf. The line can be
+ * ended by \n, \r\n or \r. The end of line is not appended. When the
+ * line is longer than max_linesize, then the rest is returned by next
+ * call. Returns false, when there are no data (EOF).
+ */
+static bool
+read_line(FileSlot *slot, size_t max_linesize, StringInfo buf)
+{
+	size_t		csize = 0;
+	bool		eof = true;
+
+	while (csize < max_linesize)
+	{
+		char	   *p;
+		char	   *nl;
+		char	   *cr;
+		size_t		n;
+
+		if (slot->rbuf_pos >= slot->rbuf_len && !fill_read_buffer(slot))
+			break;
+
+		eof = false;	/* I was able read one char */
+
+		p = slot->rbuf + slot->rbuf_pos;
+		n = Min((size_t) (slot->rbuf_len - slot->rbuf_pos), max_linesize - csize);
+
+		nl = memchr(p, '\n', n);
+		cr = memchr(p, '\r', nl ? (size_t) (nl - p) : n);
+
+		if (cr)
 		{
-			c = fgetc(f);
-			if (c == EOF)
-				break;  /* last char */
+			appendBinaryStringInfo(buf, p, cr - p);
+			slot->rbuf_pos += cr - p + 1;
+
+			/* lookin ahead \n */
+			if (slot->rbuf_pos >= slot->rbuf_len && !fill_read_buffer(slot))
+				break;	/* last char */
+
+			if (slot->rbuf[slot->rbuf_pos] == '\n')
+				slot->rbuf_pos += 1;
 
-			if (c != '\n')
-				ungetc(c, f);
-			/* skip \r\n */
 			break;
 		}
-		else if (c == '\n')
+		else if (nl)
+		{
+			appendBinaryStringInfo(buf, p, nl - p);
+			slot->rbuf_pos += nl - p + 1;
 			break;
+		}
 
-		++csize;
-		*bpt++ = c;
+		appendBinaryStringInfo(buf, p, n);
+		slot->rbuf_pos += n;
+		csize += n;
 	}
 
-	if (!eof)
-	{
-		char   *decoded;
-		size_t		len;
+	return !eof;
+}
+
+/* returns verified string converted to database encoding */
+static text *
+decode_line(char *str, size_t len, int encoding)
+{
+	char	   *decoded;
+	text	   *result;
+
+	pg_verify_mbstr(encoding, str, size2int(len), false);
+	decoded = (char *) pg_do_encoding_conversion((unsigned char *) str,
+								 size2int(len), encoding, GetDatabaseEncoding());
+	if (decoded != str)
+		len = strlen(decoded);
+
+	result = palloc(len + VARHDRSZ);
+	memcpy(VARDATA(result), decoded, len);
+	SET_VARSIZE(result, len + VARHDRSZ);
+
+	if (decoded != str)
+		pfree(decoded);
+
+	return result;
+}
 
-		pg_verify_mbstr(encoding, buffer, size2int(csize), false);
-		decoded = (char *) pg_do_encoding_conversion((unsigned char *) buffer,
-									 size2int(csize), encoding, GetDatabaseEncoding());
-		len = (decoded == buffer ? csize : strlen(decoded));
-		result = palloc(len + VARHDRSZ);
-		memcpy(VARDATA(result), decoded, len);
-		SET_VARSIZE(result, len + VARHDRSZ);
-		if (decoded != buffer)
-			pfree(decoded);
+/* read line from file. set eof if is EOF */
+
+static text *
+get_line(FileSlot *slot, size_t max_linesize, int encoding, bool *iseof)
+{
+	StringInfoData	buf;
+	text		   *result = NULL;
+
+	initStringInfo(&buf);
+
+	if (read_line(slot, max_linesize, &buf))
+	{
+		result = decode_line(buf.data, buf.len, encoding);
 		*iseof = false;
 	}
 	else
+		*iseof = true;
+
+	pfree(buf.data);
+	return result;
+}
+
+/*
+ * Verify and convert encoding of lines separated by \n in one step,
+ * and store the lines to tuplestore. The \n byte cannot be part of
+ * multibyte char in any supported encoding.
+ */
+static void
+store_lines(Tuplestorestate *tupstore, TupleDesc tupdesc,
+			char *str, size_t len, int encoding)
+{
+	char	   *decoded;
+	char	   *p;
+	char	   *end;
+
+	pg_verify_mbstr(encoding, str, size2int(len), false);
+	decoded = (char *) pg_do_encoding_conversion((unsigned char *) str,
+								 size2int(len), encoding, GetDatabaseEncoding());
+	if (decoded != str)
+		len = strlen(decoded);
+
+	p = decoded;
+	end = decoded + len;
+
+	while (p < end)
 	{
-		switch (errno)
-		{
-			case 0:
-				break;
+		char	   *nl = memchr(p, '\n', end - p);
+		Datum		value;
+		bool		isnull = false;
+
+		Assert(nl != NULL);
 
-			case EBADF:
-				CUSTOM_EXCEPTION(INVALID_OPERATION, "file descriptor isn't valid for reading");
-				break;
+		value = PointerGetDatum(cstring_to_text_with_len(p, nl - p));
+		tuplestore_putvalues(tupstore, tupdesc, &value, &isnull);
+		pfree(DatumGetPointer(value));
 
-			default:
-				STRERROR_EXCEPTION(READ_ERROR);
-				break;
+		p = nl + 1;
+	}
+
+	if (decoded != str)
+		pfree(decoded);
+}
+
+/*
+ * Read nlines lines (all lines when nlines is -1) from file and
+ * returns these lines as result of set returning function.
+ */
+static void
+return_lines(FunctionCallInfo fcinfo, FileSlot *slot,
+			 size_t max_linesize, int encoding, int nlines)
+{
+	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	TupleDesc		tupdesc;
+	MemoryContext	oldcxt;
+	StringInfoData	buf;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	oldcxt = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+#if PG_VERSION_NUM >= 120000
+
+	tupdesc = CreateTemplateTupleDesc(1);
+
+#else
+
+	tupdesc = CreateTemplateTupleDesc(1, false);
+
+#endif
+
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "line", TEXTOID, -1, 0);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcxt);
+
+	initStringInfo(&buf);
+
+	while (nlines != 0)
+	{
+		CHECK_FOR_INTERRUPTS();
+
+		if (!read_line(slot, max_linesize, &buf))
+			break;
+
+		appendStringInfoChar(&buf, '\n');
+
+		if (buf.len >= LINES_BATCH_SIZE)
+		{
+			store_lines(tupstore, tupdesc, buf.data, buf.len, encoding);
+			resetStringInfo(&buf);
 		}
 
-		*iseof = true;
+		if (nlines > 0)
+			nlines--;
 	}
 
-	pfree(buffer);
-	return result;
+	if (buf.len > 0)
+		store_lines(tupstore, tupdesc, buf.data, buf.len, encoding);
+
+	pfree(buf.data);
 }
 
 
@@ -402,14 +770,14 @@ get_line(FILE *f, size_t max_linesize, int encoding, bool *iseof)
 Datum
 utl_file_get_line(PG_FUNCTION_ARGS)
 {
-	size_t	max_linesize = 0;	/* keep compiler quiet */
-	int		encoding = 0;		/* keep compiler quiet */
-	FILE   *f;
+	size_t	max_linesize;
+	FileSlot *slot;
 	text   *result;
 	bool	iseof;
 
 	CHECK_FILE_HANDLE();
-	f = get_stream(PG_GETARG_INT32(0), &max_linesize, &encoding);
+	slot = get_slot(PG_GETARG_INT32(0));
+	max_linesize = slot->max_linesize;
 
 	/* 'len' overwrites max_linesize, but must be smaller than max_linesize */
 	if (PG_NARGS() > 1 && !PG_ARGISNULL(1))
@@ -420,7 +788,7 @@ utl_file_get_line(PG_FUNCTION_ARGS)
 			max_linesize = len;
 	}
 
-	result = get_line(f, max_linesize, encoding, &iseof);
+	result = get_line(slot, max_linesize, slot->encoding, &iseof);
 
 	if (iseof)
 	    	ereport(ERROR,
@@ -444,16 +812,14 @@ utl_file_get_line(PG_FUNCTION_ARGS)
 Datum
 utl_file_get_nextline(PG_FUNCTION_ARGS)
 {
-	size_t	max_linesize = 0;		/* keep compiler quiet */
-	int		encoding = 0;			/* keep compiler quiet */
-	FILE   *f;
+	FileSlot *slot;
 	text   *result;
 	bool	iseof;
 
 	CHECK_FILE_HANDLE();
-	f = get_stream(PG_GETARG_INT32(0), &max_linesize, &encoding);
+	slot = get_slot(PG_GETARG_INT32(0));
 
-	result = get_line(f, max_linesize, encoding, &iseof);
+	result = get_line(slot, slot->max_linesize, slot->encoding, &iseof);
 
 	if (iseof)
 		PG_RETURN_NULL();
@@ -461,6 +827,77 @@ utl_file_get_nextline(PG_FUNCTION_ARGS)
 	PG_RETURN_TEXT_P(result);
 }
 
+/*
+ * FUNCTION UTL_FILE.GET_LINES(file UTL_TYPE.FILE_TYPE, lines int DEFAULT NULL)
+ *          RETURNS SETOF text;
+ *
+ * Reads next lines (all remaining lines when lines is NULL) from file.
+ * PostgreSQL specific.
+ *
+ * Exceptions:
+ *  INVALID_FILEHANDLE, INVALID_OPERATION, READ_ERROR
+ */
+Datum
+utl_file_get_lines(PG_FUNCTION_ARGS)
+{
+	FileSlot   *slot;
+	int			nlines = -1;
+
+	CHECK_FILE_HANDLE();
+	slot = get_slot(PG_GETARG_INT32(0));
+
+	if (PG_NARGS() > 1 && !PG_ARGISNULL(1))
+	{
+		nlines = PG_GETARG_INT32(1);
+		if (nlines <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("lines must be positive (%d passed)", nlines)));
+	}
+
+	return_lines(fcinfo, slot, slot->max_linesize, slot->encoding, nlines);
+
+	return (Datum) 0;
+}
+
+/*
+ * FUNCTION UTL_FILE.READ_LINES(location text, filename text)
+ *          RETURNS SETOF text;
+ *
+ * Returns all lines of file. The file is opened and closed inside
+ * the function. Lines longer than 32767 bytes are split. PostgreSQL
+ * specific.
+ *
+ * Exceptions:
+ *  INVALID_OPERATION, INVALID_PATH, READ_ERROR
+ */
+Datum
+utl_file_read_lines(PG_FUNCTION_ARGS)
+{
+	char	   *fullname;
+	FileSlot	slot;
+
+	NOT_NULL_ARG(0);
+	NOT_NULL_ARG(1);
+
+	fullname = get_safe_path(PG_GETARG_TEXT_P(0), PG_GETARG_TEXT_P(1));
+
+	memset(&slot, 0, sizeof(FileSlot));
+
+	slot.file = AllocateFile(fullname, "r");
+	if (slot.file == NULL)
+		IO_EXCEPTION();
+
+	slot.rbuf = palloc(READ_BUFFER_SIZE);
+
+	return_lines(fcinfo, &slot, MAX_LINESIZE, GetDatabaseEncoding(), -1);
+
+	FreeFile(slot.file);
+	pfree(slot.rbuf);
+
+	return (Datum) 0;
+}
+
 static void
 do_flush(FILE *f)
 {
@@ -473,6 +910,59 @@ do_flush(FILE *f)
 	}
 }
 
+/*
+ * Write data to disk and remove them from page cache. Dirty pages
+ * cannot be removed, so the data are written synchronously where
+ * it is possible. Errors are ignored, it is just a hint.
+ */
+static void
+drop_written_pages(FileSlot *slot)
+{
+	int		fd;
+	off_t	pos;
+
+	do_flush(slot->file);
+
+	fd = fileno(slot->file);
+	pos = lseek(fd, 0, SEEK_CUR);
+
+	if (pos > slot->nocache_offset)
+	{
+
+#ifdef HAVE_SYNC_FILE_RANGE
+
+		(void) sync_file_range(fd, slot->nocache_offset, pos - slot->nocache_offset,
+							   SYNC_FILE_RANGE_WAIT_BEFORE |
+							   SYNC_FILE_RANGE_WRITE |
+							   SYNC_FILE_RANGE_WAIT_AFTER);
+
+#endif
+
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_DONTNEED)
+
+		(void) posix_fadvise(fd, slot->nocache_offset, pos - slot->nocache_offset,
+							 POSIX_FADV_DONTNEED);
+
+#endif
+
+		slot->nocache_offset = pos;
+	}
+
+	slot->nocache_pending = 0;
+}
+
+/* count written bytes, drop them from page cache if nocache is used */
+static void
+written_bytes(FileSlot *slot, size_t n)
+{
+	if (slot->nocache)
+	{
+		slot->nocache_pending += n;
+		if (slot->nocache_pending >= NOCACHE_CHUNK_SIZE)
+			drop_written_pages(slot);
+	}
+}
+
 /*
  * FUNCTION UTL_FILE.PUT(file UTL_FILE.FILE_TYPE, buffer text)
  *          RETURNS bool;
@@ -531,19 +1021,18 @@ do_write(PG_FUNCTION_ARGS, int n, FILE *f, size_t max_linesize, int encoding)
 	return len;
 }
 
-static FILE *
+static FileSlot *
 do_put(PG_FUNCTION_ARGS)
 {
-	FILE   *f;
-	size_t	max_linesize = 0;		/* keep compiler quiet */
-	int		encoding = 0;			/* keep compiler quiet */
+	FileSlot *slot;
 
 	CHECK_FILE_HANDLE();
-	f = get_stream(PG_GETARG_INT32(0), &max_linesize, &encoding);
+	slot = get_slot(PG_GETARG_INT32(0));
 
 	NOT_NULL_ARG(1);
-	do_write(fcinfo, 1, f, max_linesize, encoding);
-	return f;
+	written_bytes(slot, do_write(fcinfo, 1, slot->file,
+								 slot->max_linesize, slot->encoding));
+	return slot;
 }
 
 Datum
@@ -553,36 +1042,121 @@ utl_file_put(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(true);
 }
 
+#ifndef WIN32
+#define NEW_LINE		"\n"
+#else
+#define NEW_LINE		"\r\n"
+#endif
+
 static void
-do_new_line(FILE *f, int lines)
+do_new_line(FileSlot *slot, int lines)
 {
 	int	i;
 	for (i = 0; i < lines; i++)
 	{
-#ifndef WIN32
-		if (fputc('\n', f) == EOF)
-		    CHECK_ERRNO_PUT();
-#else
-		if (fputs("\r\n", f) == EOF)
+		if (fputs(NEW_LINE, slot->file) == EOF)
 		    CHECK_ERRNO_PUT();
-#endif
 	}
+
+	if (lines > 0)
+		written_bytes(slot, lines * strlen(NEW_LINE));
 }
 
 Datum
 utl_file_put_line(PG_FUNCTION_ARGS)
 {
-	FILE   *f;
+	FileSlot *slot;
 	bool	autoflush;
 
-	f = do_put(fcinfo);
+	slot = do_put(fcinfo);
 
 	autoflush = PG_GETARG_IF_EXISTS(2, BOOL, false);
 
-	do_new_line(f, 1);
+	do_new_line(slot, 1);
+
+	if (autoflush)
+		do_flush(slot->file);
+
+	PG_RETURN_BOOL(true);
+}
+
+/*
+ * FUNCTION UTL_FILE.PUT_LINES(file UTL_FILE.FILE_TYPE, buffer text[],
+ *                             autoflush bool DEFAULT false)
+ *          RETURNS bool;
+ *
+ * Puts all lines of array to file. The lines are encoded to one buffer
+ * that is written by one fwrite. PostgreSQL specific.
+ *
+ * Exceptions:
+ *  INVALID_FILEHANDLE, INVALID_OPERATION, WRITE_ERROR, VALUE_ERROR
+ */
+Datum
+utl_file_put_lines(PG_FUNCTION_ARGS)
+{
+	FileSlot   *slot;
+	ArrayType  *lines;
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nelems;
+	int			i;
+	size_t		max_linesize;
+	StringInfoData buf;
+	bool		autoflush;
+
+	CHECK_FILE_HANDLE();
+	slot = get_slot(PG_GETARG_INT32(0));
+	max_linesize = slot->max_linesize;
+
+	NOT_NULL_ARG(1);
+	lines = PG_GETARG_ARRAYTYPE_P(1);
+
+	if (ARR_NDIM(lines) > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+				 errmsg("wrong number of array subscripts")));
+
+	deconstruct_array(lines, TEXTOID, -1, false, 'i',
+					  &elems, &nulls, &nelems);
+
+	initStringInfo(&buf);
+
+	for (i = 0; i < nelems; i++)
+	{
+		text	   *line;
+		char	   *str;
+		size_t		len;
+
+		if (nulls[i])
+			ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("null value not allowed"),
+				 errhint("%dth line is NULL.", i + 1)));
+
+		line = DatumGetTextPP(elems[i]);
+		str = encode_text(slot->encoding, line, &len);
+		CHECK_LENGTH(len);
+
+		appendBinaryStringInfo(&buf, str, len);
+		appendStringInfoString(&buf, NEW_LINE);
+
+		if (VARDATA_ANY(line) != str)
+			pfree(str);
+	}
+
+	if (buf.len > 0)
+	{
+		if (fwrite(buf.data, 1, buf.len, slot->file) != (size_t) buf.len)
+			CHECK_ERRNO_PUT();
+
+		written_bytes(slot, buf.len);
+	}
+
+	pfree(buf.data);
 
+	autoflush = PG_GETARG_IF_EXISTS(2, BOOL, false);
 	if (autoflush)
-		do_flush(f);
+		do_flush(slot->file);
 
 	PG_RETURN_BOOL(true);
 }
@@ -590,14 +1164,14 @@ utl_file_put_line(PG_FUNCTION_ARGS)
 Datum
 utl_file_new_line(PG_FUNCTION_ARGS)
 {
-	FILE   *f;
+	FileSlot *slot;
 	int		lines;
 
 	CHECK_FILE_HANDLE();
-	f = get_stream(PG_GETARG_INT32(0), NULL, NULL);
+	slot = get_slot(PG_GETARG_INT32(0));
 	lines = PG_GETARG_IF_EXISTS(1, INT32, 1);
 
-	do_new_line(f, lines);
+	do_new_line(slot, lines);
 
 	PG_RETURN_BOOL(true);
 }
@@ -620,6 +1194,7 @@ utl_file_new_line(PG_FUNCTION_ARGS)
 Datum
 utl_file_putf(PG_FUNCTION_ARGS)
 {
+	FileSlot *slot;
 	FILE   *f;
 	char   *format;
 	size_t	max_linesize;
@@ -630,7 +1205,10 @@ utl_file_putf(PG_FUNCTION_ARGS)
 	size_t	cur_len = 0;
 
 	CHECK_FILE_HANDLE();
-	f = get_stream(PG_GETARG_INT32(0), &max_linesize, &encoding);
+	slot = get_slot(PG_GETARG_INT32(0));
+	f = slot->file;
+	max_linesize = slot->max_linesize;
+	encoding = slot->encoding;
 
 	NOT_NULL_ARG(1);
 	format = encode_text(encoding, PG_GETARG_TEXT_P(1), &format_length);
@@ -674,6 +1252,8 @@ utl_file_putf(PG_FUNCTION_ARGS)
 			CHECK_ERRNO_PUT();
 	}
 
+	written_bytes(slot, cur_len);
+
 	PG_RETURN_BOOL(true);
 }
 
@@ -713,27 +1293,32 @@ utl_file_fflush(PG_FUNCTION_ARGS)
  * Exception:
  *  INVALID_FILEHANDLE, WRITE_ERROR
  */
+static void
+close_slot(FileSlot *slot)
+{
+	if (slot->file && slot->nocache)
+		drop_written_pages(slot);
+
+	if (slot->file && fclose(slot->file) != 0)
+	{
+		if (errno == EBADF)
+			CUSTOM_EXCEPTION(INVALID_FILEHANDLE, "File is not an opened");
+		else
+			STRERROR_EXCEPTION(WRITE_ERROR);
+	}
+
+	free_slot(slot);
+}
+
 Datum
 utl_file_fclose(PG_FUNCTION_ARGS)
 {
-	int i;
-	int	d = PG_GETARG_INT32(0);
+	FileSlot   *slot = find_slot(PG_GETARG_INT32(0));
 
-	for (i = 0; i < MAX_SLOTS; i++)
+	if (slot)
 	{
-		if (slots[i].id == d)
-		{
-			if (slots[i].file && fclose(slots[i].file) != 0)
-			{
-				if (errno == EBADF)
-					CUSTOM_EXCEPTION(INVALID_FILEHANDLE, "File is not an opened");
-				else
-					STRERROR_EXCEPTION(WRITE_ERROR);
-			}
-			slots[i].file = NULL;
-			slots[i].id = INVALID_SLOTID;
-			PG_RETURN_NULL();
-		}
+		close_slot(slot);
+		PG_RETURN_NULL();
 	}
 
 	INVALID_FILEHANDLE_EXCEPTION();
@@ -745,29 +1330,20 @@ utl_file_fclose(PG_FUNCTION_ARGS)
  * FUNCTION UTL_FILE.FCLOSE_ALL()
  *          RETURNS void
  *
- * Close all opened files.
+ * Close all opened files. Only list of opened files is walked.
  *
  * Exceptions: WRITE_ERROR
  */
 Datum
 utl_file_fclose_all(PG_FUNCTION_ARGS)
 {
-	int i;
+	dlist_mutable_iter iter;
 
-	for (i = 0; i < MAX_SLOTS; i++)
+	dlist_foreach_modify(iter, &open_slots)
 	{
-		if (slots[i].id != INVALID_SLOTID)
-		{
-			if (slots[i].file && fclose(slots[i].file) != 0)
-			{
-				if (errno == EBADF)
-					CUSTOM_EXCEPTION(INVALID_FILEHANDLE, "File is not an opened");
-				else
-					STRERROR_EXCEPTION(WRITE_ERROR);
-			}
-			slots[i].file = NULL;
-			slots[i].id = INVALID_SLOTID;
-		}
+		FileSlot   *slot = dlist_container(FileSlot, node, iter.cur);
+
+		close_slot(slot);
 	}
 
 	PG_RETURN_VOID();
@@ -1071,45 +1647,127 @@ utl_file_fcopy(PG_FUNCTION_ARGS)
 }
 
 /*
- * Copy srcfile to dstfile. Return 0 if succeeded, or non-0 if error.
+ * Copy whole srcfile to dstfile. Return 0 if succeeded, or non-0 if error.
  */
 static int
-copy_text_file(FILE *srcfile, FILE *dstfile, int start_line, int end_line)
+copy_whole_file(FILE *srcfile, FILE *dstfile)
 {
 	char	   *buffer;
 	size_t		len;
-	int			i;
-
-	buffer = palloc(MAX_LINESIZE);
 
 	errno = 0;
 
-	/* skip first start_line. */
-	for (i = 1; i < start_line; i++)
+#ifdef USE_KERNEL_COPY
+
 	{
-		CHECK_FOR_INTERRUPTS();
+		int			srcfd = fileno(srcfile);
+		int			dstfd = fileno(dstfile);
+		ssize_t		n;
+
+#ifdef USE_COPY_FILE_RANGE
+
 		do
 		{
-			if (fgets(buffer, MAX_LINESIZE, srcfile) == NULL)
-				return errno;
-			len = strlen(buffer);
-		} while(buffer[len - 1] != '\n');
+			CHECK_FOR_INTERRUPTS();
+			n = copy_file_range(srcfd, NULL, dstfd, NULL, KERNEL_COPY_CHUNK, 0);
+		} while (n > 0 || (n < 0 && errno == EINTR));
+
+		if (n == 0)
+			return 0;
+
+		/*
+		 * Older kernels don't support copy between file systems, and some
+		 * file systems don't support copy_file_range at all. The file
+		 * offsets are updated, so we can continue by sendfile.
+		 */
+		if (errno != ENOSYS && errno != EXDEV &&
+			errno != EINVAL && errno != EOPNOTSUPP)
+			return errno;
+
+		errno = 0;
+
+#endif
+
+		do
+		{
+			CHECK_FOR_INTERRUPTS();
+			n = sendfile(dstfd, srcfd, NULL, KERNEL_COPY_CHUNK);
+		} while (n > 0 || (n < 0 && errno == EINTR));
+
+		if (n == 0)
+			return 0;
+
+		if (errno != ENOSYS && errno != EINVAL)
+			return errno;
+
+		errno = 0;
 	}
 
-	/* copy until end_line. */
-	for (; i <= end_line; i++)
+#endif
+
+	buffer = palloc(COPY_BUFFER_SIZE);
+
+	while ((len = fread(buffer, 1, COPY_BUFFER_SIZE, srcfile)) > 0)
 	{
 		CHECK_FOR_INTERRUPTS();
-		do
+
+		if (fwrite(buffer, 1, len, dstfile) != len)
+			return errno;
+	}
+
+	if (ferror(srcfile))
+		return errno ? errno : EIO;
+
+	pfree(buffer);
+
+	return 0;
+}
+
+/*
+ * Copy srcfile to dstfile. Return 0 if succeeded, or non-0 if error.
+ */
+static int
+copy_text_file(FILE *srcfile, FILE *dstfile, int start_line, int end_line)
+{
+	char	   *buffer;
+	size_t		len;
+	int64		i = 1;
+
+	if (start_line == 1 && end_line == INT_MAX)
+		return copy_whole_file(srcfile, dstfile);
+
+	buffer = palloc(COPY_BUFFER_SIZE);
+
+	errno = 0;
+
+	/* skip first start_line and copy until end_line. */
+	while (i <= end_line &&
+		   (len = fread(buffer, 1, COPY_BUFFER_SIZE, srcfile)) > 0)
+	{
+		char	   *p = buffer;
+		char	   *end = buffer + len;
+
+		CHECK_FOR_INTERRUPTS();
+
+		while (p < end && i <= end_line)
 		{
-			if (fgets(buffer, MAX_LINESIZE, srcfile) == NULL)
-				return errno;
-			len = strlen(buffer);
-			if (fwrite(buffer, 1, len, dstfile) != len)
+			char	   *nl = memchr(p, '\n', end - p);
+			char	   *next = nl ? nl + 1 : end;
+
+			if (i >= start_line &&
+				fwrite(p, 1, next - p, dstfile) != (size_t) (next - p))
 				return errno;
-		} while(buffer[len - 1] != '\n');
+
+			if (nl)
+				i++;
+
+			p = next;
+		}
 	}
 
+	if (ferror(srcfile))
+		return errno ? errno : EIO;
+
 	pfree(buffer);
 
 	return 0;
@@ -15,6 +15,25 @@ AS 'MODULE_PATHNAME','ora_date_round'
 LANGUAGE C IMMUTABLE STRICT;
 COMMENT ON FUNCTION pg_catalog.round(date, text) IS 'round dates according to the specified format';
 
+CREATE FUNCTION date_trunc_transform(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_date_trunc_transform'
+LANGUAGE C
+STRICT
+IMMUTABLE;
+
+do $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'server_version_num' AND setting::int >= 120000) THEN
+    UPDATE pg_proc SET prosupport= 'date_trunc_transform'::regproc::oid WHERE oid = 'pg_catalog.trunc(date, text)'::regprocedure;
+    UPDATE pg_proc SET prosupport= 'date_trunc_transform'::regproc::oid WHERE oid = 'pg_catalog.round(date, text)'::regprocedure;
+  ELSE
+    UPDATE pg_proc SET protransform= 'date_trunc_transform'::regproc::oid WHERE oid = 'pg_catalog.trunc(date, text)'::regprocedure;
+    UPDATE pg_proc SET protransform= 'date_trunc_transform'::regproc::oid WHERE oid = 'pg_catalog.round(date, text)'::regprocedure;
+  END IF;
+END
+$$;
+
 CREATE FUNCTION pg_catalog.next_day(value date, weekday text)
 RETURNS date
 AS 'MODULE_PATHNAME'
@@ -505,6 +524,12 @@ AS 'MODULE_PATHNAME','dbms_output_serveroutput'
 LANGUAGE C VOLATILE STRICT;
 COMMENT ON FUNCTION dbms_output.serveroutput(IN bool) IS 'Set drowing output';
 
+CREATE FUNCTION dbms_output.serveroutput(IN bool, IN flush_lines int4)
+RETURNS void
+AS 'MODULE_PATHNAME','dbms_output_serveroutput_batch'
+LANGUAGE C VOLATILE STRICT;
+COMMENT ON FUNCTION dbms_output.serveroutput(IN bool, IN int4) IS 'Set drowing output, lines are sent in batches';
+
 CREATE FUNCTION dbms_output.put(IN a text)
 RETURNS void
 AS 'MODULE_PATHNAME','dbms_output_put'
@@ -534,6 +559,12 @@ AS 'MODULE_PATHNAME','dbms_output_get_lines'
 LANGUAGE C VOLATILE STRICT;
 COMMENT ON FUNCTION dbms_output.get_lines(OUT text[], INOUT int4) IS 'Get lines from output buffer';
 
+CREATE FUNCTION dbms_output.get_lines()
+RETURNS SETOF text
+AS 'MODULE_PATHNAME','dbms_output_get_lines_set'
+LANGUAGE C VOLATILE STRICT;
+COMMENT ON FUNCTION dbms_output.get_lines() IS 'Get all lines from output buffer as set';
+
 
 -- others functions
 
@@ -818,6 +849,50 @@ RETURNS timestamptz
 AS 'MODULE_PATHNAME', 'ora_decode'
 LANGUAGE C IMMUTABLE;
 
+CREATE FUNCTION nvl_transform(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_nvl_transform'
+LANGUAGE C
+STRICT
+IMMUTABLE;
+
+CREATE FUNCTION nvl2_transform(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_nvl2_transform'
+LANGUAGE C
+STRICT
+IMMUTABLE;
+
+CREATE FUNCTION lnnvl_transform(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_lnnvl_transform'
+LANGUAGE C
+STRICT
+IMMUTABLE;
+
+CREATE FUNCTION decode_transform(internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_decode_transform'
+LANGUAGE C
+STRICT
+IMMUTABLE;
+
+do $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'server_version_num' AND setting::int >= 120000) THEN
+    UPDATE pg_proc SET prosupport= 'nvl_transform'::regproc::oid WHERE oid = 'nvl(anyelement, anyelement)'::regprocedure;
+    UPDATE pg_proc SET prosupport= 'nvl2_transform'::regproc::oid WHERE oid = 'nvl2(anyelement, anyelement, anyelement)'::regprocedure;
+    UPDATE pg_proc SET prosupport= 'lnnvl_transform'::regproc::oid WHERE oid = 'pg_catalog.lnnvl(bool)'::regprocedure;
+    UPDATE pg_proc SET prosupport= 'decode_transform'::regproc::oid WHERE proname = 'decode' AND prosrc = 'ora_decode';
+  ELSE
+    UPDATE pg_proc SET protransform= 'nvl_transform'::regproc::oid WHERE oid = 'nvl(anyelement, anyelement)'::regprocedure;
+    UPDATE pg_proc SET protransform= 'nvl2_transform'::regproc::oid WHERE oid = 'nvl2(anyelement, anyelement, anyelement)'::regprocedure;
+    UPDATE pg_proc SET protransform= 'lnnvl_transform'::regproc::oid WHERE oid = 'pg_catalog.lnnvl(bool)'::regprocedure;
+    UPDATE pg_proc SET protransform= 'decode_transform'::regproc::oid WHERE proname = 'decode' AND prosrc = 'ora_decode';
+  END IF;
+END
+$$;
+
 
 CREATE SCHEMA dbms_pipe;
 
@@ -863,6 +938,36 @@ AS $$SELECT dbms_pipe.send_message($1,NULL,NULL);$$
 LANGUAGE SQL VOLATILE;
 COMMENT ON FUNCTION dbms_pipe.send_message(text) IS 'Send message to pipe';
 
+CREATE FUNCTION dbms_pipe.send_messages(text, bytea[], int, int)
+RETURNS int
+AS 'MODULE_PATHNAME','dbms_pipe_send_messages'
+LANGUAGE C VOLATILE;
+COMMENT ON FUNCTION dbms_pipe.send_messages(text, bytea[], int, int) IS 'Send array of messages to pipe';
+
+CREATE FUNCTION dbms_pipe.send_messages(text, bytea[], int)
+RETURNS int
+AS $$SELECT dbms_pipe.send_messages($1,$2,$3,NULL);$$
+LANGUAGE SQL VOLATILE;
+COMMENT ON FUNCTION dbms_pipe.send_messages(text, bytea[], int) IS 'Send array of messages to pipe';
+
+CREATE FUNCTION dbms_pipe.send_messages(text, bytea[])
+RETURNS int
+AS $$SELECT dbms_pipe.send_messages($1,$2,NULL,NULL);$$
+LANGUAGE SQL VOLATILE;
+COMMENT ON FUNCTION dbms_pipe.send_messages(text, bytea[]) IS 'Send array of messages to pipe';
+
+CREATE FUNCTION dbms_pipe.receive_messages(text, int, int)
+RETURNS SETOF bytea
+AS 'MODULE_PATHNAME','dbms_pipe_receive_messages'
+LANGUAGE C VOLATILE;
+COMMENT ON FUNCTION dbms_pipe.receive_messages(text, int, int) IS 'Receive messages from pipe';
+
+CREATE FUNCTION dbms_pipe.receive_messages(text, int)
+RETURNS SETOF bytea
+AS $$SELECT dbms_pipe.receive_messages($1,$2,NULL::int);$$
+LANGUAGE SQL VOLATILE;
+COMMENT ON FUNCTION dbms_pipe.receive_messages(text, int) IS 'Receive messages from pipe';
+
 CREATE FUNCTION dbms_pipe.unique_session_name()
 RETURNS varchar
 AS 'MODULE_PATHNAME','dbms_pipe_unique_session_name'
@@ -878,6 +983,15 @@ COMMENT ON FUNCTION dbms_pipe.__list_pipes() IS '';
 CREATE VIEW dbms_pipe.db_pipes
 AS SELECT * FROM dbms_pipe.__list_pipes() AS (Name varchar, Items int, Size int, "limit" int, "private" bool, "owner" varchar);
 
+CREATE FUNCTION dbms_pipe.shmem_stats(OUT kind text, OUT name text, OUT stat text, OUT value bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME','dbms_pipe_shmem_stats'
+LANGUAGE C VOLATILE STRICT;
+COMMENT ON FUNCTION dbms_pipe.shmem_stats() IS 'Returns statistics of shared memory used by dbms_pipe and dbms_alert';
+
+CREATE VIEW dbms_pipe.db_shmem_stats
+AS SELECT * FROM dbms_pipe.shmem_stats();
+
 CREATE FUNCTION dbms_pipe.next_item_type()
 RETURNS int
 AS 'MODULE_PATHNAME','dbms_pipe_next_item_type'
@@ -1166,6 +1280,33 @@ AS 'MODULE_PATHNAME','plvdate_isleapyear'
 LANGUAGE C VOLATILE STRICT;
 COMMENT ON FUNCTION plvdate.isleapyear(date) IS 'Is leap year';
 
+/* named calendars, holidays are repeated every year (year is ignored) */
+CREATE TABLE plvdate.calendars(
+  name text PRIMARY KEY,
+  nonbizdays int NOT NULL DEFAULT 65,       /* bit mask, 1 .. Sunday, 64 .. Saturday */
+  use_easter bool NOT NULL DEFAULT true,
+  use_great_friday bool NOT NULL DEFAULT true,
+  country text,
+  holidays date[] NOT NULL DEFAULT '{}',
+  exceptions date[] NOT NULL DEFAULT '{}');
+SELECT pg_catalog.pg_extension_config_dump('plvdate.calendars', '');
+REVOKE ALL ON plvdate.calendars FROM PUBLIC;
+
+/* allow only read on plvdate.calendars to unprivileged users */
+GRANT SELECT ON TABLE plvdate.calendars TO PUBLIC;
+
+CREATE FUNCTION plvdate.save_calendar(text)
+RETURNS void
+AS 'MODULE_PATHNAME','plvdate_save_calendar'
+LANGUAGE C VOLATILE STRICT;
+COMMENT ON FUNCTION plvdate.save_calendar(text) IS 'Store current calendar under name';
+
+CREATE FUNCTION plvdate.use_calendar(text)
+RETURNS void
+AS 'MODULE_PATHNAME','plvdate_use_calendar'
+LANGUAGE C VOLATILE STRICT;
+COMMENT ON FUNCTION plvdate.use_calendar(text) IS 'Load stored calendar';
+
 
 -- PLVstr package
 
@@ -1614,6 +1755,12 @@ AS 'MODULE_PATHNAME','utl_file_fopen'
 LANGUAGE C VOLATILE;
 COMMENT ON FUNCTION utl_file.fopen(text,text,text,integer,name) IS 'The FOPEN function open file and return file handle';
 
+CREATE FUNCTION utl_file.fopen(location text, filename text, open_mode text, max_linesize integer, encoding name, buffer_size integer, nocache boolean DEFAULT false)
+RETURNS utl_file.file_type
+AS 'MODULE_PATHNAME','utl_file_fopen'
+LANGUAGE C VOLATILE;
+COMMENT ON FUNCTION utl_file.fopen(text,text,text,integer,name,integer,boolean) IS 'The FOPEN function open file with specified write buffer and return file handle';
+
 CREATE FUNCTION utl_file.fopen(location text, filename text, open_mode text, max_linesize integer)
 RETURNS utl_file.file_type
 AS 'MODULE_PATHNAME','utl_file_fopen'
@@ -1647,6 +1794,18 @@ AS 'MODULE_PATHNAME','utl_file_get_nextline'
 LANGUAGE C VOLATILE;
 COMMENT ON FUNCTION utl_file.get_nextline(utl_file.file_type) IS 'Returns one line from file or returns NULL';
 
+CREATE FUNCTION utl_file.get_lines(file utl_file.file_type, lines integer DEFAULT NULL)
+RETURNS SETOF text
+AS 'MODULE_PATHNAME','utl_file_get_lines'
+LANGUAGE C VOLATILE;
+COMMENT ON FUNCTION utl_file.get_lines(utl_file.file_type, integer) IS 'Returns next lines from file';
+
+CREATE FUNCTION utl_file.read_lines(location text, filename text)
+RETURNS SETOF text
+AS 'MODULE_PATHNAME','utl_file_read_lines'
+LANGUAGE C VOLATILE;
+COMMENT ON FUNCTION utl_file.read_lines(text, text) IS 'Returns all lines from file';
+
 CREATE FUNCTION utl_file.put(file utl_file.file_type, buffer text)
 RETURNS bool
 AS 'MODULE_PATHNAME','utl_file_put'
@@ -1683,6 +1842,12 @@ AS 'MODULE_PATHNAME','utl_file_put_line'
 LANGUAGE C VOLATILE;
 COMMENT ON FUNCTION utl_file.put_line(utl_file.file_type, text, bool) IS 'Puts data to specified file and append newline character';
 
+CREATE FUNCTION utl_file.put_lines(file utl_file.file_type, buffer text[], autoflush bool DEFAULT false)
+RETURNS bool
+AS 'MODULE_PATHNAME','utl_file_put_lines'
+LANGUAGE C VOLATILE;
+COMMENT ON FUNCTION utl_file.put_lines(utl_file.file_type, text[], bool) IS 'Puts lines to specified file and append newline character after every line';
+
 CREATE FUNCTION utl_file.putf(file utl_file.file_type, format text, arg1 text, arg2 text, arg3 text, arg4 text, arg5 text)
 RETURNS bool
 AS 'MODULE_PATHNAME','utl_file_putf'
@@ -2010,6 +2175,18 @@ AS 'MODULE_PATHNAME','dbms_random_value'
 LANGUAGE C VOLATILE;
 COMMENT ON FUNCTION dbms_random.value() IS 'Generate Random number x, where x is greater or equal to 0 and less then 1';
 
+CREATE FUNCTION dbms_random.values(n int, low double precision, high double precision)
+RETURNS SETOF double precision
+AS 'MODULE_PATHNAME','dbms_random_values'
+LANGUAGE C STRICT VOLATILE;
+COMMENT ON FUNCTION dbms_random.values(int, double precision, double precision) IS 'Generate n random numbers x, where x is greater or equal to low and less then high';
+
+CREATE FUNCTION dbms_random.strings(n int, opt text, len int)
+RETURNS SETOF text
+AS 'MODULE_PATHNAME','dbms_random_strings'
+LANGUAGE C STRICT VOLATILE;
+COMMENT ON FUNCTION dbms_random.strings(int, text, int) IS 'Create n random strings';
+
 CREATE FUNCTION dump(text)
 RETURNS varchar
 AS 'MODULE_PATHNAME', 'orafce_dump'
@@ -2106,6 +2283,352 @@ CREATE AGGREGATE pg_catalog.median(double precision) (
   FINALFUNC=pg_catalog.median8_finalfn
 );
 
+CREATE FUNCTION pg_catalog.percentile4_transfn(internal, real, double precision)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_percentile4_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.percentile4_finalfn(internal)
+RETURNS real
+AS 'MODULE_PATHNAME','orafce_percentile4_finalfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.quantile4_finalfn(internal)
+RETURNS real
+AS 'MODULE_PATHNAME','orafce_quantile4_finalfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.percentile8_transfn(internal, double precision, double precision)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_percentile8_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.percentile8_finalfn(internal)
+RETURNS double precision
+AS 'MODULE_PATHNAME','orafce_percentile8_finalfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.quantile8_finalfn(internal)
+RETURNS double precision
+AS 'MODULE_PATHNAME','orafce_quantile8_finalfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE pg_catalog.percentile(real, double precision) (
+  SFUNC=pg_catalog.percentile4_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.percentile4_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.percentile(double precision, double precision) (
+  SFUNC=pg_catalog.percentile8_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.percentile8_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.quantile(real, double precision) (
+  SFUNC=pg_catalog.percentile4_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.quantile4_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.quantile(double precision, double precision) (
+  SFUNC=pg_catalog.percentile8_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.quantile8_finalfn
+);
+
+/*
+ * Support of partial (parallel) aggregation. The aggregates are created
+ * without combine functions, because PostgreSQL 9.5 doesn't know them.
+ */
+
+CREATE FUNCTION pg_catalog.listagg_combinefn(internal, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_listagg_combinefn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.listagg_serialize(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME','orafce_listagg_serialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION pg_catalog.listagg_deserialize(bytea, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_listagg_deserialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION pg_catalog.median4_combinefn(internal, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_median4_combinefn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.median4_serialize(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME','orafce_median4_serialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION pg_catalog.median4_deserialize(bytea, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_median4_deserialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION pg_catalog.median8_combinefn(internal, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_median8_combinefn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.median8_serialize(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME','orafce_median8_serialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION pg_catalog.median8_deserialize(bytea, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_median8_deserialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+do $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'server_version_num' AND setting::int >= 90600) THEN
+    UPDATE pg_catalog.pg_aggregate
+       SET aggcombinefn = 'pg_catalog.listagg_combinefn'::regproc,
+           aggserialfn = 'pg_catalog.listagg_serialize'::regproc,
+           aggdeserialfn = 'pg_catalog.listagg_deserialize'::regproc
+     WHERE aggfnoid IN ('pg_catalog.listagg(text)'::regprocedure,
+                        'pg_catalog.listagg(text, text)'::regprocedure,
+                        'pg_catalog.wm_concat(text)'::regprocedure);
+
+    UPDATE pg_catalog.pg_aggregate
+       SET aggcombinefn = 'pg_catalog.median4_combinefn'::regproc,
+           aggserialfn = 'pg_catalog.median4_serialize'::regproc,
+           aggdeserialfn = 'pg_catalog.median4_deserialize'::regproc
+     WHERE aggfnoid IN ('pg_catalog.median(real)'::regprocedure,
+                        'pg_catalog.percentile(real, double precision)'::regprocedure,
+                        'pg_catalog.quantile(real, double precision)'::regprocedure);
+
+    UPDATE pg_catalog.pg_aggregate
+       SET aggcombinefn = 'pg_catalog.median8_combinefn'::regproc,
+           aggserialfn = 'pg_catalog.median8_serialize'::regproc,
+           aggdeserialfn = 'pg_catalog.median8_deserialize'::regproc
+     WHERE aggfnoid IN ('pg_catalog.median(double precision)'::regprocedure,
+                        'pg_catalog.percentile(double precision, double precision)'::regprocedure,
+                        'pg_catalog.quantile(double precision, double precision)'::regprocedure);
+
+    UPDATE pg_catalog.pg_proc SET proparallel = 's'
+     WHERE oid IN ('pg_catalog.listagg(text)'::regprocedure,
+                   'pg_catalog.listagg(text, text)'::regprocedure,
+                   'pg_catalog.wm_concat(text)'::regprocedure,
+                   'pg_catalog.listagg1_transfn(internal, text)'::regprocedure,
+                   'pg_catalog.listagg2_transfn(internal, text, text)'::regprocedure,
+                   'pg_catalog.wm_concat_transfn(internal, text)'::regprocedure,
+                   'pg_catalog.listagg_finalfn(internal)'::regprocedure,
+                   'pg_catalog.listagg_combinefn(internal, internal)'::regprocedure,
+                   'pg_catalog.listagg_serialize(internal)'::regprocedure,
+                   'pg_catalog.listagg_deserialize(bytea, internal)'::regprocedure,
+                   'pg_catalog.median(real)'::regprocedure,
+                   'pg_catalog.median(double precision)'::regprocedure,
+                   'pg_catalog.percentile(real, double precision)'::regprocedure,
+                   'pg_catalog.percentile(double precision, double precision)'::regprocedure,
+                   'pg_catalog.quantile(real, double precision)'::regprocedure,
+                   'pg_catalog.quantile(double precision, double precision)'::regprocedure,
+                   'pg_catalog.median4_transfn(internal, real)'::regprocedure,
+                   'pg_catalog.median4_finalfn(internal)'::regprocedure,
+                   'pg_catalog.median8_transfn(internal, double precision)'::regprocedure,
+                   'pg_catalog.median8_finalfn(internal)'::regprocedure,
+                   'pg_catalog.percentile4_transfn(internal, real, double precision)'::regprocedure,
+                   'pg_catalog.percentile4_finalfn(internal)'::regprocedure,
+                   'pg_catalog.quantile4_finalfn(internal)'::regprocedure,
+                   'pg_catalog.percentile8_transfn(internal, double precision, double precision)'::regprocedure,
+                   'pg_catalog.percentile8_finalfn(internal)'::regprocedure,
+                   'pg_catalog.quantile8_finalfn(internal)'::regprocedure,
+                   'pg_catalog.median4_combinefn(internal, internal)'::regprocedure,
+                   'pg_catalog.median4_serialize(internal)'::regprocedure,
+                   'pg_catalog.median4_deserialize(bytea, internal)'::regprocedure,
+                   'pg_catalog.median8_combinefn(internal, internal)'::regprocedure,
+                   'pg_catalog.median8_serialize(internal)'::regprocedure,
+                   'pg_catalog.median8_deserialize(bytea, internal)'::regprocedure);
+  END IF;
+END
+$$;
+
+CREATE FUNCTION pg_catalog.approx_median_transfn(internal, double precision)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_approx_median_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.approx_median_transfn(internal, double precision, integer)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_approx_median_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.approx_percentile_transfn(internal, double precision, double precision)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_approx_percentile_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.approx_percentile_transfn(internal, double precision, double precision, integer)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_approx_percentile_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.approx_percentile_finalfn(internal)
+RETURNS double precision
+AS 'MODULE_PATHNAME','orafce_approx_percentile_finalfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.approx_combinefn(internal, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_approx_combinefn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.approx_serialize(internal)
+RETURNS bytea
+AS 'MODULE_PATHNAME','orafce_approx_serialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION pg_catalog.approx_deserialize(bytea, internal)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_approx_deserialize'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE AGGREGATE pg_catalog.approx_median(double precision) (
+  SFUNC=pg_catalog.approx_median_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.approx_percentile_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.approx_median(double precision, integer) (
+  SFUNC=pg_catalog.approx_median_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.approx_percentile_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.approx_percentile(double precision, double precision) (
+  SFUNC=pg_catalog.approx_percentile_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.approx_percentile_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.approx_percentile(double precision, double precision, integer) (
+  SFUNC=pg_catalog.approx_percentile_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.approx_percentile_finalfn
+);
+
+do $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'server_version_num' AND setting::int >= 90600) THEN
+    UPDATE pg_catalog.pg_aggregate
+       SET aggcombinefn = 'pg_catalog.approx_combinefn'::regproc,
+           aggserialfn = 'pg_catalog.approx_serialize'::regproc,
+           aggdeserialfn = 'pg_catalog.approx_deserialize'::regproc
+     WHERE aggfnoid IN ('pg_catalog.approx_median(double precision)'::regprocedure,
+                        'pg_catalog.approx_median(double precision, integer)'::regprocedure,
+                        'pg_catalog.approx_percentile(double precision, double precision)'::regprocedure,
+                        'pg_catalog.approx_percentile(double precision, double precision, integer)'::regprocedure);
+
+    UPDATE pg_catalog.pg_proc SET proparallel = 's'
+     WHERE oid IN ('pg_catalog.approx_median(double precision)'::regprocedure,
+                   'pg_catalog.approx_median(double precision, integer)'::regprocedure,
+                   'pg_catalog.approx_percentile(double precision, double precision)'::regprocedure,
+                   'pg_catalog.approx_percentile(double precision, double precision, integer)'::regprocedure,
+                   'pg_catalog.approx_median_transfn(internal, double precision)'::regprocedure,
+                   'pg_catalog.approx_median_transfn(internal, double precision, integer)'::regprocedure,
+                   'pg_catalog.approx_percentile_transfn(internal, double precision, double precision)'::regprocedure,
+                   'pg_catalog.approx_percentile_transfn(internal, double precision, double precision, integer)'::regprocedure,
+                   'pg_catalog.approx_percentile_finalfn(internal)'::regprocedure,
+                   'pg_catalog.approx_combinefn(internal, internal)'::regprocedure,
+                   'pg_catalog.approx_serialize(internal)'::regprocedure,
+                   'pg_catalog.approx_deserialize(bytea, internal)'::regprocedure);
+  END IF;
+END
+$$;
+
+CREATE FUNCTION pg_catalog.median_transfn(internal, integer)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_median_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.median_transfn(internal, bigint)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_median_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.percentile_transfn(internal, integer, double precision)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_percentile_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION pg_catalog.percentile_transfn(internal, bigint, double precision)
+RETURNS internal
+AS 'MODULE_PATHNAME','orafce_percentile_transfn'
+LANGUAGE C IMMUTABLE;
+
+CREATE AGGREGATE pg_catalog.median(integer) (
+  SFUNC=pg_catalog.median_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.median8_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.median(bigint) (
+  SFUNC=pg_catalog.median_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.median8_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.percentile(integer, double precision) (
+  SFUNC=pg_catalog.percentile_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.percentile8_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.percentile(bigint, double precision) (
+  SFUNC=pg_catalog.percentile_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.percentile8_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.quantile(integer, double precision) (
+  SFUNC=pg_catalog.percentile_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.quantile8_finalfn
+);
+
+CREATE AGGREGATE pg_catalog.quantile(bigint, double precision) (
+  SFUNC=pg_catalog.percentile_transfn,
+  STYPE=internal,
+  FINALFUNC=pg_catalog.quantile8_finalfn
+);
+
+do $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'server_version_num' AND setting::int >= 90600) THEN
+    UPDATE pg_catalog.pg_aggregate
+       SET aggcombinefn = 'pg_catalog.median8_combinefn'::regproc,
+           aggserialfn = 'pg_catalog.median8_serialize'::regproc,
+           aggdeserialfn = 'pg_catalog.median8_deserialize'::regproc
+     WHERE aggfnoid IN ('pg_catalog.median(integer)'::regprocedure,
+                        'pg_catalog.median(bigint)'::regprocedure,
+                        'pg_catalog.percentile(integer, double precision)'::regprocedure,
+                        'pg_catalog.percentile(bigint, double precision)'::regprocedure,
+                        'pg_catalog.quantile(integer, double precision)'::regprocedure,
+                        'pg_catalog.quantile(bigint, double precision)'::regprocedure);
+
+    UPDATE pg_catalog.pg_proc SET proparallel = 's'
+     WHERE oid IN ('pg_catalog.median(integer)'::regprocedure,
+                   'pg_catalog.median(bigint)'::regprocedure,
+                   'pg_catalog.percentile(integer, double precision)'::regprocedure,
+                   'pg_catalog.percentile(bigint, double precision)'::regprocedure,
+                   'pg_catalog.quantile(integer, double precision)'::regprocedure,
+                   'pg_catalog.quantile(bigint, double precision)'::regprocedure,
+                   'pg_catalog.median_transfn(internal, integer)'::regprocedure,
+                   'pg_catalog.median_transfn(internal, bigint)'::regprocedure,
+                   'pg_catalog.percentile_transfn(internal, integer, double precision)'::regprocedure,
+                   'pg_catalog.percentile_transfn(internal, bigint, double precision)'::regprocedure);
+  END IF;
+END
+$$;
+
 -- oracle.varchar2 type support
 
 CREATE FUNCTION varchar2in(cstring,oid,integer)
@@ -3270,6 +3793,7 @@ GRANT USAGE ON SCHEMA plvchr TO PUBLIC;
 GRANT USAGE ON SCHEMA dbms_output TO PUBLIC;
 GRANT USAGE ON SCHEMA plvsubst TO PUBLIC;
 GRANT SELECT ON dbms_pipe.db_pipes to PUBLIC;
+GRANT SELECT ON dbms_pipe.db_shmem_stats to PUBLIC;
 GRANT USAGE ON SCHEMA dbms_utility TO PUBLIC;
 GRANT USAGE ON SCHEMA plvlex TO PUBLIC;
 GRANT USAGE ON SCHEMA utl_file TO PUBLIC;
@@ -11,18 +11,75 @@
 /*  default value */
 char  *nls_date_format = NULL;
 char  *orafce_timezone = NULL;
+char  *orafce_plvdate_calendar = NULL;
+
+int orafce_pipe_shmem_size = 30;
+int orafce_max_pipes = 30;
+int orafce_max_events = 30;
+int orafce_max_locks = 256;
+
+int orafce_utl_file_max_files = 50;
 
 void
 _PG_init(void)
 {
 
+	/*
+	 * Sizes of shared memory used by dbms_pipe and dbms_alert. These
+	 * values can be changed only when orafce is loaded by
+	 * shared_preload_libraries.
+	 */
+	DefineCustomIntVariable("orafce.pipe_shmem_size",
+									"Size of shared memory used by dbms_pipe and dbms_alert messages.",
+									NULL,
+									&orafce_pipe_shmem_size,
+									30,
+									30,
+									MAX_KILOBYTES,
+									PGC_POSTMASTER,
+									GUC_UNIT_KB,
+									NULL, NULL, NULL);
+
+	DefineCustomIntVariable("orafce.max_pipes",
+									"Maximum number of dbms_pipe pipes.",
+									NULL,
+									&orafce_max_pipes,
+									30,
+									1,
+									65536,
+									PGC_POSTMASTER,
+									0,
+									NULL, NULL, NULL);
+
+	DefineCustomIntVariable("orafce.max_events",
+									"Maximum number of dbms_alert registered events.",
+									NULL,
+									&orafce_max_events,
+									30,
+									1,
+									65536,
+									PGC_POSTMASTER,
+									0,
+									NULL, NULL, NULL);
+
+	DefineCustomIntVariable("orafce.max_locks",
+									"Maximum number of sessions collaborating through dbms_alert.",
+									NULL,
+									&orafce_max_locks,
+									256,
+									16,
+									65536,
+									PGC_POSTMASTER,
+									0,
+									NULL, NULL, NULL);
+
 #if PG_VERSION_NUM < 90600
 
-	RequestAddinLWLocks(1);
+	RequestAddinLWLocks(ORAFCE_LWLOCKS);
 
 #endif
 
-	RequestAddinShmemSpace(SHMEMMSGSZ);
+	RequestAddinShmemSpace(ora_shmem_size(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS));
 
 	/* Define custom GUC variables. */
 	DefineCustomStringVariable("orafce.nls_date_format",
@@ -44,6 +101,26 @@ _PG_init(void)
 									0,
 									check_timezone, NULL, show_timezone);
 
+	DefineCustomIntVariable("orafce.utl_file_max_files",
+									"Maximum number of files opened by utl_file in one session.",
+									NULL,
+									&orafce_utl_file_max_files,
+									50,
+									1,
+									16384,
+									PGC_USERSET,
+									0,
+									NULL, NULL, NULL);
+
+	DefineCustomStringVariable("orafce.plvdate_calendar",
+									"Name of calendar from plvdate.calendars used by plvdate functions.",
+									NULL,
+									&orafce_plvdate_calendar,
+									NULL,
+									PGC_USERSET,
+									0,
+									NULL, NULL, NULL);
+
 	DefineCustomBoolVariable("orafce.varchar2_null_safe_concat",
 									"Specify timezone used for sysdate function.",
 									NULL,
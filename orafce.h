@@ -30,6 +30,27 @@ extern int ora_instr(text *txt, text *pattern, int start, int nth);
 extern int ora_mb_strlen(text *str, char **sizes, int **positions);
 extern int ora_mb_strlen1(text *str);
 
+/*
+ * Sparse char -> byte offset index of multibyte string. The byte offset
+ * of every ORA_MB_INDEX_STEP-th char is stored, so the offset of any char
+ * is found by walking at most ORA_MB_INDEX_STEP - 1 chars. Strings without
+ * multibyte chars are not indexed.
+ */
+#define ORA_MB_INDEX_STEP		64
+
+typedef struct
+{
+	const char *str;
+	int			len;			/* length in bytes */
+	int			nchars;			/* length in chars */
+	bool		onebyte;		/* every char has one byte, marks is NULL */
+	int		   *marks;
+} ora_mb_index;
+
+extern bool ora_is_ascii(const char *str, int len);
+extern void ora_mb_index_init(ora_mb_index *idx, const char *str, int len);
+extern int ora_mb_index_offset(ora_mb_index *idx, int n);
+
 extern char *nls_date_format;
 extern char *orafce_timezone;
 
@@ -37,6 +58,8 @@ extern char *nls_date_format;
 extern char *orafce_timezone;
 
 extern bool orafce_varchar2_null_safe_concat;
+extern char *orafce_plvdate_calendar;
+extern int orafce_utl_file_max_files;
 
 /*
  * Version compatibility
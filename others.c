@@ -1,13 +1,28 @@
 #include "postgres.h"
 #include <stdlib.h>
 #include <locale.h>
+#ifdef HAVE_XLOCALE_H
+#include <xlocale.h>
+#endif
 #include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
 #include "fmgr.h"
 #include "lib/stringinfo.h"
+#include "nodes/makefuncs.h"
 #include "nodes/nodeFuncs.h"
 #include "nodes/pg_list.h"
 #include "nodes/primnodes.h"
+
+#if PG_VERSION_NUM >= 120000
+
+#include "nodes/supportnodes.h"
+
+#else
+
+#include "optimizer/clauses.h"
+
+#endif
+
 #include "parser/parse_expr.h"
 #include "parser/parse_oper.h"
 #include "utils/builtins.h"
@@ -23,8 +38,38 @@
  * package by Jan Pazdziora
  */
 
+/*
+ * When the platform has locale_t, the collation of requested locale
+ * is used by strxfrm_l, and LC_COLLATE of the process is not changed.
+ */
+#if defined(HAVE_LOCALE_T) && !defined(WIN32)
+#define NLS_USE_LOCALE_T
+#endif
+
+typedef struct NlsLocale
+{
+	struct NlsLocale *next;
+	char	   *name;
+	bool		is_default;		/* same as server LC_COLLATE */
+#ifdef NLS_USE_LOCALE_T
+	locale_t	loc;
+#endif
+	size_t		multiplication;	/* expected size of result per input byte */
+} NlsLocale;
+
+/* limit of the expected size of strxfrm result per input byte */
+#define NLS_MAX_MULTIPLICATION		16
+
+/* nlssort cache stored in fn_extra */
+typedef struct
+{
+	NlsLocale  *locale;			/* last used locale */
+	char	   *buffer;			/* zero terminated copy of string */
+	int			buffer_size;
+} NlsCache;
+
 static char *lc_collate_cache = NULL;
-static size_t multiplication = 1;
+static NlsLocale *nls_locales = NULL;
 
 text *def_locale = NULL;
 
@@ -106,6 +151,217 @@ ora_nvl2(PG_FUNCTION_ARGS)
 	PG_RETURN_NULL();
 }
 
+/*
+ * Planner support functions
+ *
+ * nvl, nvl2, lnnvl and decode are replaced by COALESCE, CASE and
+ * boolean test expressions, so the executor evaluates them without
+ * function call and the planner can see inside. On PostgreSQL 12 and
+ * newer these functions are used as prosupport, on older releases they
+ * are used as protransform.
+ */
+static FuncExpr *
+simplify_request_expr(FunctionCallInfo fcinfo)
+{
+	Node	   *rawreq = (Node *) PG_GETARG_POINTER(0);
+
+#if PG_VERSION_NUM >= 120000
+
+	if (IsA(rawreq, SupportRequestSimplify))
+		return ((SupportRequestSimplify *) rawreq)->fcall;
+
+	return NULL;
+
+#else
+
+	Assert(IsA(rawreq, FuncExpr));
+
+	return (FuncExpr *) rawreq;
+
+#endif
+}
+
+static NullTest *
+make_null_test(Expr *arg, NullTestType nulltesttype)
+{
+	NullTest   *ntest = makeNode(NullTest);
+
+	ntest->arg = arg;
+	ntest->nulltesttype = nulltesttype;
+	ntest->argisrow = false;
+	ntest->location = -1;
+
+	return ntest;
+}
+
+PG_FUNCTION_INFO_V1(orafce_nvl_transform);
+
+/*
+ * nvl(a, b) -> COALESCE(a, b)
+ */
+Datum
+orafce_nvl_transform(PG_FUNCTION_ARGS)
+{
+	FuncExpr   *expr = simplify_request_expr(fcinfo);
+	CoalesceExpr *coalesce;
+
+	if (!expr || list_length(expr->args) != 2)
+		PG_RETURN_POINTER(NULL);
+
+	coalesce = makeNode(CoalesceExpr);
+	coalesce->coalescetype = expr->funcresulttype;
+	coalesce->coalescecollid = expr->funccollid;
+	coalesce->args = list_copy(expr->args);
+	coalesce->location = expr->location;
+
+	PG_RETURN_POINTER(coalesce);
+}
+
+PG_FUNCTION_INFO_V1(orafce_nvl2_transform);
+
+/*
+ * nvl2(a, b, c) -> CASE WHEN a IS NOT NULL THEN b ELSE c END
+ */
+Datum
+orafce_nvl2_transform(PG_FUNCTION_ARGS)
+{
+	FuncExpr   *expr = simplify_request_expr(fcinfo);
+	CaseWhen   *when;
+	CaseExpr   *caseexpr;
+
+	if (!expr || list_length(expr->args) != 3)
+		PG_RETURN_POINTER(NULL);
+
+	when = makeNode(CaseWhen);
+	when->expr = (Expr *) make_null_test(linitial(expr->args), IS_NOT_NULL);
+	when->result = lsecond(expr->args);
+	when->location = -1;
+
+	caseexpr = makeNode(CaseExpr);
+	caseexpr->casetype = expr->funcresulttype;
+	caseexpr->casecollid = expr->funccollid;
+	caseexpr->arg = NULL;
+	caseexpr->args = list_make1(when);
+	caseexpr->defresult = lthird(expr->args);
+	caseexpr->location = expr->location;
+
+	PG_RETURN_POINTER(caseexpr);
+}
+
+PG_FUNCTION_INFO_V1(orafce_lnnvl_transform);
+
+/*
+ * lnnvl(a) -> a IS NOT TRUE
+ */
+Datum
+orafce_lnnvl_transform(PG_FUNCTION_ARGS)
+{
+	FuncExpr   *expr = simplify_request_expr(fcinfo);
+	BooleanTest *btest;
+
+	if (!expr || list_length(expr->args) != 1)
+		PG_RETURN_POINTER(NULL);
+
+	btest = makeNode(BooleanTest);
+	btest->arg = linitial(expr->args);
+	btest->booltesttype = IS_NOT_TRUE;
+	btest->location = expr->location;
+
+	PG_RETURN_POINTER(btest);
+}
+
+PG_FUNCTION_INFO_V1(orafce_decode_transform);
+
+/*
+ * decode(lhs, [rhs, ret], ..., [default]) ->
+ *   CASE WHEN lhs = rhs THEN ret ... ELSE default END
+ *
+ * NULL search value is replaced by lhs IS NULL, not constant search value
+ * by lhs IS NOT DISTINCT FROM rhs. The key is evaluated for every search
+ * value, so only keys that are cheap and stable are inlined.
+ */
+Datum
+orafce_decode_transform(PG_FUNCTION_ARGS)
+{
+	FuncExpr   *expr = simplify_request_expr(fcinfo);
+	Expr	   *lhs;
+	Oid			eqop;
+	Oid			eqfunc;
+	int			nargs;
+	int			i;
+	List	   *whens = NIL;
+	Expr	   *defresult;
+	CaseExpr   *caseexpr;
+
+	if (!expr || list_length(expr->args) < 3)
+		PG_RETURN_POINTER(NULL);
+
+	lhs = linitial(expr->args);
+	if (!IsA(lhs, Var) && !IsA(lhs, Const) && !IsA(lhs, Param))
+		PG_RETURN_POINTER(NULL);
+
+	get_sort_group_operators(exprType((Node *) lhs), false, false, false,
+							 NULL, &eqop, NULL, NULL);
+	if (!OidIsValid(eqop))
+		PG_RETURN_POINTER(NULL);
+
+	eqfunc = get_opcode(eqop);
+
+	nargs = list_length(expr->args);
+	if (nargs % 2 == 0)
+	{
+		defresult = llast(expr->args);
+		nargs -= 1;
+	}
+	else
+		defresult = (Expr *) makeNullConst(expr->funcresulttype, -1,
+										   expr->funccollid);
+
+	for (i = 1; i < nargs; i += 2)
+	{
+		Expr	   *rhs = list_nth(expr->args, i);
+		Expr	   *cond;
+		CaseWhen   *when;
+
+		if (IsA(rhs, Const) && ((Const *) rhs)->constisnull)
+			cond = (Expr *) make_null_test(lhs, IS_NULL);
+		else
+		{
+			OpExpr	   *opexpr;
+
+			opexpr = (OpExpr *) make_opclause(eqop, BOOLOID, false,
+											  lhs, rhs,
+											  InvalidOid, expr->inputcollid);
+			opexpr->opfuncid = eqfunc;
+
+			if (IsA(rhs, Const))
+				cond = (Expr *) opexpr;
+			else
+			{
+				NodeSetTag(opexpr, T_DistinctExpr);
+				cond = makeBoolExpr(NOT_EXPR, list_make1(opexpr), -1);
+			}
+		}
+
+		when = makeNode(CaseWhen);
+		when->expr = cond;
+		when->result = list_nth(expr->args, i + 1);
+		when->location = -1;
+
+		whens = lappend(whens, when);
+	}
+
+	caseexpr = makeNode(CaseExpr);
+	caseexpr->casetype = expr->funcresulttype;
+	caseexpr->casecollid = expr->funccollid;
+	caseexpr->arg = NULL;
+	caseexpr->args = whens;
+	caseexpr->defresult = defresult;
+	caseexpr->location = expr->location;
+
+	PG_RETURN_POINTER(caseexpr);
+}
+
 PG_FUNCTION_INFO_V1(ora_set_nls_sort);
 
 Datum
@@ -125,20 +381,20 @@ ora_set_nls_sort(PG_FUNCTION_ARGS)
 	PG_RETURN_VOID();
 }
 
-static text*
-_nls_run_strxfrm(text *string, text *locale)
+/*
+ * Returns cached description of locale. The locales are created only
+ * once per session, the list lives in TopMemoryContext.
+ */
+static NlsLocale *
+get_nls_locale(const char *name, int len)
 {
-	char *string_str;
-	int string_len;
+	NlsLocale  *nl;
+	char	   *locale_str;
+	bool		is_default;
 
-	char *locale_str = NULL;
-	int locale_len = 0;
-
-	text *result;
-	char *tmp = NULL;
-	size_t size = 0;
-	size_t rest = 0;
-	int changed_locale = 0;
+	for (nl = nls_locales; nl; nl = nl->next)
+		if (strncmp(nl->name, name, len) == 0 && nl->name[len] == '\0')
+			return nl;
 
 	/*
 	 * Save the default, server-wide locale setting.
@@ -158,105 +414,137 @@ _nls_run_strxfrm(text *string, text *locale)
 			elog(ERROR, "failed to retrieve the default LC_COLLATE value");
 	}
 
-	/*
-	 * To run strxfrm, we need a zero-terminated strings.
-	 */
-	string_len = VARSIZE_ANY_EXHDR(string);
-	if (string_len < 0)
-		return NULL;
-	string_str = palloc(string_len + 1);
-	memcpy(string_str, VARDATA_ANY(string), string_len);
+	locale_str = pnstrdup(name, len);
+	is_default = len == 0 || strcmp(locale_str, lc_collate_cache) == 0;
 
-	*(string_str + string_len) = '\0';
+	nl = MemoryContextAllocZero(TopMemoryContext, sizeof(NlsLocale));
 
-	if (locale)
+#ifdef NLS_USE_LOCALE_T
+
+	if (!is_default)
 	{
-		locale_len = VARSIZE_ANY_EXHDR(locale);
+		nl->loc = newlocale(LC_COLLATE_MASK, locale_str, (locale_t) 0);
+		if (nl->loc == (locale_t) 0)
+		{
+			pfree(nl);
+			pfree(locale_str);
+			elog(ERROR, "failed to set the requested LC_COLLATE value [%.*s]", len, name);
+		}
 	}
 
+#endif
+
+	nl->name = MemoryContextStrdup(TopMemoryContext, locale_str);
+	nl->is_default = is_default;
+	nl->multiplication = 1;
+	nl->next = nls_locales;
+	nls_locales = nl;
+
+	pfree(locale_str);
+
+	return nl;
+}
+
+static size_t
+nls_strxfrm(NlsLocale *nl, char *dest, const char *src, size_t size)
+{
+	size_t		result;
+
+	if (nl->is_default)
+		return strxfrm(dest, src, size);
+
+#ifdef NLS_USE_LOCALE_T
+
+	result = strxfrm_l(dest, src, size, nl->loc);
+
+#else
+
 	/*
-	 * If different than default locale is requested, call setlocale.
+	 * Nothing can raise an error between the calls of setlocale,
+	 * so the server cannot stay with changed locale.
 	 */
-	if (locale_len > 0
-		&& (strncmp(lc_collate_cache, VARDATA_ANY(locale), locale_len)
-			|| *(lc_collate_cache + locale_len) != '\0'))
-	{
-		locale_str = palloc(locale_len + 1);
-		memcpy(locale_str, VARDATA_ANY(locale), locale_len);
-		*(locale_str + locale_len) = '\0';
+	if (!setlocale(LC_COLLATE, nl->name))
+		elog(ERROR, "failed to set the requested LC_COLLATE value [%s]", nl->name);
 
-		/*
-		 * Try to set correct locales.
-		 * If setlocale failed, we know the default stayed the same,
-		 * co we can safely elog.
-		 */
-		if (!setlocale(LC_COLLATE, locale_str))
-			elog(ERROR, "failed to set the requested LC_COLLATE value [%s]", locale_str);
+	result = strxfrm(dest, src, size);
 
-		changed_locale = 1;
+	if (!setlocale(LC_COLLATE, lc_collate_cache))
+		elog(FATAL, "failed to set back the default LC_COLLATE value [%s]", lc_collate_cache);
+
+#endif
+
+	return result;
+}
+
+static text*
+_nls_run_strxfrm(FmgrInfo *flinfo, text *string, text *locale)
+{
+	NlsCache   *cache = (NlsCache *) flinfo->fn_extra;
+	NlsLocale  *nl;
+	char	   *locale_str;
+	int			locale_len;
+	int			string_len;
+	text	   *result;
+	size_t		size;
+	size_t		rest;
+
+	if (!cache)
+	{
+		cache = MemoryContextAllocZero(flinfo->fn_mcxt, sizeof(NlsCache));
+		flinfo->fn_extra = cache;
 	}
 
+	locale_str = VARDATA_ANY(locale);
+	locale_len = VARSIZE_ANY_EXHDR(locale);
+
+	/* usually the locale is same for all rows */
+	nl = cache->locale;
+	if (!nl || strncmp(nl->name, locale_str, locale_len) != 0
+		|| nl->name[locale_len] != '\0')
+		cache->locale = nl = get_nls_locale(locale_str, locale_len);
+
 	/*
-	 * We do TRY / CATCH / END_TRY to catch ereport / elog that might
-	 * happen during palloc. Ereport during palloc would not be
-	 * nice since it would leave the server with changed locales
-	 * setting, resulting in bad things.
+	 * To run strxfrm, we need a zero-terminated strings.
 	 */
-	PG_TRY();
+	string_len = VARSIZE_ANY_EXHDR(string);
+	if (string_len + 1 > cache->buffer_size)
 	{
+		if (cache->buffer)
+			pfree(cache->buffer);
 
-		/*
-		 * Text transformation.
-		 * Increase the buffer until the strxfrm is able to fit.
-		 */
-		size = string_len * multiplication + 1;
-		tmp = palloc(size + VARHDRSZ);
-
-		rest = strxfrm(tmp + VARHDRSZ, string_str, size);
-		while (rest >= size)
-		{
-			pfree(tmp);
-			size = rest + 1;
-			tmp = palloc(size + VARHDRSZ);
-			rest = strxfrm(tmp + VARHDRSZ, string_str, size);
-			/*
-			 * Cache the multiplication factor so that the next
-			 * time we start with better value.
-			 */
-			if (string_len)
-				multiplication = (rest / string_len) + 2;
-		}
+		cache->buffer_size = Max(string_len + 1, 1024);
+		cache->buffer = MemoryContextAlloc(flinfo->fn_mcxt, cache->buffer_size);
 	}
-	PG_CATCH ();
-	{
-		if (changed_locale) {
-			/*
-			 * Set original locale
-			 */
-			if (!setlocale(LC_COLLATE, lc_collate_cache))
-				elog(FATAL, "failed to set back the default LC_COLLATE value [%s]", lc_collate_cache);
-		}
-	}
-	PG_END_TRY ();
 
-	if (changed_locale)
+	memcpy(cache->buffer, VARDATA_ANY(string), string_len);
+	cache->buffer[string_len] = '\0';
+
+	/*
+	 * Text transformation. The expected size of result is known from
+	 * previous calls with same locale. When the buffer is too small,
+	 * strxfrm returns the necessary size, so second call always fits.
+	 */
+	size = string_len * nl->multiplication + 1;
+	result = palloc(size + VARHDRSZ);
+
+	rest = nls_strxfrm(nl, VARDATA(result), cache->buffer, size);
+	if (rest >= size)
 	{
-		/*
-		 * Set original locale
-		 */
-		if (!setlocale(LC_COLLATE, lc_collate_cache))
-			elog(FATAL, "failed to set back the default LC_COLLATE value [%s]", lc_collate_cache);
-		pfree(locale_str);
+		pfree(result);
+		size = rest + 1;
+		result = palloc(size + VARHDRSZ);
+		rest = nls_strxfrm(nl, VARDATA(result), cache->buffer, size);
 	}
-	pfree(string_str);
 
 	/*
-	 * If the multiplication factor went down, reset it.
+	 * Cache the multiplication factor so that the next time we start
+	 * with better value. It follows the last string, so it decreases
+	 * after an unusual string, and it is limited, because a longer
+	 * result is handled by second call.
 	 */
-	if (string_len && rest < string_len * multiplication / 4)
-		multiplication = (rest / string_len) + 1;
+	if (string_len)
+		nl->multiplication = Min((rest / string_len) + 2, NLS_MAX_MULTIPLICATION);
 
-	result = (text *) tmp;
 	SET_VARSIZE(result, rest + VARHDRSZ);
 	return result;
 }
@@ -286,7 +574,7 @@ ora_nlssort(PG_FUNCTION_ARGS)
 		locale = PG_GETARG_TEXT_PP(1);
 	}
 
-	result = _nls_run_strxfrm(PG_GETARG_TEXT_PP(0), locale);
+	result = _nls_run_strxfrm(fcinfo->flinfo, PG_GETARG_TEXT_PP(0), locale);
 
 	if (! result)
 		PG_RETURN_NULL();
@@ -6,13 +6,20 @@
 #include "utils/memutils.h"
 #include "utils/timestamp.h"
 #include "storage/lwlock.h"
+#include "storage/latch.h"
+#include "storage/ipc.h"
+#include "storage/proc.h"
+#include "storage/spin.h"
 #include "miscadmin.h"
+#include "pgstat.h"
 #include "string.h"
 #include "lib/stringinfo.h"
 #include "catalog/pg_type.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/date.h"
 #include "utils/numeric.h"
+#include "utils/tuplestore.h"
 
 #include "shmmc.h"
 #include "pipe.h"
@@ -44,8 +51,11 @@ PG_FUNCTION_INFO_V1(dbms_pipe_pack_message_text);
 PG_FUNCTION_INFO_V1(dbms_pipe_unpack_message_text);
 PG_FUNCTION_INFO_V1(dbms_pipe_send_message);
 PG_FUNCTION_INFO_V1(dbms_pipe_receive_message);
+PG_FUNCTION_INFO_V1(dbms_pipe_send_messages);
+PG_FUNCTION_INFO_V1(dbms_pipe_receive_messages);
 PG_FUNCTION_INFO_V1(dbms_pipe_unique_session_name);
 PG_FUNCTION_INFO_V1(dbms_pipe_list_pipes);
+PG_FUNCTION_INFO_V1(dbms_pipe_shmem_stats);
 PG_FUNCTION_INFO_V1(dbms_pipe_next_item_type);
 PG_FUNCTION_INFO_V1(dbms_pipe_create_pipe);
 PG_FUNCTION_INFO_V1(dbms_pipe_create_pipe_2);
@@ -81,6 +91,15 @@ typedef struct _queue_item {
 	struct _queue_item *next_item;
 } queue_item;
 
+/*
+ * Sessions sleeping on a pipe. A waiter is woken (and its entry released)
+ * by the first change of the pipe state it waits for.
+ */
+typedef struct _pipe_waiter {
+	Latch *latch;
+	struct _pipe_waiter *next_waiter;
+} pipe_waiter;
+
 typedef struct {
 	bool is_valid;
 	bool registered;
@@ -88,9 +107,16 @@ typedef struct {
 	char *creator;
 	Oid  uid;
 	struct _queue_item *items;
-	int16 count;
-	int16 limit;
+	struct _queue_item *items_tail;		/* last item, for O(1) enqueue */
+	int32 count;
+	int32 limit;
 	int size;
+	struct _pipe_waiter *recv_waiters;	/* sessions waiting for a message */
+	struct _pipe_waiter *send_waiters;	/* sessions waiting for free space */
+	int64 sent_messages;				/* statistics */
+	int64 sent_bytes;
+	int64 recv_messages;
+	int64 recv_bytes;
 } pipe;
 
 typedef struct {
@@ -118,23 +144,38 @@ typedef struct PipesFctx {
 	int pipe_nth;
 } PipesFctx;
 
+/*
+ * Pipes and alerts are protected by separate locks. The allocator has
+ * own lock, that is taken always as last one.
+ */
+#define PIPES_LOCK			0
+#define ALERTS_LOCK			1
+#define ALLOC_LOCK			2
+
 typedef struct
 {
 #if PG_VERSION_NUM >= 90600
 
 	int tranche_id;
-	LWLock shmem_lock;
+	LWLock shmem_locks[ORAFCE_LWLOCKS];
 #else
 
-	LWLockId shmem_lockid;
+	LWLockId shmem_lockids[ORAFCE_LWLOCKS];
 
 #endif
 
 	pipe *pipes;
 	alert_event *events;
 	alert_lock *locks;
+	ora_shash *pipes_index;
+	ora_shash *events_index;
+	ora_shash *locks_index;
+	char *area;			/* memory managed by shmmc allocator */
 	size_t size;
 	int sid;
+	slock_t stats_mutex;	/* protects lock_waits and lock_wait_time */
+	int64 lock_waits[ORAFCE_LWLOCKS];
+	int64 lock_wait_time[ORAFCE_LWLOCKS];	/* in microseconds */
 	vardata data[1]; /* flexible array member */
 } sh_memory;
 
@@ -143,22 +184,30 @@ typedef struct
 message_buffer *output_buffer = NULL;
 message_buffer *input_buffer = NULL;
 
+static Size output_buffer_size = 0;		/* allocated size of output_buffer */
+
 pipe* pipes = NULL;
+ora_shash *pipes_index = NULL;
+
+static sh_memory *shmem_desc = NULL;
 
 #define NOT_INITIALIZED		NULL
 
-LWLockId shmem_lockid = NOT_INITIALIZED;;
+LWLockId shmem_lockid = NOT_INITIALIZED;
+LWLockId alerts_lockid = NOT_INITIALIZED;
 
 int sid;                                 /* session id */
 
 extern alert_event *events;
 extern alert_lock  *locks;
+extern ora_shash *events_index;
+extern ora_shash *locks_index;
 
 /*
  * write on writer size bytes from ptr
  */
 
-static void
+static message_buffer*
 pack_field(message_buffer *buffer, message_data_type type,
 			int32 size, void *ptr, Oid tupType)
 {
@@ -166,16 +215,36 @@ pack_field(message_buffer *buffer, message_data_type type,
 	message_data_item *message;
 
 	len = MAXALIGN(size) + message_data_item_size;
-	if (MAXALIGN(buffer->size) + len > LOCALMSGSZ - message_buffer_size)
-		ereport(ERROR,
-				(errcode(ERRCODE_OUT_OF_MEMORY),
-				 errmsg("out of memory"),
-				 errdetail("Packed message is bigger than local buffer."),
-				 errhint("Increase LOCALMSGSZ in 'pipe.h' and recompile library.")));
 
 	if (buffer->next == NULL)
 		buffer->next =  message_buffer_get_content(buffer);
 
+	/* enlarge local buffer, when it is necessary */
+	if ((Size) MAXALIGN(buffer->size) + len > (Size) output_buffer_size)
+	{
+		Size	newsize = output_buffer_size;
+		ptrdiff_t next_offset = (char *) buffer->next - (char *) buffer;
+
+		while ((Size) MAXALIGN(buffer->size) + len > newsize)
+			newsize *= 2;
+
+		newsize = Min(newsize, MaxAllocSize);
+
+		if ((Size) MAXALIGN(buffer->size) + len > newsize)
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory"),
+					 errdetail("Packed message is bigger than %lu bytes.",
+							   (unsigned long) MaxAllocSize)));
+
+		buffer = repalloc(buffer, newsize);
+
+		/* padding bytes have to be zeroed */
+		memset((char *) buffer + output_buffer_size, 0, newsize - output_buffer_size);
+		buffer->next = (message_data_item *) ((char *) buffer + next_offset);
+		output_buffer_size = newsize;
+	}
+
 	message = buffer->next;
 
 	message->size = size;
@@ -189,6 +258,8 @@ pack_field(message_buffer *buffer, message_data_type type,
 	buffer->size += len;
 	buffer->items_count++;
 	buffer->next = message_data_item_next(message);
+
+	return buffer;
 }
 
 
@@ -216,149 +287,382 @@ unpack_field(message_buffer *buffer, message_data_type *type,
 
 
 /*
- * Add ptr to queue. If pipe doesn't exist, register new pipe
+ * Returns size of shared memory segment. Arrays of pipes, events and
+ * locks and their hash indexes are placed before memory used by shmmc
+ * allocator (of size bytes).
  */
+size_t
+ora_shmem_size(size_t size, int max_pipes, int max_events, int max_locks)
+{
+	return MAXALIGN(sh_memory_size) +
+		   MAXALIGN(max_pipes * sizeof(pipe)) +
+		   MAXALIGN(max_events * sizeof(alert_event)) +
+		   MAXALIGN(max_locks * sizeof(alert_lock)) +
+		   ora_shash_size(max_pipes) +
+		   ora_shash_size(max_events) +
+		   ora_shash_size(max_locks) +
+		   MAXALIGN(size);
+}
 
-bool
-ora_lock_shmem(size_t size, int max_pipes, int max_events, int max_locks, bool reset)
+static void
+register_tranche(sh_memory *sh_mem)
+{
+
+#if PG_VERSION_NUM >= 100000
+
+	LWLockRegisterTranche(sh_mem->tranche_id, "orafce");
+
+#elif PG_VERSION_NUM >= 90600
+
+	static LWLockTranche tranche;
+
+	tranche.name = "orafce";
+	tranche.array_base = sh_mem->shmem_locks;
+	tranche.array_stride = sizeof(LWLock);
+	LWLockRegisterTranche(sh_mem->tranche_id, &tranche);
+
+#endif
+
+}
+
+#if PG_VERSION_NUM >= 90600
+
+#define get_lockid(sh_mem, n)		(&(sh_mem)->shmem_locks[n])
+
+#else
+
+#define get_lockid(sh_mem, n)		((sh_mem)->shmem_lockids[n])
+
+#endif
+
+/*
+ * Attach (and create, when it doesn't exist yet) the shared memory
+ * segment. The initialization is protected by AddinShmemInitLock,
+ * so no other session can see half initialized memory.
+ */
+static bool
+attach_shmem(size_t size, int max_pipes, int max_events, int max_locks, bool reset)
 {
 	int i;
 	bool found;
+	size_t total_size;
 
 	sh_memory *sh_mem;
 
-	if (pipes == NULL)
-	{
-		sh_mem = ShmemInitStruct("dbms_pipe", size, &found);
-		if (sh_mem == NULL)
-			ereport(FATAL,
-					(errcode(ERRCODE_OUT_OF_MEMORY),
-					 errmsg("out of memory"),
-					 errdetail("Failed while allocation block %lu bytes in shared memory.", (unsigned long) size)));
+	if (pipes != NULL)
+		return true;
 
-		if (!found)
-		{
+	total_size = ora_shmem_size(size, max_pipes, max_events, max_locks);
 
-#if PG_VERSION_NUM >= 90600
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
 
-			sh_mem->tranche_id = LWLockNewTrancheId();
-			LWLockInitialize(&sh_mem->shmem_lock, sh_mem->tranche_id);
+	sh_mem = ShmemInitStruct("dbms_pipe", total_size, &found);
+	if (sh_mem == NULL)
+		ereport(FATAL,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Failed while allocation block %lu bytes in shared memory.", (unsigned long) total_size)));
 
-			{
+	if (!found)
+	{
+		char *ptr = ((char *) sh_mem) + MAXALIGN(sh_memory_size);
 
-#if PG_VERSION_NUM >= 100000
+#if PG_VERSION_NUM >= 90600
 
-				LWLockRegisterTranche(sh_mem->tranche_id, "orafce");
+		sh_mem->tranche_id = LWLockNewTrancheId();
+		for (i = 0; i < ORAFCE_LWLOCKS; i++)
+			LWLockInitialize(&sh_mem->shmem_locks[i], sh_mem->tranche_id);
 
 #else
 
-				static LWLockTranche tranche;
-
-				tranche.name = "orafce";
-				tranche.array_base = &sh_mem->shmem_lock;
-				tranche.array_stride = sizeof(LWLock);
-				LWLockRegisterTranche(sh_mem->tranche_id, &tranche);
+		for (i = 0; i < ORAFCE_LWLOCKS; i++)
+			sh_mem->shmem_lockids[i] = LWLockAssign();
 
 #endif
 
-				shmem_lockid = &sh_mem->shmem_lock;
-			}
+		pipes = sh_mem->pipes = (pipe *) ptr;
+		ptr += MAXALIGN(max_pipes * sizeof(pipe));
+		events = sh_mem->events = (alert_event *) ptr;
+		ptr += MAXALIGN(max_events * sizeof(alert_event));
+		locks = sh_mem->locks = (alert_lock *) ptr;
+		ptr += MAXALIGN(max_locks * sizeof(alert_lock));
+
+		pipes_index = sh_mem->pipes_index = ora_shash_init(ptr, max_pipes);
+		ptr += ora_shash_size(max_pipes);
+		events_index = sh_mem->events_index = ora_shash_init(ptr, max_events);
+		ptr += ora_shash_size(max_events);
+		locks_index = sh_mem->locks_index = ora_shash_init(ptr, max_locks);
+		ptr += ora_shash_size(max_locks);
+
+		sh_mem->area = ptr;
+		sh_mem->size = MAXALIGN(size);
+
+		SpinLockInit(&sh_mem->stats_mutex);
+		for (i = 0; i < ORAFCE_LWLOCKS; i++)
+		{
+			sh_mem->lock_waits[i] = 0;
+			sh_mem->lock_wait_time[i] = 0;
+		}
 
-#else
+		ora_sinit(sh_mem->area, sh_mem->size, true,
+				  get_lockid(sh_mem, ALLOC_LOCK));
+		sid = sh_mem->sid = 1;
+		for (i = 0; i < max_pipes; i++)
+			pipes[i].is_valid = false;
 
-			shmem_lockid = sh_mem->shmem_lockid = LWLockAssign();
+		for (i = 0; i < max_events; i++)
+		{
+			events[i].event_name = NULL;
+			events[i].max_receivers = 0;
+			events[i].receivers = NULL;
+			events[i].messages = NULL;
+			events[i].signals = 0;
+		}
+		for (i = 0; i < max_locks; i++)
+		{
+			locks[i].sid = -1;
+			locks[i].echo = NULL;
+			locks[i].latch = NULL;
+		}
+	}
+	else
+	{
+		pipes = sh_mem->pipes;
+		ora_sinit(sh_mem->area, sh_mem->size, reset,
+				  get_lockid(sh_mem, ALLOC_LOCK));
+		sid = ++(sh_mem->sid);
+		events = sh_mem->events;
+		locks = sh_mem->locks;
+		pipes_index = sh_mem->pipes_index;
+		events_index = sh_mem->events_index;
+		locks_index = sh_mem->locks_index;
+	}
 
-#endif
+	register_tranche(sh_mem);
 
-			LWLockAcquire(shmem_lockid, LW_EXCLUSIVE);
+	shmem_desc = sh_mem;
+	shmem_lockid = get_lockid(sh_mem, PIPES_LOCK);
+	alerts_lockid = get_lockid(sh_mem, ALERTS_LOCK);
 
-			sh_mem->size = size - sh_memory_size;
-			ora_sinit(sh_mem->data, size, true);
-			pipes = sh_mem->pipes = ora_salloc(max_pipes*sizeof(pipe));
-			sid = sh_mem->sid = 1;
-			for (i = 0; i < max_pipes; i++)
-				pipes[i].is_valid = false;
+	LWLockRelease(AddinShmemInitLock);
 
-			events = sh_mem->events = ora_salloc(max_events*sizeof(alert_event));
-			locks = sh_mem->locks = ora_salloc(max_locks*sizeof(alert_lock));
+	return pipes != NULL;
+}
 
-			for (i = 0; i < max_events; i++)
-			{
-				events[i].event_name = NULL;
-				events[i].max_receivers = 0;
-				events[i].receivers = NULL;
-				events[i].messages = NULL;
-			}
-			for (i = 0; i < max_locks; i++)
-			{
-				locks[i].sid = -1;
-				locks[i].echo = NULL;
-			}
+/*
+ * Acquire lock of pipes or alerts. The time spent by waiting for the
+ * lock is counted for dbms_pipe.db_shmem_stats.
+ */
+static void
+acquire_lock(int n, LWLockMode mode)
+{
+	LWLockId	lockid = get_lockid(shmem_desc, n);
 
-		}
-		else if (pipes == NULL)
-		{
+	if (!LWLockConditionalAcquire(lockid, mode))
+	{
+		TimestampTz start = GetCurrentTimestamp();
 
-#if PG_VERSION_NUM >= 90600
+		LWLockAcquire(lockid, mode);
 
+		SpinLockAcquire(&shmem_desc->stats_mutex);
+		shmem_desc->lock_waits[n] += 1;
+		shmem_desc->lock_wait_time[n] += GetCurrentTimestamp() - start;
+		SpinLockRelease(&shmem_desc->stats_mutex);
+	}
+}
 
-#if PG_VERSION_NUM >= 100000
+/*
+ * Attach shared memory and lock pipes exclusively.
+ */
+bool
+ora_lock_shmem(size_t size, int max_pipes, int max_events, int max_locks, bool reset)
+{
+	if (!attach_shmem(size, max_pipes, max_events, max_locks, reset))
+		return false;
 
-			LWLockRegisterTranche(sh_mem->tranche_id, "orafce");
+	acquire_lock(PIPES_LOCK, LW_EXCLUSIVE);
 
-#else
+	return true;
+}
+
+/*
+ * Attach shared memory and lock pipes for read only access.
+ */
+bool
+ora_lock_shmem_shared(size_t size, int max_pipes, int max_events, int max_locks)
+{
+	if (!attach_shmem(size, max_pipes, max_events, max_locks, false))
+		return false;
 
-			static LWLockTranche tranche;
+	acquire_lock(PIPES_LOCK, LW_SHARED);
 
-			tranche.name = "orafce";
-			tranche.array_base = &sh_mem->shmem_lock;
-			tranche.array_stride = sizeof(LWLock);
-			LWLockRegisterTranche(sh_mem->tranche_id, &tranche);
+	return true;
+}
 
-#endif
+/*
+ * Attach shared memory and lock alerts exclusively.
+ */
+bool
+ora_lock_alerts(size_t size, int max_pipes, int max_events, int max_locks)
+{
+	if (!attach_shmem(size, max_pipes, max_events, max_locks, false))
+		return false;
 
-			shmem_lockid = &sh_mem->shmem_lock;
+	acquire_lock(ALERTS_LOCK, LW_EXCLUSIVE);
 
-#else
+	return true;
+}
 
-			shmem_lockid = sh_mem->shmem_lockid;
 
-#endif
+/*
+ * Registers current session in list of waiters. Returns false, when
+ * there are not free shared memory for new entry - caller should to
+ * fall back to polling.
+ */
+static bool
+add_waiter(pipe_waiter **waiters)
+{
+	pipe_waiter *w;
+
+	for (w = *waiters; w != NULL; w = w->next_waiter)
+		if (w->latch == &MyProc->procLatch)
+			return true;
 
-			pipes = sh_mem->pipes;
-			LWLockAcquire(shmem_lockid, LW_EXCLUSIVE);
+	if (NULL == (w = ora_salloc(sizeof(pipe_waiter))))
+		return false;
 
-			ora_sinit(sh_mem->data, sh_mem->size, reset);
-			sid = ++(sh_mem->sid);
-			events = sh_mem->events;
-			locks = sh_mem->locks;
+	w->latch = &MyProc->procLatch;
+	w->next_waiter = *waiters;
+	*waiters = w;
+
+	return true;
+}
+
+static void
+remove_waiter(pipe_waiter **waiters)
+{
+	pipe_waiter *w, *prev = NULL;
+
+	for (w = *waiters; w != NULL; prev = w, w = w->next_waiter)
+	{
+		if (w->latch == &MyProc->procLatch)
+		{
+			if (prev != NULL)
+				prev->next_waiter = w->next_waiter;
+			else
+				*waiters = w->next_waiter;
+
+			ora_sfree(w);
+			break;
 		}
 	}
-	else
+}
+
+/*
+ * Wake up all waiters. The woken sessions check the pipe again and
+ * register self again when it is necessary.
+ */
+static void
+wake_waiters(pipe_waiter **waiters)
+{
+	pipe_waiter *w = *waiters;
+
+	while (w != NULL)
 	{
-		LWLockAcquire(shmem_lockid, LW_EXCLUSIVE);
+		pipe_waiter *next = w->next_waiter;
+
+		SetLatch(w->latch);
+		ora_sfree(w);
+		w = next;
 	}
 
-	return pipes != NULL;
+	*waiters = NULL;
+}
+
+/*
+ * Sleep on own latch up to endtime. When the session is not registered
+ * in some waiters list, then sleep only 10ms (polling mode). Returns
+ * false when endtime was reached.
+ */
+bool
+ora_wait_latch(float8 endtime, bool registered)
+{
+	float8		remaining = endtime - GetNowFloat();
+	long		timeout;
+	int			rc;
+
+	if (remaining <= 0.0)
+		return false;
+
+	if (!registered)
+		timeout = 10L;
+	else
+		timeout = (long) Min(remaining * 1000.0 + 1.0, (float8) INT_MAX);
+
+#if PG_VERSION_NUM >= 100000
+
+	/*
+	 * Named wait events for extensions (WaitEventExtensionNew) are
+	 * available only from PostgreSQL 17, so the sleep is reported
+	 * as Extension/Extension. Waiting sessions are counted by
+	 * dbms_pipe.db_shmem_stats.
+	 */
+	rc = WaitLatch(MyLatch,
+				   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+				   timeout,
+				   PG_WAIT_EXTENSION);
+
+#else
+
+	rc = WaitLatch(MyLatch,
+				   WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+				   timeout);
+
+#endif
+
+	if (rc & WL_POSTMASTER_DEATH)
+		proc_exit(1);
+
+	CHECK_FOR_INTERRUPTS();
+
+	return true;
+}
+
+/*
+ * Release pipe's name and wake up all sessions that wait on this pipe.
+ */
+static void
+invalidate_pipe(pipe *p)
+{
+	ora_shash_delete(pipes_index, (int) (p - pipes));
+	ora_sfree(p->pipe_name);
+	p->is_valid = false;
+
+	wake_waiters(&p->recv_waiters);
+	wake_waiters(&p->send_waiters);
 }
 
 
 /*
- * can be enhanced access/hash.h
+ * Pipes are searched by name via hash index
  */
 
 static pipe*
 find_pipe(text* pipe_name, bool* created, bool only_check)
 {
 	int i;
-	pipe *result = NULL;
+	int len = VARSIZE(pipe_name) - VARHDRSZ;
+	uint32 hash = ora_shash_bytes(VARDATA(pipe_name), len);
+	char *name;
 
 	*created = false;
-	for (i = 0; i < MAX_PIPES; i++)
+	for (i = ora_shash_first(pipes_index, hash);
+		 i != ORA_SHASH_NONE;
+		 i = ora_shash_next(pipes_index, i))
 	{
 		if (pipes[i].is_valid &&
-			strncmp((char*)VARDATA(pipe_name), pipes[i].pipe_name, VARSIZE(pipe_name) - VARHDRSZ) == 0
-			&& (strlen(pipes[i].pipe_name) == (VARSIZE(pipe_name) - VARHDRSZ)))
+			strncmp((char*)VARDATA(pipe_name), pipes[i].pipe_name, len) == 0
+			&& (strlen(pipes[i].pipe_name) == (size_t) len))
 		{
 			/* check owner if non public pipe */
 
@@ -375,60 +679,57 @@ find_pipe(text* pipe_name, bool* created, bool only_check)
 		}
 	}
 
-	if (only_check)
-		return result;
+	if (only_check || pipes_index->free_slot == ORA_SHASH_NONE)
+		return NULL;
 
-	for (i = 0; i < MAX_PIPES; i++)
-		if (!pipes[i].is_valid)
-		{
-			if (NULL != (pipes[i].pipe_name = ora_scstring(pipe_name)))
-			{
-				pipes[i].is_valid = true;
-				pipes[i].registered = false;
-				pipes[i].creator = NULL;
-				pipes[i].uid = -1;
-				pipes[i].count = 0;
-				pipes[i].limit = -1;
-
-				*created = true;
-				result = &pipes[i];
-			}
-			break;
-		}
+	if (NULL == (name = ora_scstring(pipe_name)))
+		return NULL;
 
-	return result;
+	i = ora_shash_insert(pipes_index, hash);
+
+	pipes[i].pipe_name = name;
+	pipes[i].is_valid = true;
+	pipes[i].registered = false;
+	pipes[i].creator = NULL;
+	pipes[i].uid = -1;
+	pipes[i].items = NULL;
+	pipes[i].items_tail = NULL;
+	pipes[i].count = 0;
+	pipes[i].size = 0;
+	pipes[i].limit = -1;
+	pipes[i].recv_waiters = NULL;
+	pipes[i].send_waiters = NULL;
+	pipes[i].sent_messages = 0;
+	pipes[i].sent_bytes = 0;
+	pipes[i].recv_messages = 0;
+	pipes[i].recv_bytes = 0;
+
+	*created = true;
+
+	return &pipes[i];
 }
 
 
 static bool
 new_last(pipe *p, void *ptr)
 {
-	queue_item *q, *aux_q;
+	queue_item *q;
 
 	if (p->count >= p->limit && p->limit != -1)
 		return false;
 
-	if (p->items == NULL)
-	{
-		if (NULL == (p->items = ora_salloc(sizeof(queue_item))))
-			return false;
-		p->items->next_item = NULL;
-		p->items->ptr = ptr;
-		p->count = 1;
-		return true;
-	}
-	q = p->items;
-	while (q->next_item != NULL)
-		q = q->next_item;
-
-
-	if (NULL == (aux_q = ora_salloc(sizeof(queue_item))))
+	if (NULL == (q = ora_salloc(sizeof(queue_item))))
 		return false;
 
-	q->next_item = aux_q;
-	aux_q->next_item = NULL;
-	aux_q->ptr = ptr;
+	q->next_item = NULL;
+	q->ptr = ptr;
 
+	if (p->items == NULL)
+		p->items = q;
+	else
+		p->items_tail->next_item = q;
+
+	p->items_tail = q;
 	p->count += 1;
 
 	return true;
@@ -448,14 +749,15 @@ remove_first(pipe *p, bool *found)
 		p->count -= 1;
 		ptr = q->ptr;
 		p->items = q->next_item;
+		if (p->items == NULL)
+			p->items_tail = NULL;
 		*found = true;
 
 		ora_sfree(q);
 		if (p->items == NULL && !p->registered)
-		{
-			ora_sfree(p->pipe_name);
-			p->is_valid = false;
-		}
+			invalidate_pipe(p);
+		else
+			wake_waiters(&p->send_waiters);
 
 	}
 
@@ -463,93 +765,375 @@ remove_first(pipe *p, bool *found)
 }
 
 
-/* copy message to local memory, if exists */
+/*
+ * The received message is not copied to local memory. It is removed from
+ * pipe, but it stays in shared memory (pinned), and unpack functions read
+ * it directly. The message is released by next receive, by reset_buffer,
+ * after unpacking of last field or on session exit.
+ */
+static void
+release_input_buffer(void)
+{
+	if (input_buffer != NULL)
+	{
+		ora_sfree(input_buffer);
+		input_buffer = NULL;
+	}
+}
+
+static void
+release_input_buffer_callback(int code, Datum arg)
+{
+	release_input_buffer();
+}
+
+/*
+ * Returns pinned message, if exists. When there are not any
+ * message and wait is true, then register session as receiver waiter.
+ */
 
 static message_buffer*
-get_from_pipe(text *pipe_name, bool *found)
+get_from_pipe(text *pipe_name, bool *found, bool wait, bool *registered)
 {
+	static bool callback_registered = false;
+
 	pipe *p;
 	bool created;
 	message_buffer *shm_msg;
 	message_buffer *result = NULL;
 
+	*registered = false;
+	*found = false;
+
+	if (!ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+		return NULL;
+
+	if (NULL != (p = find_pipe(pipe_name, &created,false)))
+	{
+		if (!created)
+			remove_waiter(&p->recv_waiters);
+
+		if (!created && NULL != (shm_msg = remove_first(p, found)))
+		{
+			p->size -= shm_msg->size;
+			p->recv_messages += 1;
+			p->recv_bytes += shm_msg->size;
+			result = shm_msg;
+		}
+		else if (!*found && wait)
+			*registered = add_waiter(&p->recv_waiters);
+	}
+
+	LWLockRelease(shmem_lockid);
+
+	if (result != NULL && !callback_registered)
+	{
+		before_shmem_exit(release_input_buffer_callback, (Datum) 0);
+		callback_registered = true;
+	}
+
+	return result;
+}
+
+/*
+ * Remove current session from waiters of pipe after timeout.
+ */
+static void
+cancel_wait(text *pipe_name, bool receiver)
+{
+	pipe *p;
+	bool created;
+
+	if (!ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+		return;
+
+	if (NULL != (p = find_pipe(pipe_name, &created, true)))
+		remove_waiter(receiver ? &p->recv_waiters : &p->send_waiters);
+
+	LWLockRelease(shmem_lockid);
+}
+
+/*
+ * Pipe, where the session is registered as waiter during sleep. When the
+ * sleep is broken by an error (query cancel, statement_timeout) or by
+ * session exit, the registration has to be removed, else the entry leaks
+ * and the latch would be set later by other sessions.
+ */
+static text *waiting_pipe_name = NULL;
+static bool waiting_receiver;
+
+static void
+cancel_wait_callback(int code, Datum arg)
+{
+	if (waiting_pipe_name != NULL)
+	{
+		text *pipe_name = waiting_pipe_name;
+
+		waiting_pipe_name = NULL;
+		cancel_wait(pipe_name, waiting_receiver);
+	}
+}
+
+/*
+ * Sleep on pipe up to endtime. Returns false after timeout, and the
+ * session is not registered as waiter then.
+ */
+static bool
+pipe_wait(text *pipe_name, bool receiver, float8 endtime, bool registered)
+{
+	static bool callback_registered = false;
+	bool result;
+
+	if (!registered)
+		return ora_wait_latch(endtime, false);
+
+	if (!callback_registered)
+	{
+		before_shmem_exit(cancel_wait_callback, (Datum) 0);
+		callback_registered = true;
+	}
+
+	waiting_pipe_name = pipe_name;
+	waiting_receiver = receiver;
+
+	PG_TRY();
+	{
+		result = ora_wait_latch(endtime, true);
+	}
+	PG_CATCH();
+	{
+		cancel_wait_callback(0, (Datum) 0);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	waiting_pipe_name = NULL;
+
+	if (!result)
+		cancel_wait(pipe_name, receiver);
+
+	return result;
+}
+
+
+/*
+ * if ptr is null, then only register pipe. When the pipe is full and
+ * wait is true, then register session as sender waiter.
+ */
+
+static bool
+add_to_pipe(text *pipe_name, message_buffer *ptr, int limit, bool limit_is_valid,
+			bool wait, bool *registered)
+{
+	pipe *p;
+	bool created;
+	bool result = false;
+	message_buffer *sh_ptr;
+
+	*registered = false;
+
+	if (!ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS,false))
+		return false;
+
+	for (;;)
+	{
+		if (NULL != (p = find_pipe(pipe_name, &created, false)))
+		{
+			if (created)
+				p->registered = ptr == NULL;
+			else
+				remove_waiter(&p->send_waiters);
+
+			if (limit_is_valid && (created || (p->limit < limit)))
+				p->limit = limit;
+
+			if (ptr != NULL)
+			{
+				if (NULL != (sh_ptr = ora_salloc(ptr->size)))
+				{
+					memcpy(sh_ptr,ptr,ptr->size);
+					if (new_last(p, sh_ptr))
+					{
+						p->size += ptr->size;
+						p->sent_messages += 1;
+						p->sent_bytes += ptr->size;
+						wake_waiters(&p->recv_waiters);
+						result = true;
+						break;
+					}
+					ora_sfree(sh_ptr);
+
+					/* the pipe is full, wait for some receiver */
+					if (wait && !created)
+						*registered = add_waiter(&p->send_waiters);
+				}
+				if (created)
+				{
+					/* I created new pipe, but haven't memory for new value */
+					invalidate_pipe(p);
+					result = false;
+				}
+			}
+			else
+				result = true;
+		}
+		break;
+	}
+	LWLockRelease(shmem_lockid);
+	return result;
+}
+
+/*
+ * Returns true, when message holds exactly one bytea field - only these
+ * messages can be processed by batch API.
+ */
+static bool
+is_bytea_message(message_buffer *msg)
+{
+	return msg->items_count == 1 &&
+		message_buffer_get_content(msg)->type == IT_BYTEA;
+}
+
+/*
+ * Copy messages from pipe to local memory. All messages are taken under
+ * one lock. Returns number of received messages, *values is allocated
+ * in current memory context. When there are not any message and wait is
+ * true, then register session as receiver waiter.
+ */
+static int
+get_many_from_pipe(text *pipe_name, Datum **values, int max_count,
+				   bool wait, bool *registered)
+{
+	pipe *p;
+	bool created;
+	int n = 0;
+	int nalloc = 0;
+
+	*registered = false;
+
 	if (!ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
-		return NULL;
+		return 0;
 
-	if (NULL != (p = find_pipe(pipe_name, &created,false)))
+	if (NULL != (p = find_pipe(pipe_name, &created, false)))
 	{
 		if (!created)
+			remove_waiter(&p->recv_waiters);
+
+		if (p->count > 0)
+		{
+			nalloc = Min(max_count, p->count);
+			*values = palloc(nalloc * sizeof(Datum));
+		}
+
+		/* never write behind allocated array, even if count is wrong */
+		while (n < nalloc && p->is_valid && p->items != NULL)
 		{
-			if (NULL != (shm_msg = remove_first(p, found)))
+			message_buffer *shm_msg = (message_buffer *) p->items->ptr;
+			message_data_item *item;
+			bytea *data;
+			bool found;
+
+			if (!is_bytea_message(shm_msg))
 			{
-				p->size -= shm_msg->size;
+				/* leave message in pipe for dbms_pipe.receive_message */
+				if (n > 0)
+					break;
 
-				result = (message_buffer*) MemoryContextAlloc(TopMemoryContext, shm_msg->size);
-				memcpy(result, shm_msg, shm_msg->size);
-				ora_sfree(shm_msg);
+				LWLockRelease(shmem_lockid);
+				ereport(ERROR,
+						(errcode(ERRCODE_DATATYPE_MISMATCH),
+						 errmsg("datatype mismatch"),
+						 errdetail("Message doesn't contain only one bytea field."),
+						 errhint("Use dbms_pipe.receive_message instead.")));
 			}
+
+			item = message_buffer_get_content(shm_msg);
+			data = (bytea *) palloc(item->size + VARHDRSZ);
+			SET_VARSIZE(data, item->size + VARHDRSZ);
+			memcpy(VARDATA(data), message_data_get_content(item), item->size);
+			(*values)[n++] = PointerGetDatum(data);
+
+			p->size -= shm_msg->size;
+			p->recv_messages += 1;
+			p->recv_bytes += shm_msg->size;
+			remove_first(p, &found);
+			ora_sfree(shm_msg);
 		}
+
+		if (n == 0 && wait)
+			*registered = add_waiter(&p->recv_waiters);
 	}
 
 	LWLockRelease(shmem_lockid);
 
-	return result;
+	return n;
 }
 
-
 /*
- * if ptr is null, then only register pipe
+ * Push messages msgs[*nsent .. nmsgs - 1] to pipe under one lock. When
+ * the pipe is full, then *nsent is number of already sent messages, and
+ * when wait is true, the session is registered as sender waiter. Returns
+ * true when all messages was sent.
  */
-
 static bool
-add_to_pipe(text *pipe_name, message_buffer *ptr, int limit, bool limit_is_valid)
+add_many_to_pipe(text *pipe_name, message_buffer **msgs, int nmsgs, int *nsent,
+				 int limit, bool limit_is_valid, bool wait, bool *registered)
 {
 	pipe *p;
 	bool created;
-	bool result = false;
-	message_buffer *sh_ptr;
+	int n = *nsent;
 
-	if (!ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS,false))
+	*registered = false;
+
+	if (!ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
 		return false;
 
-	for (;;)
+	if (NULL != (p = find_pipe(pipe_name, &created, false)))
 	{
-		if (NULL != (p = find_pipe(pipe_name, &created, false)))
+		if (created)
+			p->registered = false;
+		else
+			remove_waiter(&p->send_waiters);
+
+		if (limit_is_valid && (created || (p->limit < limit)))
+			p->limit = limit;
+
+		while (n < nmsgs)
 		{
-			if (created)
-				p->registered = ptr == NULL;
+			message_buffer *sh_ptr;
 
-			if (limit_is_valid && (created || (p->limit < limit)))
-				p->limit = limit;
+			if (NULL == (sh_ptr = ora_salloc(msgs[n]->size)))
+				break;
 
-			if (ptr != NULL)
+			memcpy(sh_ptr, msgs[n], msgs[n]->size);
+			if (!new_last(p, sh_ptr))
 			{
-				if (NULL != (sh_ptr = ora_salloc(ptr->size)))
-				{
-					memcpy(sh_ptr,ptr,ptr->size);
-					if (new_last(p, sh_ptr))
-					{
-						p->size += ptr->size;
-						result = true;
-						break;
-					}
-					ora_sfree(sh_ptr);
-				}
-				if (created)
-				{
-					/* I created new pipe, but haven't memory for new value */
-					ora_sfree(p->pipe_name);
-					p->is_valid = false;
-					result = false;
-				}
+				ora_sfree(sh_ptr);
+				break;
 			}
-			else
-				result = true;
+
+			p->size += msgs[n]->size;
+			p->sent_messages += 1;
+			p->sent_bytes += msgs[n]->size;
+			n += 1;
 		}
-		break;
+
+		if (n > *nsent)
+			wake_waiters(&p->recv_waiters);
+		else if (created)
+			/* I created new pipe, but haven't memory for new value */
+			invalidate_pipe(p);
+
+		/* the pipe is full, wait for some receiver */
+		if (n < nmsgs && wait && p->is_valid)
+			*registered = add_waiter(&p->send_waiters);
 	}
+
 	LWLockRelease(shmem_lockid);
-	return result;
+
+	*nsent = n;
+
+	return n == nmsgs;
 }
 
 
@@ -573,13 +1157,13 @@ remove_pipe(text *pipe_name, bool purge)
 			q = aux_q;
 		}
 		p->items = NULL;
+		p->items_tail = NULL;
 		p->size = 0;
 		p->count = 0;
 		if (!(purge && p->registered))
-		{
-			ora_sfree(p->pipe_name);
-			p->is_valid = false;
-		}
+			invalidate_pipe(p);
+		else
+			wake_waiters(&p->send_waiters);
 	}
 }
 
@@ -600,6 +1184,10 @@ init_buffer(message_buffer *buffer, int32 size)
 	buffer->next = message_buffer_get_content(buffer);
 }
 
+/*
+ * Returns output buffer, allocate it when it doesn't exist. The buffer
+ * can be enlarged by pack_field.
+ */
 static message_buffer*
 check_buffer(message_buffer *buffer, int32 size)
 {
@@ -613,6 +1201,7 @@ check_buffer(message_buffer *buffer, int32 size)
 					 errdetail("Failed while allocation block %d bytes in memory.", size)));
 
 		init_buffer(buffer, size);
+		output_buffer_size = size;
 	}
 
 	return buffer;
@@ -624,7 +1213,7 @@ dbms_pipe_pack_message_text(PG_FUNCTION_ARGS)
 	text *str = PG_GETARG_TEXT_PP(0);
 
 	output_buffer = check_buffer(output_buffer, LOCALMSGSZ);
-	pack_field(output_buffer, IT_VARCHAR,
+	output_buffer = pack_field(output_buffer, IT_VARCHAR,
 		VARSIZE_ANY_EXHDR(str), VARDATA_ANY(str), InvalidOid);
 
 	PG_RETURN_VOID();
@@ -637,7 +1226,7 @@ dbms_pipe_pack_message_date(PG_FUNCTION_ARGS)
 	DateADT dt = PG_GETARG_DATEADT(0);
 
 	output_buffer = check_buffer(output_buffer, LOCALMSGSZ);
-	pack_field(output_buffer, IT_DATE,
+	output_buffer = pack_field(output_buffer, IT_DATE,
 			   sizeof(dt), &dt, InvalidOid);
 
 	PG_RETURN_VOID();
@@ -650,7 +1239,7 @@ dbms_pipe_pack_message_timestamp(PG_FUNCTION_ARGS)
 	TimestampTz dt = PG_GETARG_TIMESTAMPTZ(0);
 
 	output_buffer = check_buffer(output_buffer, LOCALMSGSZ);
-	pack_field(output_buffer, IT_TIMESTAMPTZ,
+	output_buffer = pack_field(output_buffer, IT_TIMESTAMPTZ,
 			   sizeof(dt), &dt, InvalidOid);
 
 	PG_RETURN_VOID();
@@ -663,7 +1252,7 @@ dbms_pipe_pack_message_number(PG_FUNCTION_ARGS)
 	Numeric num = PG_GETARG_NUMERIC(0);
 
 	output_buffer = check_buffer(output_buffer, LOCALMSGSZ);
-	pack_field(output_buffer, IT_NUMBER,
+	output_buffer = pack_field(output_buffer, IT_NUMBER,
 			   VARSIZE(num) - VARHDRSZ, VARDATA(num), InvalidOid);
 
 	PG_RETURN_VOID();
@@ -676,7 +1265,7 @@ dbms_pipe_pack_message_bytea(PG_FUNCTION_ARGS)
 	bytea *data = PG_GETARG_BYTEA_P(0);
 
 	output_buffer = check_buffer(output_buffer, LOCALMSGSZ);
-	pack_field(output_buffer, IT_BYTEA,
+	output_buffer = pack_field(output_buffer, IT_BYTEA,
 		VARSIZE_ANY_EXHDR(data), VARDATA_ANY(data), InvalidOid);
 
 	PG_RETURN_VOID();
@@ -744,7 +1333,7 @@ dbms_pipe_pack_message_record(PG_FUNCTION_ARGS)
 	data = (bytea*) DatumGetPointer(record_send(info));
 
 	output_buffer = check_buffer(output_buffer, LOCALMSGSZ);
-	pack_field(output_buffer, IT_RECORD,
+	output_buffer = pack_field(output_buffer, IT_RECORD,
 			   VARSIZE(data), VARDATA(data), tupType);
 
 	PG_RETURN_VOID();
@@ -804,11 +1393,23 @@ dbms_pipe_unpack_message(PG_FUNCTION_ARGS, message_data_type dtype)
 #endif
 
 			StringInfoData	buf;
-			text		   *data = cstring_to_text_with_len(ptr, size);
 
-			buf.data = VARDATA(data);
-			buf.len = VARSIZE(data) - VARHDRSZ;
-			buf.maxlen = buf.len;
+			/*
+			 * record_recv needs terminated buffer. Zeroed padding byte can be
+			 * used as terminator, so data can be read directly from pinned
+			 * message. Else the field is copied.
+			 */
+			if (MAXALIGN(size) > (Size) size)
+				buf.data = ptr;
+			else
+			{
+				buf.data = palloc(size + 1);
+				memcpy(buf.data, ptr, size);
+				buf.data[size] = '\0';
+			}
+
+			buf.len = size;
+			buf.maxlen = size + 1;
 			buf.cursor = 0;
 
 			/*
@@ -829,10 +1430,7 @@ dbms_pipe_unpack_message(PG_FUNCTION_ARGS, message_data_type dtype)
 	}
 
 	if (input_buffer->items_count == 0)
-	{
-		pfree(input_buffer);
-		input_buffer = NULL;
-	}
+		release_input_buffer();
 
 	PG_RETURN_DATUM(result);
 }
@@ -898,9 +1496,9 @@ dbms_pipe_receive_message(PG_FUNCTION_ARGS)
 {
 	text *pipe_name = NULL;
 	int timeout = ONE_YEAR;
-	int cycle = 0;
 	float8 endtime;
 	bool found = false;
+	bool registered;
 
 	if (PG_ARGISNULL(0))
 		ereport(ERROR,
@@ -913,23 +1511,31 @@ dbms_pipe_receive_message(PG_FUNCTION_ARGS)
 	if (!PG_ARGISNULL(1))
 		timeout = PG_GETARG_INT32(1);
 
-	if (input_buffer != NULL)
-	{
-		pfree(input_buffer);
-		input_buffer = NULL;
-	}
+	release_input_buffer();
 
-	WATCH_PRE(timeout, endtime, cycle);
-	if (NULL != (input_buffer = get_from_pipe(pipe_name, &found)))
+	/*
+	 * The latch is reset before the pipe is checked, so any message
+	 * sent after the check wakes up the following sleep.
+	 */
+	endtime = GetNowFloat() + (float8) timeout;
+	for (;;)
 	{
-		input_buffer->next = message_buffer_get_content(input_buffer);
-		break;
+		ResetLatch(MyLatch);
+
+		if (NULL != (input_buffer = get_from_pipe(pipe_name, &found,
+												  timeout != 0, &registered)))
+		{
+			input_buffer->next = message_buffer_get_content(input_buffer);
+			break;
+		}
+		/* found empty message */
+		if (found)
+			break;
+
+		if (!pipe_wait(pipe_name, true, endtime, registered))
+			PG_RETURN_INT32(RESULT_WAIT);
 	}
-/* found empty message */
-	if (found)
-		break;
 
-	WATCH_POST(timeout, endtime, cycle);
 	PG_RETURN_INT32(RESULT_DATA);
 }
 
@@ -941,8 +1547,8 @@ dbms_pipe_send_message(PG_FUNCTION_ARGS)
 	int timeout = ONE_YEAR;
 	int limit = 0;
 	bool valid_limit;
+	bool registered;
 
-	int cycle = 0;
 	float8 endtime;
 
 	if (PG_ARGISNULL(0))
@@ -966,21 +1572,231 @@ dbms_pipe_send_message(PG_FUNCTION_ARGS)
 		valid_limit = true;
 	}
 
-	if (input_buffer != NULL) /* XXX Strange? */
+	release_input_buffer(); /* XXX Strange? */
+
+	if ((Size) output_buffer->size > SHMEMMSGSZ)
+		ereport(ERROR,
+				(errcode(ERRCODE_OUT_OF_MEMORY),
+				 errmsg("out of memory"),
+				 errdetail("Packed message (%d bytes) is bigger than shared memory.",
+						   output_buffer->size),
+				 errhint("Increase orafce.pipe_shmem_size configuration parameter.")));
+
+	endtime = GetNowFloat() + (float8) timeout;
+	for (;;)
+	{
+		ResetLatch(MyLatch);
+
+		if (add_to_pipe(pipe_name, output_buffer,
+						limit, valid_limit, timeout != 0, &registered))
+			break;
+
+		if (!pipe_wait(pipe_name, false, endtime, registered))
+			PG_RETURN_INT32(RESULT_WAIT);
+	}
+
+	/* don't hold large buffer longer than necessary */
+	if (output_buffer_size > LOCALMSGSZ)
 	{
-		pfree(input_buffer);
-		input_buffer = NULL;
+		pfree(output_buffer);
+		output_buffer = check_buffer(NULL, LOCALMSGSZ);
 	}
+	else
+		init_buffer(output_buffer, LOCALMSGSZ);
 
-	WATCH_PRE(timeout, endtime, cycle);
-	if (add_to_pipe(pipe_name, output_buffer,
-					limit, valid_limit))
-		break;
-	WATCH_POST(timeout, endtime, cycle);
+	PG_RETURN_INT32(RESULT_DATA);
+}
+
+/*
+ * Batch API - every array's field is sent as separate message with one
+ * bytea field, so these messages can be received by receive_message and
+ * unpack_message_bytea too. Returns number of sent messages - less than
+ * array's size means timeout.
+ *
+ *   dbms_pipe.send_messages(pipe_name text, messages bytea[],
+ *                           timeout int, maxpipesize int)
+ */
+Datum
+dbms_pipe_send_messages(PG_FUNCTION_ARGS)
+{
+	text *pipe_name = NULL;
+	int timeout = ONE_YEAR;
+	int limit = 0;
+	bool valid_limit;
+	bool registered;
+	Datum *elems;
+	bool *nulls;
+	int nelems;
+	int nsent = 0;
+	message_buffer **msgs;
+	int i;
 
-	init_buffer(output_buffer, LOCALMSGSZ);
+	float8 endtime;
 
-	PG_RETURN_INT32(RESULT_DATA);
+	if (PG_ARGISNULL(0))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("pipe name is NULL"),
+				 errdetail("Pipename may not be NULL.")));
+	else
+		pipe_name = PG_GETARG_TEXT_P(0);
+
+	if (PG_ARGISNULL(1))
+		PG_RETURN_INT32(0);
+
+	if (!PG_ARGISNULL(2))
+		timeout = PG_GETARG_INT32(2);
+
+	if (PG_ARGISNULL(3))
+		valid_limit = false;
+	else
+	{
+		limit = PG_GETARG_INT32(3);
+		valid_limit = true;
+	}
+
+	deconstruct_array(PG_GETARG_ARRAYTYPE_P(1), BYTEAOID, -1, false, 'i',
+					  &elems, &nulls, &nelems);
+
+	/* prepare all messages before first lock */
+	msgs = palloc(nelems * sizeof(message_buffer *));
+	for (i = 0; i < nelems; i++)
+	{
+		bytea *data;
+		int32 len;
+		Size size;
+		message_buffer *msg;
+		message_data_item *item;
+
+		if (nulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("message is NULL"),
+					 errdetail("Array of messages may not contain NULL.")));
+
+		data = DatumGetByteaPP(elems[i]);
+		len = VARSIZE_ANY_EXHDR(data);
+		size = message_buffer_size + message_data_item_size + MAXALIGN(len);
+
+		if (size > SHMEMMSGSZ)
+			ereport(ERROR,
+					(errcode(ERRCODE_OUT_OF_MEMORY),
+					 errmsg("out of memory"),
+					 errdetail("Packed message (%lu bytes) is bigger than shared memory.",
+							   (unsigned long) size),
+					 errhint("Increase orafce.pipe_shmem_size configuration parameter.")));
+
+		msg = palloc(size);
+		init_buffer(msg, size);
+
+		item = message_buffer_get_content(msg);
+		item->size = len;
+		item->type = IT_BYTEA;
+		item->tupType = InvalidOid;
+		memcpy(message_data_get_content(item), VARDATA_ANY(data), len);
+
+		msg->size = size;
+		msg->items_count = 1;
+		msgs[i] = msg;
+	}
+
+	endtime = GetNowFloat() + (float8) timeout;
+	for (;;)
+	{
+		ResetLatch(MyLatch);
+
+		if (add_many_to_pipe(pipe_name, msgs, nelems, &nsent,
+							 limit, valid_limit, timeout != 0, &registered))
+			break;
+
+		if (!pipe_wait(pipe_name, false, endtime, registered))
+			break;
+	}
+
+	PG_RETURN_INT32(nsent);
+}
+
+typedef struct MessagesFctx {
+	Datum *values;
+	int nvalues;
+	int next;
+} MessagesFctx;
+
+/*
+ * Batch API - returns up to max_count messages with one bytea field.
+ * Waits only for first message.
+ *
+ *   dbms_pipe.receive_messages(pipe_name text, max_count int, timeout int)
+ */
+Datum
+dbms_pipe_receive_messages(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	MessagesFctx    *fctx;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		text *pipe_name = NULL;
+		int max_count;
+		int timeout = ONE_YEAR;
+		float8 endtime;
+		bool registered;
+		MemoryContext oldcontext;
+
+		if (PG_ARGISNULL(0))
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("pipe name is NULL"),
+					 errdetail("Pipename may not be NULL.")));
+		else
+			pipe_name = PG_GETARG_TEXT_P(0);
+
+		if (PG_ARGISNULL(1))
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("max_count is NULL")));
+
+		max_count = PG_GETARG_INT32(1);
+		if (max_count <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("max_count should be positive number")));
+
+		if (!PG_ARGISNULL(2))
+			timeout = PG_GETARG_INT32(2);
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		fctx = palloc(sizeof(MessagesFctx));
+		fctx->values = NULL;
+		fctx->next = 0;
+		funcctx->user_fctx = fctx;
+
+		endtime = GetNowFloat() + (float8) timeout;
+		for (;;)
+		{
+			ResetLatch(MyLatch);
+
+			fctx->nvalues = get_many_from_pipe(pipe_name, &fctx->values, max_count,
+											  timeout != 0, &registered);
+			if (fctx->nvalues > 0)
+				break;
+
+			if (!pipe_wait(pipe_name, true, endtime, registered))
+				break;
+		}
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	fctx = (MessagesFctx *) funcctx->user_fctx;
+
+	if (fctx->next < fctx->nvalues)
+		SRF_RETURN_NEXT(funcctx, fctx->values[fctx->next++]);
+
+	SRF_RETURN_DONE(funcctx);
 }
 
 
@@ -995,7 +1811,7 @@ dbms_pipe_unique_session_name (PG_FUNCTION_ARGS)
 	int timeout = 10;
 
 	WATCH_PRE(timeout, endtime, cycle);
-	if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES,MAX_EVENTS,MAX_LOCKS,false))
+	if (ora_lock_shmem_shared(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 	{
 		initStringInfo(&strbuf);
 		appendStringInfo(&strbuf,"PG$PIPE$%d$%d",sid, MyProcPid);
@@ -1033,7 +1849,7 @@ dbms_pipe_list_pipes(PG_FUNCTION_ARGS)
 		bool has_lock = false;
 
 		WATCH_PRE(timeout, endtime, cycle);
-		if (ora_lock_shmem(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS, false))
+		if (ora_lock_shmem_shared(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
 		{
 			has_lock = true;
 			break;
@@ -1122,6 +1938,182 @@ dbms_pipe_list_pipes(PG_FUNCTION_ARGS)
 	SRF_RETURN_DONE(funcctx);
 }
 
+#define DB_SHMEM_STATS_COLS		4
+
+static void
+put_stat(Tuplestorestate *tupstore, TupleDesc tupdesc,
+		 const char *kind, const char *name, const char *stat, int64 value)
+{
+	Datum		values[DB_SHMEM_STATS_COLS];
+	bool		nulls[DB_SHMEM_STATS_COLS] = {false, false, false, false};
+
+	values[0] = CStringGetTextDatum(kind);
+	if (name != NULL)
+		values[1] = CStringGetTextDatum(name);
+	else
+		nulls[1] = true;
+	values[2] = CStringGetTextDatum(stat);
+	values[3] = Int64GetDatum(value);
+
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+static int
+count_waiters(pipe_waiter *w)
+{
+	int			n = 0;
+
+	for (; w != NULL; w = w->next_waiter)
+		n++;
+
+	return n;
+}
+
+/*
+ * Returns statistics of shared memory used by dbms_pipe and dbms_alert
+ * as (kind, name, stat, value) rows. Pipes, alerts and allocator are
+ * read under their own locks one by one, so the result is not one
+ * consistent snapshot.
+ */
+Datum
+dbms_pipe_shmem_stats(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+	ora_sstat_info info;
+	int64		used_bytes = 0;
+	int64		free_bytes = 0;
+	int64		lock_waits[ORAFCE_LWLOCKS];
+	int64		lock_wait_time[ORAFCE_LWLOCKS];
+	int			used;
+	int			i;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	tupdesc = CreateTupleDescCopy(tupdesc);
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	if (!ora_lock_shmem_shared(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
+		LOCK_ERROR();
+
+	for (i = 0, used = 0; i < MAX_PIPES; i++)
+	{
+		pipe	   *p = &pipes[i];
+
+		if (!p->is_valid)
+			continue;
+
+		used += 1;
+		put_stat(tupstore, tupdesc, "pipe", p->pipe_name, "messages_sent", p->sent_messages);
+		put_stat(tupstore, tupdesc, "pipe", p->pipe_name, "bytes_sent", p->sent_bytes);
+		put_stat(tupstore, tupdesc, "pipe", p->pipe_name, "messages_received", p->recv_messages);
+		put_stat(tupstore, tupdesc, "pipe", p->pipe_name, "bytes_received", p->recv_bytes);
+		put_stat(tupstore, tupdesc, "pipe", p->pipe_name, "receivers_waiting", count_waiters(p->recv_waiters));
+		put_stat(tupstore, tupdesc, "pipe", p->pipe_name, "senders_waiting", count_waiters(p->send_waiters));
+	}
+
+	put_stat(tupstore, tupdesc, "slots", "pipes", "used", used);
+	put_stat(tupstore, tupdesc, "slots", "pipes", "max", MAX_PIPES);
+
+	LWLockRelease(shmem_lockid);
+
+	if (!ora_lock_alerts(SHMEMMSGSZ, MAX_PIPES, MAX_EVENTS, MAX_LOCKS))
+		LOCK_ERROR();
+
+	for (i = 0, used = 0; i < MAX_EVENTS; i++)
+	{
+		alert_event *ev = &events[i];
+		message_item *msg;
+		int			pending = 0;
+
+		if (ev->event_name == NULL)
+			continue;
+
+		for (msg = ev->messages; msg != NULL; msg = msg->next_message)
+			pending++;
+
+		used += 1;
+		put_stat(tupstore, tupdesc, "alert", ev->event_name, "signals", ev->signals);
+		put_stat(tupstore, tupdesc, "alert", ev->event_name, "receivers", ev->receivers_number);
+		put_stat(tupstore, tupdesc, "alert", ev->event_name, "pending_messages", pending);
+	}
+
+	put_stat(tupstore, tupdesc, "slots", "events", "used", used);
+	put_stat(tupstore, tupdesc, "slots", "events", "max", MAX_EVENTS);
+
+	for (i = 0, used = 0; i < MAX_LOCKS; i++)
+		if (locks[i].sid != -1)
+			used += 1;
+
+	put_stat(tupstore, tupdesc, "slots", "locks", "used", used);
+	put_stat(tupstore, tupdesc, "slots", "locks", "max", MAX_LOCKS);
+
+	LWLockRelease(alerts_lockid);
+
+	ora_sstat(&info);
+
+	for (i = 0; i < info.nclasses; i++)
+	{
+		ora_sstat_class *c = &info.classes[i];
+		char		name[32];
+
+		snprintf(name, sizeof(name), "%lu", (unsigned long) c->class_size);
+
+		put_stat(tupstore, tupdesc, "memory class", name, "used_blocks", c->used_blocks);
+		put_stat(tupstore, tupdesc, "memory class", name, "used_bytes", c->used_bytes);
+		put_stat(tupstore, tupdesc, "memory class", name, "free_blocks", c->free_blocks);
+		put_stat(tupstore, tupdesc, "memory class", name, "free_bytes", c->free_bytes);
+
+		used_bytes += c->used_bytes;
+		free_bytes += c->free_bytes;
+	}
+
+	put_stat(tupstore, tupdesc, "memory", NULL, "total_bytes", info.total_bytes);
+	put_stat(tupstore, tupdesc, "memory", NULL, "used_bytes", used_bytes);
+	put_stat(tupstore, tupdesc, "memory", NULL, "free_bytes", free_bytes);
+	put_stat(tupstore, tupdesc, "memory", NULL, "largest_free_block", info.largest_free);
+	put_stat(tupstore, tupdesc, "memory", NULL, "allocations", info.allocations);
+	put_stat(tupstore, tupdesc, "memory", NULL, "failed_allocations", info.failures);
+
+	SpinLockAcquire(&shmem_desc->stats_mutex);
+	for (i = 0; i < ORAFCE_LWLOCKS; i++)
+	{
+		lock_waits[i] = shmem_desc->lock_waits[i];
+		lock_wait_time[i] = shmem_desc->lock_wait_time[i];
+	}
+	SpinLockRelease(&shmem_desc->stats_mutex);
+
+	put_stat(tupstore, tupdesc, "lock", "pipes", "waits", lock_waits[PIPES_LOCK]);
+	put_stat(tupstore, tupdesc, "lock", "pipes", "wait_time_us", lock_wait_time[PIPES_LOCK]);
+	put_stat(tupstore, tupdesc, "lock", "alerts", "waits", lock_waits[ALERTS_LOCK]);
+	put_stat(tupstore, tupdesc, "lock", "alerts", "wait_time_us", lock_wait_time[ALERTS_LOCK]);
+	put_stat(tupstore, tupdesc, "lock", "allocator", "waits", info.lock_waits);
+	put_stat(tupstore, tupdesc, "lock", "allocator", "wait_time_us", info.lock_wait_time);
+
+	return (Datum) 0;
+}
+
 /*
  * secondary functions
  */
@@ -1212,11 +2204,7 @@ dbms_pipe_reset_buffer(PG_FUNCTION_ARGS)
 		output_buffer = NULL;
 	}
 
-	if (input_buffer != NULL)
-	{
-		pfree(input_buffer);
-		input_buffer = NULL;
-	}
+	release_input_buffer();
 
 	PG_RETURN_VOID();
 }
@@ -2,41 +2,61 @@
 #define __PIPE__
 
 #define LOCALMSGSZ (8*1024)
-#define SHMEMMSGSZ (30*1024)
-#define MAX_PIPES  30
-#define MAX_EVENTS 30
-#define MAX_LOCKS  256
+
+/*
+ * Sizes of shared memory structures are set by postmaster's GUC
+ * orafce.pipe_shmem_size (in kB), orafce.max_pipes, orafce.max_events
+ * and orafce.max_locks.
+ */
+extern int orafce_pipe_shmem_size;
+extern int orafce_max_pipes;
+extern int orafce_max_events;
+extern int orafce_max_locks;
+
+#define SHMEMMSGSZ ((size_t) orafce_pipe_shmem_size * 1024)
+#define MAX_PIPES  orafce_max_pipes
+#define MAX_EVENTS orafce_max_events
+#define MAX_LOCKS  orafce_max_locks
 
 typedef struct _message_item {
 	char *message;
 	float8 timestamp;
 	struct _message_item *next_message;
 	struct _message_item *prev_message;
-	unsigned char message_id;
+	int message_id;
 	int *receivers;                     /* copy of array all registered receivers */
 	int receivers_number;
 } message_item;
 
 typedef struct _message_echo {
 	struct _message_item *message;
-	unsigned char message_id;
+	int message_id;
 	struct _message_echo *next_echo;
 } message_echo;
 
 typedef struct {
 	char *event_name;
-	unsigned char max_receivers;
+	int max_receivers;
 	int *receivers;
 	int receivers_number;
 	struct _message_item *messages;
+	int64 signals;						/* statistics */
 } alert_event;
 
 typedef struct {
 	int sid;
 	message_echo *echo;
+	struct Latch *latch;				/* latch of the session */
 } alert_lock;
 
+/* number of LWLocks used by dbms_pipe, dbms_alert and shmmc allocator */
+#define ORAFCE_LWLOCKS		3
+
+size_t ora_shmem_size(size_t size, int max_pipes, int max_events, int max_locks);
 bool ora_lock_shmem(size_t size, int max_pipes, int max_events, int max_locks, bool reset);
+bool ora_lock_shmem_shared(size_t size, int max_pipes, int max_events, int max_locks);
+bool ora_lock_alerts(size_t size, int max_pipes, int max_events, int max_locks);
+bool ora_wait_latch(float8 endtime, bool registered);
 
 #define ERRCODE_ORA_PACKAGES_LOCK_REQUEST_ERROR        MAKE_SQLSTATE('3','0', '0','0','1')
 
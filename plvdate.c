@@ -2,7 +2,8 @@
   This code implements one part of functonality of
   free available library PL/Vision. Please look www.quest.com
 
-  This library isn't optimalized for big numbers, for working
+  The business days are cached for years 1900 - 2099, the calculation
+  for other dates isn't optimalized for big numbers, for working
   with n days (n > 10000), can be slow (on my P4 31ms).
 
   Original author: Steven Feuerstein, 1996 - 2002
@@ -14,8 +15,13 @@
 #define PLVDATE_VERSION  "PostgreSQL PLVdate, version 3.7, October 2018"
 
 #include "postgres.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "utils/array.h"
 #include "utils/date.h"
 #include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include <sys/time.h>
 #include <stdlib.h>
 #include "orafce.h"
@@ -41,6 +47,8 @@ PG_FUNCTION_INFO_V1(plvdate_include_start);
 PG_FUNCTION_INFO_V1(plvdate_including_start);
 
 PG_FUNCTION_INFO_V1(plvdate_default_holidays);
+PG_FUNCTION_INFO_V1(plvdate_save_calendar);
+PG_FUNCTION_INFO_V1(plvdate_use_calendar);
 
 PG_FUNCTION_INFO_V1(plvdate_version);
 
@@ -67,9 +75,6 @@ static bool use_great_friday = true;
 static bool include_start = true;
 static int country_id = -1;			/* unknown */
 
-#define MAX_holidays   30
-#define MAX_EXCEPTIONS 50
-
 typedef struct {
 	char day;
 	char month;
@@ -83,11 +88,17 @@ typedef struct {
 	int holidays_c;
 } cultural_info;
 
-static holiday_desc holidays[MAX_holidays];  /* sorted array */
-static DateADT exceptions[MAX_EXCEPTIONS];   /* sorted array */
+/* arrays are allocated in TopMemoryContext and enlarged when it is necessary */
+static holiday_desc *holidays = NULL;	/* sorted array */
+static DateADT *exceptions = NULL;		/* sorted array */
 
 static int holidays_c = 0;
 static int exceptions_c = 0;
+static int holidays_size = 0;
+static int exceptions_size = 0;
+
+/* value of orafce.plvdate_calendar used for last loading of calendar */
+static char *loaded_calendar_guc = NULL;
 
 static holiday_desc czech_holidays[] = {
 	{1,1}, // Novy rok
@@ -179,6 +190,26 @@ holiday_desc_comp(const void* a, const void* b)
 	return result;
 }
 
+static void *
+enlarge_array(void *array, int *size, int needed, Size elemsize)
+{
+	if (needed <= *size)
+		return array;
+
+	*size = Max(Max(*size * 2, needed), 32);
+
+	if (array)
+		return repalloc(array, *size * elemsize);
+
+	return MemoryContextAlloc(TopMemoryContext, *size * elemsize);
+}
+
+#define ensure_holidays_size(n) \
+	(holidays = enlarge_array(holidays, &holidays_size, (n), sizeof(holiday_desc)))
+
+#define ensure_exceptions_size(n) \
+	(exceptions = enlarge_array(exceptions, &exceptions_size, (n), sizeof(DateADT)))
+
 
 static void
 calc_easter_sunday(int year, int* dd, int* mm)
@@ -244,6 +275,358 @@ easter_holidays(DateADT day, int y, int m)
 	return false;
 }
 
+/*
+ * Cache of business days. For continuous range of years the number of
+ * business days before any day (prefix sum) and the list of business
+ * days are stored, so add and diff are simple lookups. The cache is
+ * built for years, that are used, and it is invalidated when the
+ * calendar is changed.
+ *
+ * Because Easter is defined only for years 1900 - 2099, the cache is
+ * used only in this range. The original day by day calculation is
+ * used for other dates.
+ */
+#define BIZDAYS_CACHE_MIN_YEAR		1900
+#define BIZDAYS_CACHE_MAX_YEAR		2099
+#define BIZDAYS_CACHE_MAX_YEARS		50
+
+static bool bizdays_cache_valid = false;
+static int bizdays_cache_first_year;
+static int bizdays_cache_last_year;
+static DateADT bizdays_cache_start;			/* first day of cache */
+static DateADT bizdays_cache_end;			/* last day of cache */
+static int *bizdays_cache_prefix = NULL;	/* bizdays before day */
+static int *bizdays_cache_diff_prefix = NULL;	/* see ora_diff_bizdays */
+static DateADT *bizdays_cache_list = NULL;	/* sorted business days */
+static int bizdays_cache_count;
+
+static void
+invalidate_bizdays_cache(void)
+{
+	bizdays_cache_valid = false;
+}
+
+/*
+ * returns true, when day is holiday (without checking day of week)
+ */
+static bool
+is_holiday(DateADT day)
+{
+	int y, m, d;
+	holiday_desc hd;
+
+	if (NULL != bsearch(&day, exceptions, exceptions_c,
+						sizeof(DateADT), dateadt_comp))
+		return true;
+
+	j2date(day + POSTGRES_EPOCH_JDATE, &y, &m, &d);
+	hd.day = (char) d;
+	hd.month = (char) m;
+
+	if (easter_holidays(day, y, m))
+		return true;
+
+	return NULL != bsearch(&hd, holidays, holidays_c,
+						   sizeof(holiday_desc), holiday_desc_comp);
+}
+
+static void
+build_bizdays_cache(int first_year, int last_year)
+{
+	DateADT start = date2j(first_year, 1, 1) - POSTGRES_EPOCH_JDATE;
+	DateADT end = date2j(last_year + 1, 1, 1) - POSTGRES_EPOCH_JDATE - 1;
+	int ndays = end - start + 1;
+	int *prefix;
+	int *diff_prefix;
+	DateADT *list;
+	bool holiday;
+	int dow;
+	int i;
+
+	prefix = MemoryContextAlloc(TopMemoryContext, (ndays + 1) * sizeof(int));
+	diff_prefix = MemoryContextAlloc(TopMemoryContext, (ndays + 1) * sizeof(int));
+	list = MemoryContextAlloc(TopMemoryContext, ndays * sizeof(DateADT));
+
+	prefix[0] = 0;
+	diff_prefix[0] = 0;
+	dow = j2day(start + POSTGRES_EPOCH_JDATE);
+	holiday = is_holiday(start);
+
+	for (i = 0; i < ndays; i++)
+	{
+		bool	next_holiday = is_holiday(start + i + 1);
+		bool	bizdow = ((1 << dow) & nonbizdays) == 0;
+
+		prefix[i + 1] = prefix[i];
+		if (bizdow && !holiday)
+		{
+			list[prefix[i]] = start + i;
+			prefix[i + 1] += 1;
+		}
+
+		diff_prefix[i + 1] = diff_prefix[i];
+		if (bizdow && !next_holiday)
+			diff_prefix[i + 1] += 1;
+
+		holiday = next_holiday;
+		dow = (dow + 1) % 7;
+	}
+
+	if (bizdays_cache_prefix)
+	{
+		pfree(bizdays_cache_prefix);
+		pfree(bizdays_cache_diff_prefix);
+		pfree(bizdays_cache_list);
+	}
+
+	bizdays_cache_prefix = prefix;
+	bizdays_cache_diff_prefix = diff_prefix;
+	bizdays_cache_list = list;
+	bizdays_cache_count = prefix[ndays];
+	bizdays_cache_first_year = first_year;
+	bizdays_cache_last_year = last_year;
+	bizdays_cache_start = start;
+	bizdays_cache_end = end;
+	bizdays_cache_valid = true;
+}
+
+/*
+ * Ensure, so cache holds days from day1 to day2. Returns false,
+ * when it is not possible.
+ */
+static bool
+bizdays_cache_covers(int64 day1, int64 day2)
+{
+	int y1, y2, m, d;
+
+	if (day1 > day2)
+	{
+		int64 aux = day1;
+
+		day1 = day2; day2 = aux;
+	}
+
+	if (bizdays_cache_valid &&
+		day1 >= bizdays_cache_start && day2 <= bizdays_cache_end)
+		return true;
+
+	if (day2 - day1 > 366 * BIZDAYS_CACHE_MAX_YEARS ||
+		day1 < date2j(BIZDAYS_CACHE_MIN_YEAR, 1, 1) - POSTGRES_EPOCH_JDATE ||
+		day2 >= date2j(BIZDAYS_CACHE_MAX_YEAR + 1, 1, 1) - POSTGRES_EPOCH_JDATE)
+		return false;
+
+	j2date((int) day1 + POSTGRES_EPOCH_JDATE, &y1, &m, &d);
+	j2date((int) day2 + POSTGRES_EPOCH_JDATE, &y2, &m, &d);
+
+	/* extend current range, when it is not too big */
+	if (bizdays_cache_valid &&
+		Max(y2, bizdays_cache_last_year) - Min(y1, bizdays_cache_first_year) < BIZDAYS_CACHE_MAX_YEARS)
+	{
+		y1 = Min(y1, bizdays_cache_first_year);
+		y2 = Max(y2, bizdays_cache_last_year);
+	}
+
+	build_bizdays_cache(y1, y2);
+
+	return true;
+}
+
+/*
+ * Named calendars are stored in table plvdate.calendars, so they are
+ * persistent and available for all sessions. The holidays are stored
+ * as dates, the year is ignored.
+ */
+static void
+load_calendar(const char *name)
+{
+	static SPIPlanPtr	plan = NULL;
+
+	Oid		argtypes[] = {TEXTOID};
+	Datum	values[1];
+	char	nulls[1] = {' '};
+	HeapTuple	tuple;
+	TupleDesc	tupdesc;
+	Datum	value;
+	bool	isnull;
+	int		new_nonbizdays;
+	bool	new_use_easter;
+	bool	new_use_great_friday;
+	int		new_country_id = -1;
+	Datum  *elems;
+	bool   *elemnulls;
+	int		nelems;
+	int		i;
+
+	values[0] = CStringGetTextDatum(name);
+
+	if (SPI_connect() < 0)
+		ereport(ERROR,
+			(errcode(ERRCODE_INTERNAL_ERROR),
+			 errmsg("SPI_connect failed")));
+
+	if (!plan)
+	{
+		SPIPlanPtr p = SPI_prepare(
+		    "SELECT nonbizdays, use_easter, use_great_friday, country, holidays, exceptions"
+		        " FROM plvdate.calendars WHERE name = $1",
+		    1, argtypes);
+
+		if (p == NULL || (plan = SPI_saveplan(p)) == NULL)
+			ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				errmsg("SPI_prepare_failed")));
+	}
+
+	if (SPI_OK_SELECT != SPI_execute_plan(plan, values, nulls, false, 1))
+		ereport(ERROR,
+			(errcode(ERRCODE_INTERNAL_ERROR),
+			 errmsg("can't execute sql")));
+
+	if (SPI_processed == 0)
+		ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_OBJECT),
+			 errmsg("calendar \"%s\" does not exist", name)));
+
+	tuple = SPI_tuptable->vals[0];
+	tupdesc = SPI_tuptable->tupdesc;
+
+	new_nonbizdays = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+	if (isnull || new_nonbizdays < 0 || new_nonbizdays >= 0x7f)
+		ereport(ERROR,
+			(errcode(ERRCODE_DATA_EXCEPTION),
+			 errmsg("invalid calendar \"%s\"", name),
+			 errdetail("One day in week have to be bizday.")));
+
+	value = SPI_getbinval(tuple, tupdesc, 2, &isnull);
+	new_use_easter = !isnull && DatumGetBool(value);
+
+	value = SPI_getbinval(tuple, tupdesc, 3, &isnull);
+	new_use_great_friday = !isnull && DatumGetBool(value);
+
+	value = SPI_getbinval(tuple, tupdesc, 4, &isnull);
+	if (!isnull)
+	{
+		text   *country = DatumGetTextPP(value);
+
+		new_country_id = ora_seq_search(VARDATA_ANY(country), states, VARSIZE_ANY_EXHDR(country));
+		CHECK_SEQ_SEARCH(new_country_id, "STATE/State/state");
+	}
+
+	/* all checks are done, now the calendar can be changed */
+	nonbizdays = (unsigned char) new_nonbizdays;
+	use_easter = new_use_easter;
+	use_great_friday = new_use_great_friday;
+	country_id = new_country_id;
+
+	holidays_c = 0;
+	value = SPI_getbinval(tuple, tupdesc, 5, &isnull);
+	if (!isnull)
+	{
+		deconstruct_array(DatumGetArrayTypeP(value), DATEOID, sizeof(DateADT),
+						  true, 'i', &elems, &elemnulls, &nelems);
+
+		ensure_holidays_size(nelems);
+		for (i = 0; i < nelems; i++)
+		{
+			int y, m, d;
+
+			if (elemnulls[i])
+				continue;
+
+			j2date(DatumGetDateADT(elems[i]) + POSTGRES_EPOCH_JDATE, &y, &m, &d);
+			holidays[holidays_c].month = m;
+			holidays[holidays_c].day = d;
+			holidays_c += 1;
+		}
+
+		qsort(holidays, holidays_c, sizeof(holiday_desc), holiday_desc_comp);
+	}
+
+	exceptions_c = 0;
+	value = SPI_getbinval(tuple, tupdesc, 6, &isnull);
+	if (!isnull)
+	{
+		deconstruct_array(DatumGetArrayTypeP(value), DATEOID, sizeof(DateADT),
+						  true, 'i', &elems, &elemnulls, &nelems);
+
+		ensure_exceptions_size(nelems);
+		for (i = 0; i < nelems; i++)
+			if (!elemnulls[i])
+				exceptions[exceptions_c++] = DatumGetDateADT(elems[i]);
+
+		qsort(exceptions, exceptions_c, sizeof(DateADT), dateadt_comp);
+	}
+
+	SPI_finish();
+
+	invalidate_bizdays_cache();
+}
+
+/*
+ * Load calendar specified by orafce.plvdate_calendar, when this value
+ * was changed from last call. So the calendar can be set for database
+ * or role, and it is not necessary to configure any new session.
+ */
+static void
+load_calendar_guc(void)
+{
+	const char *name = orafce_plvdate_calendar;
+
+	if (name == NULL || *name == '\0')
+	{
+		if (loaded_calendar_guc)
+		{
+			pfree(loaded_calendar_guc);
+			loaded_calendar_guc = NULL;
+		}
+		return;
+	}
+
+	if (loaded_calendar_guc && strcmp(loaded_calendar_guc, name) == 0)
+		return;
+
+	load_calendar(name);
+
+	if (loaded_calendar_guc)
+		pfree(loaded_calendar_guc);
+	loaded_calendar_guc = MemoryContextStrdup(TopMemoryContext, name);
+}
+
+/*
+ * Returns true and result, when the result can be calculated from cache.
+ */
+static bool
+cached_add_bizdays(DateADT day, int days, DateADT *result)
+{
+	int nbizdow = 0;
+	int64 estimated;
+	int64 idx;
+	int i;
+
+	for (i = 0; i < 7; i++)
+		if (((1 << i) & nonbizdays) == 0)
+			nbizdow += 1;
+
+	/* holidays are not calculated, so add one month */
+	estimated = (int64) day + (int64) days * (7 / nbizdow + 1) + (days > 0 ? 31 : -31);
+
+	if (!bizdays_cache_covers(day, estimated))
+		return false;
+
+	/* bizdays_cache_prefix[i] is number of bizdays before start + i */
+	if (days > 0)
+		idx = (int64) bizdays_cache_prefix[day - bizdays_cache_start + 1] + days - 1;
+	else
+		idx = (int64) bizdays_cache_prefix[day - bizdays_cache_start] + days;
+
+	if (idx < 0 || idx >= bizdays_cache_count)
+		return false;
+
+	*result = bizdays_cache_list[idx];
+
+	return true;
+}
+
 static DateADT
 ora_add_bizdays(DateADT day, int days)
 {
@@ -251,6 +634,14 @@ ora_add_bizdays(DateADT day, int days)
 	int y, m, auxd;
 	holiday_desc hd;
 
+	load_calendar_guc();
+
+	if (days == 0)
+		return day;
+
+	if (cached_add_bizdays(day, days, &day))
+		return day;
+
 	d = j2day(day+POSTGRES_EPOCH_JDATE);
 	dx = days > 0? 1 : -1;
 
@@ -295,12 +686,34 @@ ora_diff_bizdays(DateADT day1, DateADT day2)
 	bool start_is_bizday = false;
 
 	DateADT aux_day;
+
+	load_calendar_guc();
+
 	if (day1 > day2)
 	{
 		aux_day = day1;
 		day1 = day2; day2 = aux_day;
 	}
 
+	/*
+	 * The loop checks day of week of current day, but holidays of next
+	 * day. The cache holds prefix sum of same condition, so the results
+	 * are same.
+	 */
+	if (bizdays_cache_covers(day1, day2))
+	{
+		int idx1 = day1 - bizdays_cache_start;
+		int idx2 = day2 - bizdays_cache_start;
+
+		days = bizdays_cache_diff_prefix[idx2 + 1] - bizdays_cache_diff_prefix[idx1];
+		start_is_bizday = bizdays_cache_diff_prefix[idx1 + 1] > bizdays_cache_diff_prefix[idx1];
+
+		if (start_is_bizday && !include_start && days > 0)
+			days -= 1;
+
+		return days;
+	}
+
 	/* d is incremented on start of cycle, so now I have to decrease one */
 	d = j2day(day1+POSTGRES_EPOCH_JDATE-1);
 	days = 0;
@@ -479,6 +892,15 @@ plvdate_isbizday (PG_FUNCTION_ARGS)
 	int y, m, d;
 	holiday_desc hd;
 
+	load_calendar_guc();
+
+	if (bizdays_cache_covers(day, day))
+	{
+		int idx = day - bizdays_cache_start;
+
+		PG_RETURN_BOOL(bizdays_cache_prefix[idx + 1] > bizdays_cache_prefix[idx]);
+	}
+
 	if (0 != ((1 << j2day(day+POSTGRES_EPOCH_JDATE)) & nonbizdays))
 		return false;
 
@@ -518,6 +940,8 @@ plvdate_set_nonbizday_dow (PG_FUNCTION_ARGS)
 	int d = ora_seq_search(VARDATA_ANY(day_txt), ora_days, VARSIZE_ANY_EXHDR(day_txt));
 	CHECK_SEQ_SEARCH(d, "DAY/Day/day");
 
+	load_calendar_guc();
+
 	check = nonbizdays | (1 << d);
 	if (check == 0x7f)
 		ereport(ERROR,
@@ -527,6 +951,7 @@ plvdate_set_nonbizday_dow (PG_FUNCTION_ARGS)
 			     errhint("One day in week have to be bizday.")));
 
 	nonbizdays = nonbizdays | (1 << d);
+	invalidate_bizdays_cache();
 
 	PG_RETURN_VOID();
 }
@@ -550,7 +975,10 @@ plvdate_unset_nonbizday_dow (PG_FUNCTION_ARGS)
 	int d = ora_seq_search(VARDATA_ANY(day_txt), ora_days, VARSIZE_ANY_EXHDR(day_txt));
 	CHECK_SEQ_SEARCH(d, "DAY/Day/day");
 
+	load_calendar_guc();
+
 	nonbizdays = (nonbizdays | (1 << d)) ^ (1 << d);
+	invalidate_bizdays_cache();
 
 	PG_RETURN_VOID();
 }
@@ -576,15 +1004,10 @@ plvdate_set_nonbizday_day (PG_FUNCTION_ARGS)
 	int y, m, d;
 	holiday_desc hd;
 
+	load_calendar_guc();
+
 	if (arg2)
 	{
-		if (holidays_c == MAX_holidays)
-			ereport(ERROR,
-				    (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
-				     errmsg("nonbizday registeration error"),
-				     errdetail("Too much registered nonbizdays."),
-				     errhint("Increase MAX_holidays in 'plvdate.c'.")));
-
 		j2date(arg1 + POSTGRES_EPOCH_JDATE, &y, &m, &d);
 		hd.month = m; hd.day = d;
 
@@ -594,6 +1017,7 @@ plvdate_set_nonbizday_day (PG_FUNCTION_ARGS)
 				     errmsg("nonbizday registeration error"),
 				     errdetail("Date is registered.")));
 
+		ensure_holidays_size(holidays_c + 1);
 		holidays[holidays_c].month = m;
 		holidays[holidays_c].day = d;
 		holidays_c += 1;
@@ -602,23 +1026,19 @@ plvdate_set_nonbizday_day (PG_FUNCTION_ARGS)
 	}
 	else
 	{
-		if (exceptions_c == MAX_EXCEPTIONS)
-			ereport(ERROR,
-				    (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
-				     errmsg("nonbizday registeration error"),
-				     errdetail("Too much registered nonrepeated nonbizdays."),
-				     errhint("Increase MAX_EXCEPTIONS in 'plvdate.c'.")));
-
 		if (NULL != bsearch(&arg1, exceptions, exceptions_c, sizeof(DateADT), dateadt_comp))
 			ereport(ERROR,
 				    (errcode(ERRCODE_DUPLICATE_OBJECT),
 				     errmsg("nonbizday registeration error"),
 				     errdetail("Date is registered.")));
 
+		ensure_exceptions_size(exceptions_c + 1);
 		exceptions[exceptions_c++] = arg1;
 		qsort(exceptions, exceptions_c, sizeof(DateADT), dateadt_comp);
 	}
 
+	invalidate_bizdays_cache();
+
 	PG_RETURN_VOID();
 }
 
@@ -644,6 +1064,8 @@ plvdate_unset_nonbizday_day (PG_FUNCTION_ARGS)
 	bool found = false;
 	int i;
 
+	load_calendar_guc();
+
 	if (arg2)
 	{
 		j2date(arg1 + POSTGRES_EPOCH_JDATE, &y, &m, &d);
@@ -676,6 +1098,8 @@ plvdate_unset_nonbizday_day (PG_FUNCTION_ARGS)
 			     errmsg("nonbizday unregisteration error"),
 			     errdetail("Nonbizday not found.")));
 
+	invalidate_bizdays_cache();
+
 	PG_RETURN_VOID();
 }
 
@@ -696,7 +1120,10 @@ plvdate_unset_nonbizday_day (PG_FUNCTION_ARGS)
 Datum
 plvdate_use_easter (PG_FUNCTION_ARGS)
 {
+	load_calendar_guc();
+
 	use_easter = PG_GETARG_BOOL(0);
+	invalidate_bizdays_cache();
 
 	PG_RETURN_VOID();
 }
@@ -716,6 +1143,8 @@ plvdate_use_easter (PG_FUNCTION_ARGS)
 Datum
 plvdate_using_easter (PG_FUNCTION_ARGS)
 {
+	load_calendar_guc();
+
 	PG_RETURN_BOOL(use_easter);
 }
 
@@ -736,7 +1165,10 @@ plvdate_using_easter (PG_FUNCTION_ARGS)
 Datum
 plvdate_use_great_friday (PG_FUNCTION_ARGS)
 {
+	load_calendar_guc();
+
 	use_great_friday = PG_GETARG_BOOL(0);
+	invalidate_bizdays_cache();
 
 	PG_RETURN_VOID();
 }
@@ -756,6 +1188,8 @@ plvdate_use_great_friday (PG_FUNCTION_ARGS)
 Datum
 plvdate_using_great_friday (PG_FUNCTION_ARGS)
 {
+	load_calendar_guc();
+
 	PG_RETURN_BOOL(use_great_friday);
 }
 
@@ -810,6 +1244,9 @@ plvdate_default_holidays (PG_FUNCTION_ARGS)
 {
 	text *country = PG_GETARG_TEXT_PP(0);
 
+	/* calendar from orafce.plvdate_calendar must not overwrite this calendar */
+	load_calendar_guc();
+
 	country_id = ora_seq_search(VARDATA_ANY(country), states, VARSIZE_ANY_EXHDR(country));
 	CHECK_SEQ_SEARCH(country_id, "STATE/State/state");
 
@@ -819,8 +1256,122 @@ plvdate_default_holidays (PG_FUNCTION_ARGS)
 	exceptions_c = 0;
 
 	holidays_c = defaults_ci[country_id].holidays_c;
+	ensure_holidays_size(holidays_c);
 	memcpy(holidays, defaults_ci[country_id].holidays, holidays_c*sizeof(holiday_desc));
 
+	invalidate_bizdays_cache();
+
+	PG_RETURN_VOID();
+}
+
+/****************************************************************
+ * PLVdate.save_calendar
+ *
+ * Syntax:
+ *   FUNCTION save_calendar(IN name text) RETURNS void;
+ *
+ * Purpouse:
+ *   Store current calendar to table plvdate.calendars
+ *
+ ****************************************************************/
+
+Datum
+plvdate_save_calendar (PG_FUNCTION_ARGS)
+{
+	static SPIPlanPtr	plan = NULL;
+
+	Oid		argtypes[] = {TEXTOID, INT4OID, BOOLOID, BOOLOID, TEXTOID, InvalidOid, InvalidOid};
+	Datum	values[7];
+	char	nulls[7] = {' ', ' ', ' ', ' ', ' ', ' ', ' '};
+	Datum  *elems;
+	int		nelems;
+	int		i;
+
+	load_calendar_guc();
+
+	values[0] = PointerGetDatum(PG_GETARG_TEXT_PP(0));
+	values[1] = Int32GetDatum((int) nonbizdays);
+	values[2] = BoolGetDatum(use_easter);
+	values[3] = BoolGetDatum(use_great_friday);
+
+	if (country_id >= 0)
+		values[4] = CStringGetTextDatum(states[country_id]);
+	else
+		nulls[4] = 'n';
+
+	/* the year of holidays is ignored, leap year is used for 29.2. */
+	nelems = Max(holidays_c, exceptions_c);
+	elems = palloc((nelems + 1) * sizeof(Datum));
+
+	for (i = 0; i < holidays_c; i++)
+		elems[i] = DateADTGetDatum(date2j(2000, holidays[i].month, holidays[i].day) - POSTGRES_EPOCH_JDATE);
+	values[5] = PointerGetDatum(construct_array(elems, holidays_c, DATEOID,
+												sizeof(DateADT), true, 'i'));
+
+	for (i = 0; i < exceptions_c; i++)
+		elems[i] = DateADTGetDatum(exceptions[i]);
+	values[6] = PointerGetDatum(construct_array(elems, exceptions_c, DATEOID,
+												sizeof(DateADT), true, 'i'));
+
+	if (SPI_connect() < 0)
+		ereport(ERROR,
+			(errcode(ERRCODE_INTERNAL_ERROR),
+			 errmsg("SPI_connect failed")));
+
+	if (!plan)
+	{
+		SPIPlanPtr p;
+
+		argtypes[5] = get_array_type(DATEOID);
+		argtypes[6] = argtypes[5];
+
+		p = SPI_prepare(
+		    "INSERT INTO plvdate.calendars(name, nonbizdays, use_easter, use_great_friday,"
+		        " country, holidays, exceptions)"
+		        " VALUES($1, $2, $3, $4, $5, $6, $7)"
+		        " ON CONFLICT (name) DO UPDATE SET nonbizdays = EXCLUDED.nonbizdays,"
+		        " use_easter = EXCLUDED.use_easter, use_great_friday = EXCLUDED.use_great_friday,"
+		        " country = EXCLUDED.country, holidays = EXCLUDED.holidays,"
+		        " exceptions = EXCLUDED.exceptions",
+		    7, argtypes);
+
+		if (p == NULL || (plan = SPI_saveplan(p)) == NULL)
+			ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				errmsg("SPI_prepare_failed")));
+	}
+
+	if (SPI_OK_INSERT != SPI_execute_plan(plan, values, nulls, false, 0))
+		ereport(ERROR,
+			(errcode(ERRCODE_INTERNAL_ERROR),
+			 errmsg("can't execute sql")));
+
+	SPI_finish();
+
+	PG_RETURN_VOID();
+}
+
+/****************************************************************
+ * PLVdate.use_calendar
+ *
+ * Syntax:
+ *   FUNCTION use_calendar(IN name text) RETURNS void;
+ *
+ * Purpouse:
+ *   Load calendar from table plvdate.calendars
+ *
+ ****************************************************************/
+
+Datum
+plvdate_use_calendar (PG_FUNCTION_ARGS)
+{
+	char *name = text_to_cstring(PG_GETARG_TEXT_PP(0));
+
+	/* calendar from orafce.plvdate_calendar must not overwrite this calendar */
+	load_calendar_guc();
+
+	load_calendar(name);
+
 	PG_RETURN_VOID();
 }
 
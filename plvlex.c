@@ -16,63 +16,27 @@
 
 #include "postgres.h"
 #include "catalog/pg_type.h"
+#include "miscadmin.h"
 #include "lib/stringinfo.h"
 #include "nodes/pg_list.h"
 #include "utils/date.h"
 #include "utils/builtins.h"
+#include "utils/tuplestore.h"
 #include "plvlex.h"
 #include "sqlparse.h"
 #include "funcapi.h"
 #include "orafce.h"
 #include "builtins.h"
 
-typedef struct {
-	List	*nodes;
-	int 	nnodes;
-	int	cnode;
-	char **values;
-} tokensFctx;
-
 PG_FUNCTION_INFO_V1(plvlex_tokens);
 
 extern int      orafce_sql_yyparse();
 extern void orafce_sql_yyerror(List **result, const char *message);
-extern void orafce_sql_scanner_init(const char *str);
+extern void orafce_sql_scanner_init(const char *str, int slen);
 extern void orafce_sql_scanner_finish(void);
 
 static orafce_lexnode *__node;
 
-static char *__result;
-static int __len;
-
-#define CSTRING(txt) \
-	( \
-    __len = VARSIZE(txt) - VARHDRSZ, \
-    __result = palloc(__len + 1), \
-    memcpy(__result, VARDATA(txt), __len), \
-    __result[__len] = '\0', \
-    __result)
-
-
-#define COPY_TO_S(src,dest,col)	(dest->col = (src->col ? pstrdup(src->col) : NULL))
-#define COPY_TO(src,dest,col)	(dest->col = src->col)
-
-#define COPY_FIELDS(src,dest) \
-	COPY_TO(src, dest, typenode), \
-	COPY_TO_S(src,dest,str), \
-	COPY_TO(src,dest,keycode), \
-	COPY_TO(src,dest,lloc), \
-	COPY_TO_S(src,dest,sep), \
-	COPY_TO(src,dest,modificator), \
-	COPY_TO(src,dest,classname)
-
-
-#define COPY_NODE(src)   \
-  ( \
-    __node = (orafce_lexnode*) palloc(sizeof(orafce_lexnode)),  \
-    COPY_FIELDS(src,__node), \
-    __node)
-
 
 /* Finding triplet a.b --> a */
 
@@ -153,12 +117,12 @@ filterList(List *list, bool skip_spaces, bool qnames)
 			}
 			else if (isdot && !dot && a)
 			{
-				dot = COPY_NODE(nd);
+				dot = nd;
 				continue;
 			}
 			else if (IsType(nd, IDENT) && !a)
 			{
-				a = COPY_NODE(nd);
+				a = nd;
 				continue;
 			}
 		}
@@ -169,7 +133,7 @@ filterList(List *list, bool skip_spaces, bool qnames)
 
 		if (!(skip_spaces && IsType(nd, WHITESPACE)))
 		{
-			result = lappend(result, COPY_NODE(nd));
+			result = lappend(result, nd);
 		}
 	}
 
@@ -180,113 +144,104 @@ filterList(List *list, bool skip_spaces, bool qnames)
 	return result;
 }
 
+/*
+ * The nodes returned by parser are not modified, so the filtered list
+ * shares them with the parser's list.
+ */
 Datum
 plvlex_tokens(PG_FUNCTION_ARGS)
 {
-	FuncCallContext	   *funcctx;
-	TupleDesc			tupdesc;
-	AttInMetadata	   *attinmeta;
-	tokensFctx		   *fctx;
-
-
-	if (SRF_IS_FIRSTCALL ())
-	{
-		MemoryContext  oldcontext;
-		List *lexems;
-		text *src = PG_GETARG_TEXT_P(0);
-		bool skip_spaces = PG_GETARG_BOOL(1);
-		bool qnames = PG_GETARG_BOOL(2);
-
-		orafce_sql_scanner_init(CSTRING(src));
-		if (orafce_sql_yyparse(&lexems) != 0)
-			orafce_sql_yyerror(NULL, "bogus input");
-
-		orafce_sql_scanner_finish();
-
-		funcctx = SRF_FIRSTCALL_INIT ();
-		oldcontext = MemoryContextSwitchTo (funcctx->multi_call_memory_ctx);
-
-		fctx = (tokensFctx*) palloc (sizeof (tokensFctx));
-		funcctx->user_fctx = (void *)fctx;
-
-		fctx->nodes = filterList(lexems, skip_spaces, qnames);
-		fctx->nnodes = list_length(fctx->nodes);
-		fctx->cnode = 0;
-
-		fctx->values = (char **) palloc (6 * sizeof (char *));
-		fctx->values  [0] = (char*) palloc (16 * sizeof (char));
-		fctx->values  [1] = (char*) palloc (1024 * sizeof (char));
-		fctx->values  [2] = (char*) palloc (16 * sizeof (char));
-		fctx->values  [3] = (char*) palloc (16 * sizeof (char));
-		fctx->values  [4] = (char*) palloc (255 * sizeof (char));
-		fctx->values  [5] = (char*) palloc (255 * sizeof (char));
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	List	   *lexems;
+	List	   *nodes;
+	ListCell   *cell;
+	text	   *src = PG_GETARG_TEXT_PP(0);
+	bool		skip_spaces = PG_GETARG_BOOL(1);
+	bool		qnames = PG_GETARG_BOOL(2);
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	orafce_sql_scanner_init(VARDATA_ANY(src), VARSIZE_ANY_EXHDR(src));
+	if (orafce_sql_yyparse(&lexems) != 0)
+		orafce_sql_yyerror(NULL, "bogus input");
+
+	orafce_sql_scanner_finish();
+
+	nodes = filterList(lexems, skip_spaces, qnames);
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
 
 #if PG_VERSION_NUM >= 120000
 
-		tupdesc = CreateTemplateTupleDesc (6);
+	tupdesc = CreateTemplateTupleDesc (6);
 
 #else
 
-		tupdesc = CreateTemplateTupleDesc (6, false);
+	tupdesc = CreateTemplateTupleDesc (6, false);
 
 #endif
 
-		TupleDescInitEntry (tupdesc,  1, "start_pos", INT4OID, -1, 0);
-		TupleDescInitEntry (tupdesc,  2, "token",     TEXTOID, -1, 0);
-		TupleDescInitEntry (tupdesc,  3, "keycode",   INT4OID, -1, 0);
-		TupleDescInitEntry (tupdesc,  4, "class",     TEXTOID, -1, 0);
-		TupleDescInitEntry (tupdesc,  5, "separator", TEXTOID, -1, 0);
-		TupleDescInitEntry (tupdesc,  6, "mod",       TEXTOID, -1, 0);
-
-		attinmeta = TupleDescGetAttInMetadata (tupdesc);
-		funcctx -> attinmeta = attinmeta;
-
-		MemoryContextSwitchTo (oldcontext);
-	}
+	TupleDescInitEntry (tupdesc,  1, "start_pos", INT4OID, -1, 0);
+	TupleDescInitEntry (tupdesc,  2, "token",     TEXTOID, -1, 0);
+	TupleDescInitEntry (tupdesc,  3, "keycode",   INT4OID, -1, 0);
+	TupleDescInitEntry (tupdesc,  4, "class",     TEXTOID, -1, 0);
+	TupleDescInitEntry (tupdesc,  5, "separator", TEXTOID, -1, 0);
+	TupleDescInitEntry (tupdesc,  6, "mod",       TEXTOID, -1, 0);
 
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
 
-	funcctx = SRF_PERCALL_SETUP ();
-	fctx = (tokensFctx*) funcctx->user_fctx;
+	MemoryContextSwitchTo(oldcontext);
 
-	while (fctx->cnode < fctx->nnodes)
+	foreach(cell, nodes)
 	{
-		char **values;
-		Datum result;
-		HeapTuple tuple;
-		char *back_vals[6];
-
-		orafce_lexnode *nd = (orafce_lexnode*) list_nth(fctx->nodes, fctx->cnode++);
-		values = fctx->values;
-
-		back_vals[2] = values[2];
-		back_vals[4] = values[4];
-		back_vals[5] = values[5];
-
-		snprintf(values[0],    16, "%d", nd->lloc);
-		snprintf(values[1], 10000, "%s", SF(nd->str));
-		snprintf(values[2],    16, "%d", nd->keycode);
-		snprintf(values[3],    16, "%s", nd->classname);
-		snprintf(values[4],   255, "%s", SF(nd->sep));
-		snprintf(values[5],    48, "%s", SF(nd->modificator));
-
-		if (nd->keycode == -1)
-			values[2] = NULL;
-
-		if (!nd->sep)
-			values[4] = NULL;
-
-		if (!nd->modificator)
-			values[5] = NULL;
-
-		tuple = BuildTupleFromCStrings(funcctx->attinmeta, fctx->values);
-		result = HeapTupleGetDatum(tuple);
-
-		values[2] = back_vals[2];
-		values[4] = back_vals[4];
-		values[5] = back_vals[5];
-
-		SRF_RETURN_NEXT (funcctx, result);
+		orafce_lexnode *nd = (orafce_lexnode *) lfirst(cell);
+		Datum		values[6];
+		bool		nulls[6] = {false, false, false, false, false, false};
+
+		values[0] = Int32GetDatum(nd->lloc);
+		values[1] = PointerGetDatum(cstring_to_text(SF(nd->str)));
+		values[3] = PointerGetDatum(cstring_to_text(nd->classname));
+
+		if (nd->keycode != -1)
+			values[2] = Int32GetDatum(nd->keycode);
+		else
+			nulls[2] = true;
+
+		if (nd->sep)
+			values[4] = PointerGetDatum(cstring_to_text(nd->sep));
+		else
+			nulls[4] = true;
+
+		if (nd->modificator)
+			values[5] = PointerGetDatum(cstring_to_text(nd->modificator));
+		else
+			nulls[5] = true;
+
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+
+		pfree(DatumGetPointer(values[1]));
+		pfree(DatumGetPointer(values[3]));
+		if (!nulls[4])
+			pfree(DatumGetPointer(values[4]));
+		if (!nulls[5])
+			pfree(DatumGetPointer(values[5]));
 	}
 
-	SRF_RETURN_DONE (funcctx);
+	return (Datum) 0;
 }
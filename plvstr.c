@@ -93,6 +93,103 @@ typedef enum
 	LAST
 }  position_mode;
 
+/*
+ * Returns true when the string has no byte with high bit set. Such
+ * string has one byte per char in any server encoding. The string is
+ * tested by 8 byte words.
+ */
+bool
+ora_is_ascii(const char *str, int len)
+{
+	const char *end = str + len;
+
+	while (end - str >= 32)
+	{
+		uint64		w[4];
+
+		memcpy(w, str, sizeof(w));
+		if ((w[0] | w[1] | w[2] | w[3]) & UINT64CONST(0x8080808080808080))
+			return false;
+		str += sizeof(w);
+	}
+
+	while (end - str >= 8)
+	{
+		uint64		w;
+
+		memcpy(&w, str, sizeof(w));
+		if (w & UINT64CONST(0x8080808080808080))
+			return false;
+		str += sizeof(w);
+	}
+
+	while (str < end)
+	{
+		if (IS_HIGHBIT_SET(*str))
+			return false;
+		str++;
+	}
+
+	return true;
+}
+
+void
+ora_mb_index_init(ora_mb_index *idx, const char *str, int len)
+{
+	int			offset = 0;
+	int			n = 0;
+
+	idx->str = str;
+	idx->len = len;
+	idx->marks = NULL;
+
+	if (pg_database_encoding_max_length() == 1 || ora_is_ascii(str, len))
+	{
+		idx->onebyte = true;
+		idx->nchars = len;
+		return;
+	}
+
+	idx->onebyte = false;
+	idx->marks = palloc((len / ORA_MB_INDEX_STEP + 1) * sizeof(int));
+
+	while (offset < len)
+	{
+		if (n % ORA_MB_INDEX_STEP == 0)
+			idx->marks[n / ORA_MB_INDEX_STEP] = offset;
+
+		offset += _pg_mblen(str + offset);
+		n += 1;
+	}
+
+	idx->nchars = n;
+}
+
+/*
+ * Returns byte offset of nth char (zero based), n can be
+ * from 0 to idx->nchars.
+ */
+int
+ora_mb_index_offset(ora_mb_index *idx, int n)
+{
+	int			offset;
+	int			i;
+
+	Assert(n >= 0 && n <= idx->nchars);
+
+	if (idx->onebyte)
+		return n;
+
+	if (n == idx->nchars)
+		return idx->len;
+
+	offset = idx->marks[n / ORA_MB_INDEX_STEP];
+	for (i = n % ORA_MB_INDEX_STEP; i > 0; i--)
+		offset += _pg_mblen(idx->str + offset);
+
+	return offset;
+}
+
 /*
  * Make substring, can handle negative start
  *
@@ -114,6 +211,19 @@ ora_mb_strlen(text *str, char **sizes, int **positions)
 	if (NULL != positions)
 		*positions = palloc(r_len * sizeof(int));
 
+	if (ora_is_ascii(p, r_len))
+	{
+		for (cur = 0; cur < r_len; cur++)
+		{
+			if (sizes)
+				(*sizes)[cur] = 1;
+			if (positions)
+				(*positions)[cur] = cur;
+		}
+
+		return r_len;
+	}
+
 	while (cur < r_len)
 	{
 		sz = _pg_mblen(p);
@@ -139,10 +249,11 @@ ora_mb_strlen1(text *str)
 
 	r_len = VARSIZE_ANY_EXHDR(str);
 
-	if (pg_database_encoding_max_length() == 1)
+	p = VARDATA_ANY(str);
+
+	if (pg_database_encoding_max_length() == 1 || ora_is_ascii(p, r_len))
 		return r_len;
 
-	p = VARDATA_ANY(str);
 	c = 0;
 	while (r_len > 0)
 	{
@@ -171,7 +282,7 @@ ora_substr(Datum str, int start, int len)
 		int32	n;
 
 		t = DatumGetTextPP(str);
-		n = pg_mbstrlen_with_len(VARDATA_ANY(t), VARSIZE_ANY_EXHDR(t));
+		n = ora_mb_strlen1(t);
 		start = n + start + 1;
 		if (start <= 0)
 			return cstring_to_text("");
@@ -186,7 +297,199 @@ ora_substr(Datum str, int start, int len)
 			str, Int32GetDatum(start), Int32GetDatum(len)));
 }
 
-/* simply search algorhitm - can be better */
+/*
+ * Patterns shorter than INSTR_BMH_MIN_PATLEN or texts with fewer than
+ * INSTR_BMH_MIN_TXTLEN candidate positions are searched by memchr for
+ * the first byte of the pattern. Building the Boyer-Moore-Horspool skip
+ * table doesn't pay off there.
+ */
+#define INSTR_BMH_MIN_PATLEN		4
+#define INSTR_BMH_MIN_TXTLEN		256
+
+/*
+ * Returns byte offset of nth occurrence of pat in str. Candidate offsets
+ * are beg .. last (both inclusive). Overlapped occurrences are counted.
+ * Returns -1 when there are not enough occurrences. plen should be > 0.
+ */
+static int
+instr_bytes_forward(const char *str, int beg, int last,
+					const char *pat, int plen, int nth)
+{
+	int			skip[256];
+	int			i;
+
+	if (beg > last)
+		return -1;
+
+	if (plen < INSTR_BMH_MIN_PATLEN || last - beg < INSTR_BMH_MIN_TXTLEN)
+	{
+		const char *p = str + beg;
+		const char *stop = str + last;
+
+		while (p <= stop)
+		{
+			p = memchr(p, (unsigned char) pat[0], stop - p + 1);
+			if (p == NULL)
+				return -1;
+
+			if (memcmp(p + 1, pat + 1, plen - 1) == 0)
+			{
+				if (--nth == 0)
+					return p - str;
+			}
+			p += 1;
+		}
+
+		return -1;
+	}
+
+	for (i = 0; i < 256; i++)
+		skip[i] = plen;
+	for (i = 0; i < plen - 1; i++)
+		skip[(unsigned char) pat[i]] = plen - 1 - i;
+
+	i = beg;
+	while (i <= last)
+	{
+		unsigned char c = (unsigned char) str[i + plen - 1];
+
+		if (c == (unsigned char) pat[plen - 1] &&
+			memcmp(str + i, pat, plen - 1) == 0)
+		{
+			if (--nth == 0)
+				return i;
+		}
+		i += skip[c];
+	}
+
+	return -1;
+}
+
+/*
+ * Same as instr_bytes_forward, but candidate offsets are beg .. 0 and
+ * the text is scanned from right. The skip table is built for mirrored
+ * pattern, so the tested byte is the first byte of the window.
+ */
+static int
+instr_bytes_backward(const char *str, int beg,
+					 const char *pat, int plen, int nth)
+{
+	int			skip[256];
+	int			i;
+
+	if (beg < 0)
+		return -1;
+
+	if (plen < INSTR_BMH_MIN_PATLEN || beg < INSTR_BMH_MIN_TXTLEN)
+	{
+		unsigned char first = (unsigned char) pat[0];
+
+		for (i = beg; i >= 0; i--)
+		{
+			if ((unsigned char) str[i] == first &&
+				memcmp(str + i + 1, pat + 1, plen - 1) == 0)
+			{
+				if (--nth == 0)
+					return i;
+			}
+		}
+
+		return -1;
+	}
+
+	for (i = 0; i < 256; i++)
+		skip[i] = plen;
+	for (i = plen - 1; i > 0; i--)
+		skip[(unsigned char) pat[i]] = i;
+
+	i = beg;
+	while (i >= 0)
+	{
+		unsigned char c = (unsigned char) str[i];
+
+		if (c == (unsigned char) pat[0] &&
+			memcmp(str + i + 1, pat + 1, plen - 1) == 0)
+		{
+			if (--nth == 0)
+				return i;
+		}
+		i -= skip[c];
+	}
+
+	return -1;
+}
+
+/*
+ * Returns byte offset of nth character (zero based), or -1 when
+ * the string is shorter.
+ */
+static int
+mb_char_offset(const char *str, int len, int n)
+{
+	int			offset = 0;
+
+	while (n-- > 0)
+	{
+		if (offset >= len)
+			return -1;
+		offset += _pg_mblen(str + offset);
+	}
+
+	return offset;
+}
+
+/*
+ * In UTF8 the byte match of valid strings can start only on
+ * character boundary, so we can search bytes and calculate
+ * the position in chars only for the found occurrence.
+ */
+static int
+ora_instr_utf8(text *txt, text *pattern, int start, int nth)
+{
+	const char *str_txt, *str_pat;
+	int			len_txt, len_pat;
+	int			begbyte, pos;
+
+	str_txt = VARDATA_ANY(txt);
+	len_txt = VARSIZE_ANY_EXHDR(txt);
+	str_pat = VARDATA_ANY(pattern);
+	len_pat = VARSIZE_ANY_EXHDR(pattern);
+
+	if (start > 0)
+	{
+		begbyte = mb_char_offset(str_txt, len_txt, start - 1);
+		if (begbyte < 0 || begbyte > len_txt - len_pat)
+			return 0;	/* out of range */
+
+		pos = instr_bytes_forward(str_txt, begbyte, len_txt - len_pat,
+								  str_pat, len_pat, nth);
+		if (pos < 0)
+			return 0;
+
+		return start + pg_mbstrlen_with_len(str_txt + begbyte, pos - begbyte);
+	}
+	else
+	{
+		ora_mb_index idx;
+		int			c_len_pat;
+		int			beg;
+
+		ora_mb_index_init(&idx, str_txt, len_txt);
+		c_len_pat = pg_mbstrlen_with_len(str_pat, len_pat);
+
+		beg = Min(idx.nchars + start, idx.nchars - c_len_pat);
+		if (beg < 0)
+			return 0;	/* out of range */
+
+		begbyte = Min(ora_mb_index_offset(&idx, beg), len_txt - len_pat);
+
+		pos = instr_bytes_backward(str_txt, begbyte, str_pat, len_pat, nth);
+		if (pos < 0)
+			return 0;
+
+		return pg_mbstrlen_with_len(str_txt, pos) + 1;
+	}
+}
 
 static int
 ora_instr_mb(text *txt, text *pattern, int start, int nth)
@@ -239,13 +542,23 @@ ora_instr(text *txt, text *pattern, int start, int nth)
 	int			len_txt, len_pat;
 	const char *str_txt, *str_pat;
 	int			beg, end, i, dx;
+	int			pos;
 
 	if (nth <= 0)
 		PARAMETER_ERROR("Four parameter isn't positive.");
 
-	/* Forward for multibyte strings */
-	if (pg_database_encoding_max_length() > 1)
+	/*
+	 * Forward for multibyte strings. When the text is ASCII only, the chars
+	 * positions are same like bytes positions.
+	 */
+	if (pg_database_encoding_max_length() > 1 &&
+		!ora_is_ascii(VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt)))
+	{
+		if (GetDatabaseEncoding() == PG_UTF8 && VARSIZE_ANY_EXHDR(pattern) > 0)
+			return ora_instr_utf8(txt, pattern, start, nth);
+
 		return ora_instr_mb(txt, pattern, start, nth);
+	}
 
 	str_txt = VARDATA_ANY(txt);
 	len_txt = VARSIZE_ANY_EXHDR(txt);
@@ -269,16 +582,24 @@ ora_instr(text *txt, text *pattern, int start, int nth)
 			return 0;	/* out of range */
 	}
 
-	for (i = beg; i != end; i += dx)
+	/* empty pattern is found on every position */
+	if (len_pat == 0)
 	{
-		if (memcmp(str_txt + i, str_pat, len_pat) == 0)
+		for (i = beg; i != end; i += dx)
 		{
 			if (--nth == 0)
 				return i + 1;
 		}
+
+		return 0;
 	}
 
-	return 0;
+	if (dx > 0)
+		pos = instr_bytes_forward(str_txt, beg, end - 1, str_pat, len_pat, nth);
+	else
+		pos = instr_bytes_backward(str_txt, beg, str_pat, len_pat, nth);
+
+	return pos >= 0 ? pos + 1 : 0;
 }
 
 
@@ -568,21 +889,15 @@ plvstr_rvrs(PG_FUNCTION_ARGS)
 	int new_len;
 	text *result;
 	char *data;
-	char *sizes = NULL;
-	int *positions = NULL;
-	bool mb_encode;
+	ora_mb_index idx;
 
 	if (PG_ARGISNULL(0))
 		PG_RETURN_NULL();
 
 	str = PG_GETARG_TEXT_PP(0);
 
-	mb_encode = pg_database_encoding_max_length() > 1;
-
-	if (!mb_encode)
-		len = VARSIZE_ANY_EXHDR(str);
-	else
-		len = ora_mb_strlen(str, &sizes, &positions);
+	ora_mb_index_init(&idx, VARDATA_ANY(str), VARSIZE_ANY_EXHDR(str));
+	len = idx.nchars;
 
 	start = PG_ARGISNULL(1) ? 1 : PG_GETARG_INT32(1);
 	end = PG_ARGISNULL(2) ? (start < 0 ? -len : len) : PG_GETARG_INT32(2);
@@ -600,42 +915,43 @@ plvstr_rvrs(PG_FUNCTION_ARGS)
 		end = new_start;
 	}
 
-	start = start != 0 ? start : 1;
+	start = start > 0 ? start : 1;
 	end = end < len ? end : len;
 
 	new_len = end - start + 1;
 	new_len = new_len >= 0 ? new_len : 0;
 
-	if (mb_encode)
+	if (!idx.onebyte)
 	{
-		int max_size;
-		int cur_size;
-		char *p;
-		int j;
-		int fz_size;
-
-		fz_size = VARSIZE_ANY_EXHDR(str);
+		const char *p;
+		const char *stop;
 
-		if ((max_size = (new_len*pg_database_encoding_max_length())) > fz_size)
-			result = palloc(fz_size + VARHDRSZ);
+		if (new_len > 0)
+		{
+			p = idx.str + ora_mb_index_offset(&idx, start - 1);
+			stop = idx.str + ora_mb_index_offset(&idx, end);
+		}
 		else
-			result = palloc(max_size + VARHDRSZ);
-		data = (char*) VARDATA(result);
+			p = stop = idx.str;
+
+		result = palloc(stop - p + VARHDRSZ);
+		SET_VARSIZE(result, stop - p + VARHDRSZ);
 
-		cur_size = 0;
-		p = VARDATA_ANY(str);
-		for (i = end - 1; i>= start - 1; i--)
+		/* the chars are stored from the end of the result */
+		data = (char *) VARDATA(result) + (stop - p);
+		while (p < stop)
 		{
-			for (j=0; j<sizes[i]; j++)
-				*data++ = *(p+positions[i]+j);
-			cur_size += sizes[i];
-		}
-		SET_VARSIZE(result, cur_size + VARHDRSZ);
+			int		sz = _pg_mblen(p);
 
+			data -= sz;
+			memcpy(data, p, sz);
+			p += sz;
+		}
 	}
 	else
 	{
-		char *p = VARDATA_ANY(str);
+		const char *p = idx.str;
+
 		result = palloc(new_len + VARHDRSZ);
 		data = (char*) VARDATA(result);
 		SET_VARSIZE(result, new_len + VARHDRSZ);
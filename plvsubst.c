@@ -13,6 +13,7 @@
 */
 
 #include "postgres.h"
+#include <limits.h>
 #include "utils/builtins.h"
 #include "utils/numeric.h"
 #include "string.h"
@@ -67,32 +68,134 @@ set_c_subst(text *sc)
 	MemoryContextSwitchTo(oldctx);
 }
 
+/*
+ * Parsed template and output function of array elements are cached
+ * in fn_extra. The template is split to literal segments, and between
+ * every two segments there is one placeholder.
+ */
+typedef struct
+{
+	text	   *template_str;	/* cache key */
+	text	   *subst;
+	int			nslots;
+	int		   *seg_start;		/* nslots + 1 segments */
+	int		   *seg_len;
+	int			literal_len;
+
+	Oid			elemtype;		/* InvalidOid when not known yet */
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	Oid			typelem;
+	FmgrInfo	proc;
+} PlvsubstCache;
+
+static bool
+text_equal(text *t1, text *t2)
+{
+	return VARSIZE_ANY_EXHDR(t1) == VARSIZE_ANY_EXHDR(t2) &&
+		memcmp(VARDATA_ANY(t1), VARDATA_ANY(t2), VARSIZE_ANY_EXHDR(t1)) == 0;
+}
+
+static void
+compile_template(PlvsubstCache *cache, text *template_in, text *c_subst,
+				 MemoryContext mcxt)
+{
+	MemoryContext oldcxt;
+	const char *template_str = VARDATA_ANY(template_in);
+	int			template_len = VARSIZE_ANY_EXHDR(template_in);
+	const char *subst_str = VARDATA_ANY(c_subst);
+	int			subst_len = VARSIZE_ANY_EXHDR(c_subst);
+	bool		template_ascii = ora_is_ascii(template_str, template_len);
+	int			maxslots;
+	int			seg_start = 0;
+	int			i = 0;
+
+	if (cache->template_str)
+	{
+		pfree(cache->template_str);
+		pfree(cache->subst);
+		pfree(cache->seg_start);
+		pfree(cache->seg_len);
+	}
+
+	oldcxt = MemoryContextSwitchTo(mcxt);
+
+	cache->template_str = (text *) palloc(VARSIZE_ANY(template_in));
+	memcpy(cache->template_str, template_in, VARSIZE_ANY(template_in));
+	cache->subst = (text *) palloc(VARSIZE_ANY(c_subst));
+	memcpy(cache->subst, c_subst, VARSIZE_ANY(c_subst));
+
+	maxslots = subst_len > 0 ? template_len / subst_len : 0;
+	cache->seg_start = palloc((maxslots + 1) * sizeof(int));
+	cache->seg_len = palloc((maxslots + 1) * sizeof(int));
+	cache->nslots = 0;
+
+	MemoryContextSwitchTo(oldcxt);
+
+	/* empty keyword matches everywhere, so parameters are never enough */
+	if (subst_len == 0 && template_len > 0)
+		cache->nslots = INT_MAX;
+
+	/*
+	 * The template is processed by bytes. The substitution string can be
+	 * matched only on char boundary, because we skip whole chars.
+	 */
+	while (subst_len > 0 && i < template_len)
+	{
+		if (template_len - i >= subst_len &&
+			memcmp(&template_str[i], subst_str, subst_len) == 0)
+		{
+			cache->seg_start[cache->nslots] = seg_start;
+			cache->seg_len[cache->nslots] = i - seg_start;
+			cache->nslots += 1;
+
+			i += subst_len;
+			seg_start = i;
+		}
+		else
+			i += template_ascii ? 1 : pg_mblen(&template_str[i]);
+	}
+
+	if (cache->nslots != INT_MAX)
+	{
+		cache->seg_start[cache->nslots] = seg_start;
+		cache->seg_len[cache->nslots] = template_len - seg_start;
+		cache->literal_len = template_len - cache->nslots * subst_len;
+	}
+}
+
 static text*
 plvsubst_string(text *template_in, ArrayType *vals_in, text *c_subst, FunctionCallInfo fcinfo)
 {
+	PlvsubstCache *cache = (PlvsubstCache *) fcinfo->flinfo->fn_extra;
 	ArrayType	   *v = vals_in;
 	int				nitems,
 				   *dims,
 					ndims;
 	char		   *p;
-	int16			typlen;
-	bool			typbyval;
-	char			typalign;
-	char			typdelim;
-	Oid				typelem;
-	Oid				typiofunc;
-	FmgrInfo		proc;
-	int				i = 0, items = 0;
-	StringInfo		sinfo;
 	const char	   *template_str;
-	int				template_len;
-	char		   *sizes;
-	int			   *positions;
-	int				subst_mb_len;
-	int				subst_len;
+	char		  **values;
+	int			   *lengths;
+	int				result_len;
+	text		   *result;
+	char		   *dest;
+	int				i;
 	const bits8	   *bitmap;
 	int				bitmask;
 
+	if (!cache)
+	{
+		cache = MemoryContextAllocZero(fcinfo->flinfo->fn_mcxt,
+									   sizeof(PlvsubstCache));
+		fcinfo->flinfo->fn_extra = cache;
+	}
+
+	if (!cache->template_str ||
+		!text_equal(cache->template_str, template_in) ||
+		!text_equal(cache->subst, c_subst))
+		compile_template(cache, template_in, c_subst, fcinfo->flinfo->fn_mcxt);
+
 	if (v != NULL && (ndims = ARR_NDIM(v)) > 0)
 	{
 		if (ndims != 1)
@@ -105,11 +208,19 @@ plvsubst_string(text *template_in, ArrayType *vals_in, text *c_subst, FunctionCa
 		dims = ARR_DIMS(v);
 		nitems = ArrayGetNItems(ndims, dims);
 		bitmap = ARR_NULLBITMAP(v);
-		get_type_io_data(ARR_ELEMTYPE(v), IOFunc_output,
-							&typlen, &typbyval,
-							&typalign, &typdelim,
-							&typelem, &typiofunc);
-		fmgr_info_cxt(typiofunc, &proc, fcinfo->flinfo->fn_mcxt);
+
+		if (cache->elemtype != ARR_ELEMTYPE(v))
+		{
+			char		typdelim;
+			Oid			typiofunc;
+
+			get_type_io_data(ARR_ELEMTYPE(v), IOFunc_output,
+								&cache->typlen, &cache->typbyval,
+								&cache->typalign, &typdelim,
+								&cache->typelem, &typiofunc);
+			fmgr_info_cxt(typiofunc, &cache->proc, fcinfo->flinfo->fn_mcxt);
+			cache->elemtype = ARR_ELEMTYPE(v);
+		}
 	}
 	else
 	{
@@ -118,60 +229,71 @@ plvsubst_string(text *template_in, ArrayType *vals_in, text *c_subst, FunctionCa
 		bitmap = NULL;
 	}
 
-	template_str = VARDATA(template_in);
-	template_len = ora_mb_strlen(template_in, &sizes, &positions);
-	subst_mb_len = ora_mb_strlen1(c_subst);
-	subst_len = VARSIZE_ANY_EXHDR(c_subst);
-	sinfo = makeStringInfo();
+	if (cache->nslots > nitems)
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("too few parameters specified for template string")));
+
+	/* there are not placeholders, so the template is result */
+	if (cache->nslots == 0)
+		return cstring_to_text_with_len(VARDATA_ANY(template_in),
+										VARSIZE_ANY_EXHDR(template_in));
+
+	values = palloc(cache->nslots * sizeof(char *));
+	lengths = palloc(cache->nslots * sizeof(int));
+	result_len = cache->literal_len;
 
 	bitmask = 1;
-	for (i = 0; i < template_len; i++)
+	for (i = 0; i < cache->nslots; i++)
 	{
-		if (strncmp(&template_str[positions[i]], VARDATA(c_subst), subst_len) == 0)
+		if (bitmap && (*bitmap & bitmask) == 0)
+			values[i] = "NULL";
+		else
 		{
-			Datum    itemvalue;
-			char     *value;
+			Datum	itemvalue = fetch_att(p, cache->typbyval, cache->typlen);
 
-			if (items++ < nitems)
-			{
-				if (bitmap && (*bitmap & bitmask) == 0)
-					value = pstrdup("NULL");
-				else
-				{
-					itemvalue = fetch_att(p, typbyval, typlen);
-					value = DatumGetCString(FunctionCall3(&proc,
+			values[i] = DatumGetCString(FunctionCall3(&cache->proc,
 								itemvalue,
-								ObjectIdGetDatum(typelem),
+								ObjectIdGetDatum(cache->typelem),
 								Int32GetDatum(-1)));
 
-					p = att_addlength_pointer(p, typlen, p);
-					p = (char *) att_align_nominal(p, typalign);
-				}
-				appendStringInfoString(sinfo, value);
-				pfree(value);
-
-				if (bitmap)
-				{
-					bitmask <<= 1;
-					if (bitmask == 0x100)
-					{
-						bitmap++;
-						bitmask = 1;
-					}
-				}
+			p = att_addlength_pointer(p, cache->typlen, p);
+			p = (char *) att_align_nominal(p, cache->typalign);
+		}
+
+		lengths[i] = strlen(values[i]);
+		result_len += lengths[i];
+
+		if (bitmap)
+		{
+			bitmask <<= 1;
+			if (bitmask == 0x100)
+			{
+				bitmap++;
+				bitmask = 1;
 			}
-			else
-				ereport(ERROR,
-						(errcode(ERRCODE_SYNTAX_ERROR),
-						 errmsg("too few parameters specified for template string")));
+		}
+	}
+
+	/* the result is assembled in one allocation */
+	result = (text *) palloc(result_len + VARHDRSZ);
+	SET_VARSIZE(result, result_len + VARHDRSZ);
+	dest = VARDATA(result);
+	template_str = VARDATA_ANY(cache->template_str);
+
+	for (i = 0; i <= cache->nslots; i++)
+	{
+		memcpy(dest, template_str + cache->seg_start[i], cache->seg_len[i]);
+		dest += cache->seg_len[i];
 
-			i += subst_mb_len - 1;
+		if (i < cache->nslots)
+		{
+			memcpy(dest, values[i], lengths[i]);
+			dest += lengths[i];
 		}
-		else
-			appendBinaryStringInfo(sinfo, &template_str[positions[i]], sizes[i]);
 	}
 
-	return cstring_to_text(sinfo->data);
+	return result;
 }
 
 
@@ -1,7 +1,9 @@
 #include "postgres.h"
 #include "funcapi.h"
+#include "miscadmin.h"
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "catalog/pg_type.h"
 #include "lib/stringinfo.h"
 
@@ -13,6 +15,7 @@
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include "utils/lsyscache.h"
+#include "utils/tuplestore.h"
 
 #include "orafce.h"
 #include "builtins.h"
@@ -21,20 +24,49 @@
 extern PGDLLIMPORT ProtocolVersion FrontendProtocol;	/* for mingw */
 #endif
 
-/*
- * TODO: BUFSIZE_UNLIMITED to be truely unlimited (or INT_MAX),
- * and allocate buffers on-demand.
- */
 #define BUFSIZE_DEFAULT		20000
 #define BUFSIZE_MIN			2000
 #define BUFSIZE_MAX			1000000
-#define BUFSIZE_UNLIMITED	BUFSIZE_MAX
+#define BUFSIZE_UNLIMITED	PG_INT64_MAX
+
+/*
+ * Completed lines are stored as zero terminated strings in a list of
+ * chunks, so the queue can grow without reallocation and copying. A line
+ * is never split between chunks.
+ */
+#define CHUNK_SIZE			(64 * 1024)
+
+typedef struct OutputChunk
+{
+	struct OutputChunk *next;
+	Size		size;			/* allocated bytes in data */
+	Size		used;			/* used bytes in data */
+	char		data[FLEXIBLE_ARRAY_MEMBER];
+} OutputChunk;
 
 static bool is_server_output = false;
-static char *buffer = NULL;
-static int   buffer_size = 0;	/* allocated bytes in buffer */
-static int   buffer_len = 0;	/* used bytes in buffer */
-static int   buffer_get = 0;	/* retrieved bytes in buffer */
+static int	flush_lines = 1;	/* send lines in batches of this size */
+
+static bool enabled = false;
+static int64 buffer_size = 0;	/* limit of used bytes */
+static int64 buffer_len = 0;	/* used bytes, every line takes its length + 1 */
+static bool buffer_get = false;	/* some line was retrieved */
+
+static MemoryContext output_cxt = NULL;
+static OutputChunk *first_chunk = NULL;
+static OutputChunk *last_chunk = NULL;
+static int64 stored_lines = 0;	/* completed, not retrieved lines */
+
+static OutputChunk *read_chunk = NULL;
+static Size read_pos = 0;
+
+/* not finished line (put without new_line) */
+static char *partial = NULL;
+static int	partial_len = 0;
+static int	partial_size = 0;
+
+/* there are lines waiting for the next batch of server output */
+#define batch_pending()		(is_server_output && flush_lines > 1 && stored_lines > 0)
 
 static void add_str(const char *str, int len);
 static void add_text(text *str);
@@ -44,26 +76,57 @@ static void send_buffer(void);
 /*
  * Aux. buffer functionality
  */
+static void
+discard_lines(void)
+{
+	if (output_cxt)
+		MemoryContextReset(output_cxt);
+
+	first_chunk = last_chunk = read_chunk = NULL;
+	read_pos = 0;
+	stored_lines = 0;
+	buffer_len = partial_len;
+}
+
+static void
+discard_buffer(void)
+{
+	partial_len = 0;
+	buffer_get = false;
+	discard_lines();
+}
+
 static void
 add_str(const char *str, int len)
 {
 	/* Discard all buffers if get_line was called. */
-	if (buffer_get > 0)
-	{
-		buffer_get = 0;
-		buffer_len = 0;
-	}
+	if (buffer_get)
+		discard_buffer();
 
 	if (buffer_len + len > buffer_size)
 		ereport(ERROR,
 			(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
 			 errmsg("buffer overflow"),
-			 errdetail("Buffer overflow, limit of %d bytes", buffer_size),
+			 errdetail("Buffer overflow, limit of %d bytes", (int) buffer_size),
 			 errhint("Increase buffer size in dbms_output.enable() next time")));
 
-	memcpy(buffer + buffer_len, str, len);
+	if (partial_len + len > partial_size)
+	{
+		int			newsize = Max(partial_size, 1024);
+
+		while (newsize < partial_len + len)
+			newsize *= 2;
+
+		if (partial)
+			partial = repalloc(partial, newsize);
+		else
+			partial = MemoryContextAlloc(TopMemoryContext, newsize);
+		partial_size = newsize;
+	}
+
+	memcpy(partial + partial_len, str, len);
+	partial_len += len;
 	buffer_len += len;
-	buffer[buffer_len] = '\0';
 }
 
 static void
@@ -72,35 +135,90 @@ add_text(text *str)
 	add_str(VARDATA_ANY(str), VARSIZE_ANY_EXHDR(str));
 }
 
+/*
+ * Moves the partial line to the queue of completed lines.
+ */
+static void
+store_partial(void)
+{
+	Size		need = partial_len + 1;
+
+	if (!last_chunk || last_chunk->size - last_chunk->used < need)
+	{
+		OutputChunk *chunk;
+		Size		size = Max(CHUNK_SIZE, need);
+
+		if (!output_cxt)
+			output_cxt = AllocSetContextCreate(TopMemoryContext,
+											   "dbms_output buffer",
+											   ALLOCSET_DEFAULT_MINSIZE,
+											   ALLOCSET_DEFAULT_INITSIZE,
+											   ALLOCSET_DEFAULT_MAXSIZE);
+
+		chunk = MemoryContextAlloc(output_cxt,
+								   offsetof(OutputChunk, data) + size);
+		chunk->next = NULL;
+		chunk->size = size;
+		chunk->used = 0;
+
+		if (last_chunk)
+			last_chunk->next = chunk;
+		else
+			first_chunk = read_chunk = chunk;
+		last_chunk = chunk;
+	}
+
+	memcpy(last_chunk->data + last_chunk->used, partial, partial_len);
+	last_chunk->data[last_chunk->used + partial_len] = '\0';
+	last_chunk->used += need;
+
+	partial_len = 0;
+	stored_lines += 1;
+}
+
 static void
 add_newline(void)
 {
-	add_str("", 1);	/* add \0 */
-	if (is_server_output)
+	add_str("", 1);	/* reserve place for \0 */
+	partial_len -= 1;
+	store_partial();
+
+	if (is_server_output && stored_lines >= flush_lines)
 		send_buffer();
 }
 
-
+/*
+ * Sends all completed lines as one notice message. The lines are
+ * removed from the queue, the partial line is kept.
+ */
 static void
 send_buffer()
 {
-	if (buffer_len > 0)
+	if (stored_lines > 0)
 	{
 		StringInfoData msgbuf;
-		char *cursor = buffer;
+		StringInfoData str;
+		MemoryContext oldcxt;
+		OutputChunk *chunk;
+
+		/* The message can be built in aborted transaction too */
+		oldcxt = MemoryContextSwitchTo(output_cxt);
 
-		while (--buffer_len > 0)
+		initStringInfo(&str);
+		for (chunk = first_chunk; chunk; chunk = chunk->next)
 		{
-			if (*cursor == '\0')
-				*cursor = '\n';
-			cursor++;
-		}
+			Size		pos = 0;
 
-		if (*cursor != '\0')
-			ereport(ERROR,
-				    (errcode(ERRCODE_INTERNAL_ERROR),
-				     errmsg("internal error"),
-				     errdetail("Wrong message format detected")));
+			while (pos < chunk->used)
+			{
+				int			len = strlen(chunk->data + pos);
+
+				if (str.len > 0)
+					appendStringInfoChar(&str, '\n');
+				appendBinaryStringInfo(&str, chunk->data + pos, len);
+				pos += len + 1;
+			}
+		}
 
 		pq_beginmessage(&msgbuf, 'N');
 
@@ -117,7 +235,7 @@ send_buffer()
 #endif
 
 			pq_sendbyte(&msgbuf, PG_DIAG_MESSAGE_PRIMARY);
-			pq_sendstring(&msgbuf, buffer);
+			pq_sendstring(&msgbuf, str.data);
 			pq_sendbyte(&msgbuf, '\0');
 
 #ifndef _MSC_VER
@@ -125,15 +243,39 @@ send_buffer()
 		}
 		else
 		{
-			*cursor++ = '\n';
-			*cursor = '\0';
-			pq_sendstring(&msgbuf, buffer);
+			appendStringInfoChar(&str, '\n');
+			pq_sendstring(&msgbuf, str.data);
 		}
 
 #endif
 
 		pq_endmessage(&msgbuf);
 		pq_flush();
+
+		MemoryContextSwitchTo(oldcxt);
+
+		discard_lines();
+	}
+}
+
+/*
+ * Lines waiting for the next batch are sent at the end of transaction,
+ * so the client gets them when the statement finishes.
+ */
+static void
+output_xact_callback(XactEvent event, void *arg)
+{
+	switch (event)
+	{
+		case XACT_EVENT_COMMIT:
+		case XACT_EVENT_ABORT:
+		case XACT_EVENT_PREPARE:
+			if (batch_pending())
+				send_buffer();
+			break;
+
+		default:
+			break;
 	}
 }
 
@@ -144,20 +286,17 @@ send_buffer()
  */
 
 static void
-dbms_output_enable_internal(int32 n_buf_size)
+dbms_output_enable_internal(int64 n_buf_size)
 {
-	/* We allocate +2 bytes for an end-of-line and a string terminator. */
-	if (buffer == NULL)
+	if (!enabled)
 	{
-		buffer = MemoryContextAlloc(TopMemoryContext, n_buf_size + 2);
+		enabled = true;
 		buffer_size = n_buf_size;
-		buffer_len = 0;
-		buffer_get = 0;
+		discard_buffer();
 	}
 	else if (n_buf_size > buffer_len)
 	{
 		/* We cannot shrink buffer less than current length. */
-		buffer = repalloc(buffer, n_buf_size + 2);
 		buffer_size = n_buf_size;
 	}
 }
@@ -177,7 +316,7 @@ PG_FUNCTION_INFO_V1(dbms_output_enable);
 Datum
 dbms_output_enable(PG_FUNCTION_ARGS)
 {
-	int32 n_buf_size;
+	int64 n_buf_size;
 
 	if (PG_ARGISNULL(0))
 		n_buf_size = BUFSIZE_UNLIMITED;
@@ -206,24 +345,73 @@ PG_FUNCTION_INFO_V1(dbms_output_disable);
 Datum
 dbms_output_disable(PG_FUNCTION_ARGS)
 {
-	if (buffer)
-		pfree(buffer);
+	/* lines waiting for the next batch was already accepted */
+	if (batch_pending())
+		send_buffer();
+
+	discard_buffer();
+
+	if (partial)
+		pfree(partial);
 
-	buffer = NULL;
+	partial = NULL;
+	partial_size = 0;
+
+	enabled = false;
 	buffer_size = 0;
 	buffer_len = 0;
-	buffer_get = 0;
 	PG_RETURN_VOID();
 }
 
+static void
+set_server_output(bool value, int nlines)
+{
+	static bool callbacks_registered = false;
+
+	if (!callbacks_registered)
+	{
+		RegisterXactCallback(output_xact_callback, NULL);
+		callbacks_registered = true;
+	}
+
+	if (batch_pending())
+		send_buffer();
+
+	is_server_output = value;
+	flush_lines = nlines;
+
+	if (is_server_output && !enabled)
+		dbms_output_enable_internal(BUFSIZE_DEFAULT);
+}
+
 PG_FUNCTION_INFO_V1(dbms_output_serveroutput);
 
 Datum
 dbms_output_serveroutput(PG_FUNCTION_ARGS)
 {
-	is_server_output = PG_GETARG_BOOL(0);
-	if (is_server_output && !buffer)
-		dbms_output_enable_internal(BUFSIZE_DEFAULT);
+	set_server_output(PG_GETARG_BOOL(0), 1);
+	PG_RETURN_VOID();
+}
+
+/*
+ * serveroutput(bool, flush_lines)
+ *
+ * Lines are sent to client in one message when flush_lines lines are
+ * collected or at the end of transaction.
+ */
+PG_FUNCTION_INFO_V1(dbms_output_serveroutput_batch);
+
+Datum
+dbms_output_serveroutput_batch(PG_FUNCTION_ARGS)
+{
+	int32		nlines = PG_GETARG_INT32(1);
+
+	if (nlines < 1)
+		ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("flush_lines must be greater than zero")));
+
+	set_server_output(PG_GETARG_BOOL(0), nlines);
 	PG_RETURN_VOID();
 }
 
@@ -237,7 +425,7 @@ PG_FUNCTION_INFO_V1(dbms_output_put);
 Datum
 dbms_output_put(PG_FUNCTION_ARGS)
 {
-	if (buffer)
+	if (enabled)
 		add_text(PG_GETARG_TEXT_PP(0));
 	PG_RETURN_VOID();
 }
@@ -247,7 +435,7 @@ PG_FUNCTION_INFO_V1(dbms_output_put_line);
 Datum
 dbms_output_put_line(PG_FUNCTION_ARGS)
 {
-	if (buffer)
+	if (enabled)
 	{
 		add_text(PG_GETARG_TEXT_PP(0));
 		add_newline();
@@ -260,22 +448,46 @@ PG_FUNCTION_INFO_V1(dbms_output_new_line);
 Datum
 dbms_output_new_line(PG_FUNCTION_ARGS)
 {
-	if (buffer)
+	if (enabled)
 		add_newline();
 	PG_RETURN_VOID();
 }
 
+/*
+ * Returns next line from the queue. The not finished line is returned
+ * as last one.
+ */
 static text *
 dbms_output_next(void)
 {
-	if (buffer_get < buffer_len)
+	text	   *line;
+
+	/* Lines waiting for the next batch are not available for reading */
+	if (batch_pending())
+		send_buffer();
+
+	while (read_chunk && read_pos >= read_chunk->used)
+	{
+		read_chunk = read_chunk->next;
+		read_pos = 0;
+	}
+
+	if (read_chunk)
 	{
-		text *line = cstring_to_text(buffer + buffer_get);
-		buffer_get += VARSIZE_ANY_EXHDR(line) + 1;
-		return line;
+		line = cstring_to_text(read_chunk->data + read_pos);
+		read_pos += VARSIZE_ANY_EXHDR(line) + 1;
+		stored_lines -= 1;
+	}
+	else if (partial_len > 0)
+	{
+		line = cstring_to_text_with_len(partial, partial_len);
+		partial_len = 0;
 	}
 	else
 		return NULL;
+
+	buffer_get = true;
+	return line;
 }
 
 PG_FUNCTION_INFO_V1(dbms_output_get_line);
@@ -326,35 +538,39 @@ dbms_output_get_lines(PG_FUNCTION_ARGS)
 
 	int32		max_lines = PG_GETARG_INT32(0);
 	int32		n;
-	ArrayBuildState *astate = NULL;
+	Datum	   *lines = NULL;
+	int16		typlen;
+	bool		typbyval;
+	char		typalign;
+	ArrayType  *arr;
 
 	/* Build a tuple descriptor for our result type */
 	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
 		elog(ERROR, "return type must be a row type");
 
-	for (n = 0; n < max_lines && (line = dbms_output_next()) != NULL; n++)
+	if (batch_pending())
+		send_buffer();
+
+	if (max_lines > 0)
 	{
-		astate = accumArrayResult(astate, PointerGetDatum(line), false,
-					TEXTOID, CurrentMemoryContext);
+		int64		available = stored_lines + (partial_len > 0 ? 1 : 0);
+
+		lines = palloc(Max(Min(max_lines, available), 1) * sizeof(Datum));
 	}
 
+	for (n = 0; n < max_lines && (line = dbms_output_next()) != NULL; n++)
+		lines[n] = PointerGetDatum(line);
+
 	/* 0: lines as text array */
+	get_typlenbyvalalign(TEXTOID, &typlen, &typbyval, &typalign);
 	if (n > 0)
-		values[0] = makeArrayResult(astate, CurrentMemoryContext);
+		arr = construct_array(lines, n, TEXTOID, typlen, typbyval, typalign);
 	else
-	{
-		int16		typlen;
-		bool		typbyval;
-		char		typalign;
-		ArrayType  *arr;
-
-		get_typlenbyvalalign(TEXTOID, &typlen, &typbyval, &typalign);
 		arr = construct_md_array(
 			NULL,
 			NULL,
 			0, NULL, NULL, TEXTOID, typlen, typbyval, typalign);
-		values[0] = PointerGetDatum(arr);
-	}
+	values[0] = PointerGetDatum(arr);
 
 	/* 1: # of lines as integer */
 	values[1] = Int32GetDatum(n);
@@ -364,3 +580,77 @@ dbms_output_get_lines(PG_FUNCTION_ARGS)
 
 	PG_RETURN_DATUM(result);
 }
+
+/*
+ * get_lines() returns setof text
+ *
+ * Returns all lines from the queue as set. There are not limits
+ * given by size of array.
+ */
+PG_FUNCTION_INFO_V1(dbms_output_get_lines_set);
+
+Datum
+dbms_output_get_lines_set(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+	MemoryContext linecxt;
+	text	   *line;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+#if PG_VERSION_NUM >= 120000
+
+	tupdesc = CreateTemplateTupleDesc(1);
+
+#else
+
+	tupdesc = CreateTemplateTupleDesc(1, false);
+
+#endif
+
+	TupleDescInitEntry(tupdesc, (AttrNumber) 1, "line", TEXTOID, -1, 0);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	linecxt = AllocSetContextCreate(CurrentMemoryContext,
+									"dbms_output get_lines",
+									ALLOCSET_DEFAULT_MINSIZE,
+									ALLOCSET_DEFAULT_INITSIZE,
+									ALLOCSET_DEFAULT_MAXSIZE);
+
+	oldcontext = MemoryContextSwitchTo(linecxt);
+
+	while ((line = dbms_output_next()) != NULL)
+	{
+		Datum		value = PointerGetDatum(line);
+		bool		isnull = false;
+
+		tuplestore_putvalues(tupstore, tupdesc, &value, &isnull);
+		MemoryContextReset(linecxt);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextDelete(linecxt);
+
+	return (Datum) 0;
+}
@@ -2,13 +2,19 @@
  * Note - I don't find any documentation about pseudo random
  * number generator used in Oracle. So the results of these
  * functions should be different then native Oracle functions!
- * This library is based on ANSI C implementation.
+ * The generator is xoshiro256** with per-session state, seeded
+ * by splitmix64.
  */
 
 #include "postgres.h"
+#include "funcapi.h"
+#include "miscadmin.h"
 #include "access/hash.h"
+#include "catalog/pg_type.h"
 #include "lib/stringinfo.h"
 #include "utils/builtins.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
 
 #include "stdlib.h"
 #include "time.h"
@@ -27,6 +33,8 @@ PG_FUNCTION_INFO_V1(dbms_random_string);
 PG_FUNCTION_INFO_V1(dbms_random_terminate);
 PG_FUNCTION_INFO_V1(dbms_random_value);
 PG_FUNCTION_INFO_V1(dbms_random_value_range);
+PG_FUNCTION_INFO_V1(dbms_random_values);
+PG_FUNCTION_INFO_V1(dbms_random_strings);
 
 /* Coefficients in rational approximations. */
 static const double a[] =
@@ -71,6 +79,70 @@ static const double d[] =
 
 static double ltqnorm(double p);
 
+static uint64 prng_state[4];
+static bool prng_seeded = false;
+
+static inline uint64
+rotl(const uint64 x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+static uint64
+splitmix64(uint64 *x)
+{
+	uint64		z = (*x += UINT64CONST(0x9E3779B97F4A7C15));
+
+	z = (z ^ (z >> 30)) * UINT64CONST(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27)) * UINT64CONST(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+static void
+prng_seed(uint64 seed)
+{
+	int			i;
+
+	for (i = 0; i < 4; i++)
+		prng_state[i] = splitmix64(&seed);
+
+	prng_seeded = true;
+}
+
+/*
+ * xoshiro256** by David Blackman and Sebastiano Vigna
+ */
+static uint64
+prng_next(void)
+{
+	uint64		result;
+	uint64		t;
+
+	/* Without explicit seed every session has different sequence */
+	if (!prng_seeded)
+		prng_seed((uint64) GetCurrentTimestamp() ^ ((uint64) MyProcPid << 32));
+
+	result = rotl(prng_state[1] * 5, 7) * 9;
+	t = prng_state[1] << 17;
+
+	prng_state[2] ^= prng_state[0];
+	prng_state[3] ^= prng_state[1];
+	prng_state[1] ^= prng_state[2];
+	prng_state[0] ^= prng_state[3];
+
+	prng_state[2] ^= t;
+	prng_state[3] = rotl(prng_state[3], 45);
+
+	return result;
+}
+
+/* returns value from [0.0 - 1.0) */
+static inline double
+prng_double(void)
+{
+	return (double) (prng_next() >> 11) * (1.0 / (double) (UINT64CONST(1) << 53));
+}
+
 
 /*
  * dbms_random.initialize (seed IN BINARY_INTEGER)
@@ -82,7 +154,7 @@ dbms_random_initialize(PG_FUNCTION_ARGS)
 {
 	int seed = PG_GETARG_INT32(0);
 
-	srand(seed);
+	prng_seed((uint64) (int64) seed);
 	
 	PG_RETURN_VOID();
 }
@@ -98,7 +170,8 @@ dbms_random_normal(PG_FUNCTION_ARGS)
 	float8 result;
 	
 	/* need random value from (0..1) */
-	result = ltqnorm(((double) rand() + 1) / ((double) RAND_MAX + 2));
+	result = ltqnorm(((double) (prng_next() >> 11) + 0.5) *
+					 (1.0 / (double) (UINT64CONST(1) << 53)));
 
 	PG_RETURN_FLOAT8(result);
 }
@@ -112,11 +185,9 @@ Datum
 dbms_random_random(PG_FUNCTION_ARGS)
 {
 	int result;
-	/*
-	 * Oracle generator generates numebers from -2^31 and +2^31,
-	 * ANSI C only from 0 .. RAND_MAX,
-	 */
-	result = 2 * (rand() - RAND_MAX / 2);
+
+	/* Oracle generator generates numebers from -2^31 and +2^31 */
+	result = (int32) (prng_next() >> 32);
 
 	PG_RETURN_INT32(result);
 }
@@ -132,7 +203,7 @@ dbms_random_seed_int(PG_FUNCTION_ARGS)
 {
 	int seed = PG_GETARG_INT32(0);
 	
-	srand(seed);
+	prng_seed((uint64) (int64) seed);
 
 	PG_RETURN_VOID();
 }
@@ -151,7 +222,7 @@ dbms_random_seed_varchar(PG_FUNCTION_ARGS)
 	
 	seed = hash_any((unsigned char *) VARDATA_ANY(key), VARSIZE_ANY_EXHDR(key));
 	
-	srand((int) seed);
+	prng_seed((uint64) (int64) (int) seed);
 					
 	PG_RETURN_VOID();
 }
@@ -167,71 +238,68 @@ dbms_random_seed_varchar(PG_FUNCTION_ARGS)
  * 'u','U'  upper case alpha characters only
  * 'x','X'  any alpha-numeric characters (upper)
  */
+static const char *alpha_mixed = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char *lower_only = "abcdefghijklmnopqrstuvwxyz";
+static const char *upper_only = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char *upper_alphanum = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+static const char *printable = "`1234567890-=qwertyuiop[]asdfghjkl;'zxcvbnm,./!@#$%^&*()_+QWERTYUIOP{}|ASDFGHJKL:\"ZXCVVBNM<>? ";
+
+/*
+ * Every 64bit random value is used for two chars.
+ */
 static text *
 random_string(const char *charset, size_t chrset_size, int len)
 {
-	StringInfo	str;
-	int	i;
-	
-	str = makeStringInfo();
-	for (i = 0; i < len; i++)
+	text	   *result;
+	char	   *ptr;
+	int			i;
+
+	if (len < 0)
+		len = 0;
+
+	result = (text *) palloc(len + VARHDRSZ);
+	SET_VARSIZE(result, len + VARHDRSZ);
+	ptr = VARDATA(result);
+
+	for (i = 0; i < len; i += 2)
 	{
-		int pos = (int) ((double) rand() / ((double) RAND_MAX + 1) * chrset_size);
-		
-		appendStringInfoChar(str, charset[pos]);
+		uint64		r = prng_next();
+
+		ptr[i] = charset[((r >> 32) * chrset_size) >> 32];
+		if (i + 1 < len)
+			ptr[i + 1] = charset[((r & 0xFFFFFFFF) * chrset_size) >> 32];
 	}
-	
-	return cstring_to_text(str->data);
+
+	return result;
 }
 
-Datum
-dbms_random_string(PG_FUNCTION_ARGS)
+static const char *
+get_charset(text *opt, size_t *chrset_size)
 {
-	char *option;
-	int	len;
+	char	   *option = text_to_cstring(opt);
 	const char *charset;
-	size_t chrset_size;
-
-	const char *alpha_mixed = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
-	const char *lower_only = "abcdefghijklmnopqrstuvwxyz";
-	const char *upper_only = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-	const char *upper_alphanum = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-	const char *printable = "`1234567890-=qwertyuiop[]asdfghjkl;'zxcvbnm,./!@#$%^&*()_+QWERTYUIOP{}|ASDFGHJKL:\"ZXCVVBNM<>? ";
-
-	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
-		ereport(ERROR,
-				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
-				 errmsg("an argument is NULL")));
 
-	option = text_to_cstring(PG_GETARG_TEXT_P(0));
-	len = PG_GETARG_INT32(1);
-	
 	switch (option[0])
 	{
 		case 'a':
 		case 'A':
 			charset = alpha_mixed;
-			chrset_size = strlen(alpha_mixed);
 			break;
 		case 'l':
 		case 'L':
 			charset = lower_only;
-			chrset_size = strlen(lower_only);
 			break;
 		case 'u':
 		case 'U':
 			charset = upper_only;
-			chrset_size = strlen(upper_only);
 			break;
 		case 'x':
 		case 'X':
 			charset = upper_alphanum;
-			chrset_size = strlen(upper_alphanum);
 			break;
 		case 'p':
 		case 'P':
 			charset = printable;
-			chrset_size = strlen(printable);
 			break;
 			
 		default:
@@ -241,10 +309,29 @@ dbms_random_string(PG_FUNCTION_ARGS)
 				 errhint("available option \"aAlLuUxXpP\"")));
 			/* be compiler a quiete */
 			charset = NULL;
-			chrset_size = 0;
 	}
-	
-	PG_RETURN_TEXT_P(random_string(charset, chrset_size, len));
+
+	pfree(option);
+
+	*chrset_size = strlen(charset);
+
+	return charset;
+}
+
+Datum
+dbms_random_string(PG_FUNCTION_ARGS)
+{
+	const char *charset;
+	size_t chrset_size;
+
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("an argument is NULL")));
+
+	charset = get_charset(PG_GETARG_TEXT_PP(0), &chrset_size);
+
+	PG_RETURN_TEXT_P(random_string(charset, chrset_size, PG_GETARG_INT32(1)));
 }
 
 /*
@@ -270,7 +357,7 @@ dbms_random_value(PG_FUNCTION_ARGS)
 	float8 result;
 	
 	/* result [0.0 - 1.0) */
-	result = (double) rand() / ((double) RAND_MAX + 1);
+	result = prng_double();
 	
 	PG_RETURN_FLOAT8(result);
 }
@@ -291,11 +378,122 @@ dbms_random_value_range(PG_FUNCTION_ARGS)
 	if (low > high)
 		PG_RETURN_NULL();
 
-	result = ((double) rand() / ((double) RAND_MAX + 1)) * ( high -  low) + low;
+	result = prng_double() * ( high -  low) + low;
 
 	PG_RETURN_FLOAT8(result);
 }
 
+static Tuplestorestate *
+init_materialize_srf(FunctionCallInfo fcinfo, Oid typid, TupleDesc *tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	MemoryContext oldcontext;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+#if PG_VERSION_NUM >= 120000
+
+	*tupdesc = CreateTemplateTupleDesc(1);
+
+#else
+
+	*tupdesc = CreateTemplateTupleDesc(1, false);
+
+#endif
+
+	TupleDescInitEntry(*tupdesc, (AttrNumber) 1, "value", typid, -1, 0);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+
+	return tupstore;
+}
+
+/*
+ * dbms_random.values(n int, low double precision, high double precision)
+ *   RETURNS SETOF double precision
+ *
+ *     Returns n random numbers from [low - high)
+ */
+Datum
+dbms_random_values(PG_FUNCTION_ARGS)
+{
+	int32		n = PG_GETARG_INT32(0);
+	float8		low = PG_GETARG_FLOAT8(1);
+	float8		high = PG_GETARG_FLOAT8(2);
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	int32		i;
+
+	tupstore = init_materialize_srf(fcinfo, FLOAT8OID, &tupdesc);
+
+	for (i = 0; i < n; i++)
+	{
+		Datum		value;
+		bool		isnull = low > high;
+
+		CHECK_FOR_INTERRUPTS();
+
+		value = isnull ? (Datum) 0 :
+			Float8GetDatum(prng_double() * (high - low) + low);
+
+		tuplestore_putvalues(tupstore, tupdesc, &value, &isnull);
+	}
+
+	return (Datum) 0;
+}
+
+/*
+ * dbms_random.strings(n int, opt text, len int) RETURNS SETOF text
+ *
+ *     Returns n random strings
+ */
+Datum
+dbms_random_strings(PG_FUNCTION_ARGS)
+{
+	int32		n = PG_GETARG_INT32(0);
+	int32		len = PG_GETARG_INT32(2);
+	const char *charset;
+	size_t		chrset_size;
+	Tuplestorestate *tupstore;
+	TupleDesc	tupdesc;
+	int32		i;
+
+	charset = get_charset(PG_GETARG_TEXT_PP(1), &chrset_size);
+	tupstore = init_materialize_srf(fcinfo, TEXTOID, &tupdesc);
+
+	for (i = 0; i < n; i++)
+	{
+		text	   *str;
+		Datum		value;
+		bool		isnull = false;
+
+		CHECK_FOR_INTERRUPTS();
+
+		str = random_string(charset, chrset_size, len);
+		value = PointerGetDatum(str);
+		tuplestore_putvalues(tupstore, tupdesc, &value, &isnull);
+		pfree(str);
+	}
+
+	return (Datum) 0;
+}
+
 
 /*
  * Lower tail quantile for standard normal distribution function.
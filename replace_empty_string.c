@@ -7,6 +7,7 @@
 #include "miscadmin.h"
 #include "parser/parse_coerce.h"
 #include "utils/builtins.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/rel.h"
 
@@ -16,6 +17,12 @@
 PG_FUNCTION_INFO_V1(orafce_replace_empty_strings);
 PG_FUNCTION_INFO_V1(orafce_replace_null_strings);
 
+#ifndef TupleDescAttr
+
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+
+#endif
+
 #if PG_VERSION_NUM < 100000
 
 static HeapTuple
@@ -133,86 +140,169 @@ should_raise_warnings(FunctionCallInfo fcinfo)
 }
 
 /*
- * Detects emty strings in type text based fields and replaces them by NULL.
+ * The list of string columns is computed once per relation and trigger
+ * call site. Any relcache invalidation forces rebuild of the list.
  */
-Datum
-orafce_replace_empty_strings(PG_FUNCTION_ARGS)
+typedef struct
+{
+	Oid			relid;
+	uint64		inval_count;	/* invalidation counter when list was built */
+	int			natts;
+	int			nstrcols;
+	int		   *strcols;		/* attnums of varlena string columns */
+	char	   *relname;
+	int		   *resetcols;
+	Datum	   *values;
+	bool	   *nulls;
+} StringColumnsCache;
+
+static uint64 relcache_inval_count = 0;
+
+static void
+string_columns_relcache_callback(Datum arg, Oid relid)
+{
+	relcache_inval_count += 1;
+}
+
+static StringColumnsCache *
+get_string_columns(FunctionCallInfo fcinfo)
 {
+	static bool callback_registered = false;
+
 	TriggerData	   *trigdata = (TriggerData *) fcinfo->context;
-	HeapTuple		rettuple = NULL;
-	TupleDesc		tupdesc;
-	int			   *resetcols = NULL;
-	Datum		   *values = NULL;
-	bool		   *nulls = NULL;
+	Relation		rel = trigdata->tg_relation;
+	TupleDesc		tupdesc = rel->rd_att;
+	StringColumnsCache *cache = (StringColumnsCache *) fcinfo->flinfo->fn_extra;
+	MemoryContext	oldcxt;
 	Oid				prev_typid = InvalidOid;
 	bool			is_string = false;
-	int				nresetcols = 0;
 	int				attnum;
-	bool			raise_warning = false;
-	char		   *relname = NULL;
 
-	trigger_sanity_check(fcinfo, "replace_empty_strings");
-	raise_warning = should_raise_warnings(fcinfo);
+	if (!callback_registered)
+	{
+		CacheRegisterRelcacheCallback(string_columns_relcache_callback, (Datum) 0);
+		callback_registered = true;
+	}
 
-	rettuple = get_rettuple(fcinfo);
-	tupdesc = trigdata->tg_relation->rd_att;
+	if (cache &&
+		cache->relid == RelationGetRelid(rel) &&
+		cache->inval_count == relcache_inval_count &&
+		cache->natts == tupdesc->natts)
+		return cache;
+
+	if (cache)
+	{
+		pfree(cache->strcols);
+		pfree(cache->relname);
+		pfree(cache->resetcols);
+		pfree(cache->values);
+		pfree(cache->nulls);
+	}
+	else
+		cache = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt,
+								   sizeof(StringColumnsCache));
+
+	oldcxt = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
+
+	cache->relid = RelationGetRelid(rel);
+	cache->inval_count = relcache_inval_count;
+	cache->natts = tupdesc->natts;
+	cache->nstrcols = 0;
+	cache->strcols = palloc(Max(tupdesc->natts, 1) * sizeof(int));
+	cache->relname = SPI_getrelname(rel);
+	cache->resetcols = palloc(Max(tupdesc->natts, 1) * sizeof(int));
+	cache->values = palloc(Max(tupdesc->natts, 1) * sizeof(Datum));
+	cache->nulls = palloc(Max(tupdesc->natts, 1) * sizeof(bool));
 
 	/* iterate over record's fields */
 	for (attnum = 1; attnum <= tupdesc->natts; attnum++)
 	{
-		Oid typid;
+		Form_pg_attribute attr = TupleDescAttr(tupdesc, attnum - 1);
+
+		/* only varlena values can be replaced by text value */
+		if (attr->attisdropped || attr->attlen != -1)
+			continue;
 
 		/* simple cache - lot of time columns with same type is side by side */
-		typid = SPI_gettypeid(tupdesc, attnum);
-		if (typid != prev_typid)
+		if (attr->atttypid != prev_typid)
 		{
 			TYPCATEGORY category;
 			bool		ispreferred;
 			Oid base_typid;
 
-			base_typid = getBaseType(typid);
+			base_typid = getBaseType(attr->atttypid);
 			get_type_category_preferred(base_typid, &category, &ispreferred);
 
 			is_string = (category == TYPCATEGORY_STRING);
-			prev_typid = typid;
+			prev_typid = attr->atttypid;
 		}
 
 		if (is_string)
+			cache->strcols[cache->nstrcols++] = attnum;
+	}
+
+	MemoryContextSwitchTo(oldcxt);
+
+	fcinfo->flinfo->fn_extra = cache;
+
+	return cache;
+}
+
+/*
+ * Returns true when the value is empty string. Empty strings are never
+ * compressed or toasted, so these values need not be detoasted.
+ */
+static bool
+is_empty_string(Datum value)
+{
+	struct varlena *ptr = (struct varlena *) DatumGetPointer(value);
+
+	if (VARATT_IS_EXTERNAL(ptr) || VARATT_IS_COMPRESSED(ptr))
+		return false;
+
+	return VARSIZE_ANY_EXHDR(ptr) == 0;
+}
+
+/*
+ * Detects emty strings in type text based fields and replaces them by NULL.
+ */
+Datum
+orafce_replace_empty_strings(PG_FUNCTION_ARGS)
+{
+	TriggerData	   *trigdata = (TriggerData *) fcinfo->context;
+	HeapTuple		rettuple = NULL;
+	TupleDesc		tupdesc;
+	StringColumnsCache *cache;
+	int				nresetcols = 0;
+	int				i;
+	bool			raise_warning = false;
+
+	trigger_sanity_check(fcinfo, "replace_empty_strings");
+	raise_warning = should_raise_warnings(fcinfo);
+
+	rettuple = get_rettuple(fcinfo);
+	tupdesc = trigdata->tg_relation->rd_att;
+	cache = get_string_columns(fcinfo);
+
+	/* iterate over string fields */
+	for (i = 0; i < cache->nstrcols; i++)
+	{
+		int			attnum = cache->strcols[i];
+		Datum		value;
+		bool		isnull;
+
+		value = heap_getattr(rettuple, attnum, tupdesc, &isnull);
+		if (!isnull && is_empty_string(value))
 		{
-			Datum		value;
-			bool		isnull;
-
-			value = SPI_getbinval(rettuple, tupdesc, attnum, &isnull);
-			if (!isnull)
-			{
-				text *txt = DatumGetTextP(value);
-
-				/* is it empty string (has zero length */
-				if (VARSIZE_ANY_EXHDR(txt) == 0)
-				{
-					if (!resetcols)
-					{
-						/* lazy allocation of dynamic memory */
-						resetcols = palloc0(tupdesc->natts * sizeof(int));
-						nulls = palloc0(tupdesc->natts * sizeof(bool));
-						values = palloc0(tupdesc->natts * sizeof(Datum));
-					}
-
-					resetcols[nresetcols] = attnum;
-					values[nresetcols] = (Datum) 0;
-					nulls[nresetcols++] = true;
-
-					if (raise_warning)
-					{
-						if (!relname)
-							relname = SPI_getrelname(trigdata->tg_relation);
-
-						elog(WARNING,
+			cache->resetcols[nresetcols] = attnum;
+			cache->values[nresetcols] = (Datum) 0;
+			cache->nulls[nresetcols++] = true;
+
+			if (raise_warning)
+				elog(WARNING,
 				"Field \"%s\" of table \"%s\" is empty string (replaced by NULL).",
-								SPI_fname(tupdesc, attnum), relname);
-					}
-				}
-			}
+					 NameStr(TupleDescAttr(tupdesc, attnum - 1)->attname),
+					 cache->relname);
 		}
 	}
 
@@ -220,19 +310,10 @@ orafce_replace_empty_strings(PG_FUNCTION_ARGS)
 	{
 		/* construct new tuple */
 		rettuple = heap_modify_tuple_by_cols(rettuple, tupdesc,
-											 nresetcols, resetcols,
-											 values, nulls);
+											 nresetcols, cache->resetcols,
+											 cache->values, cache->nulls);
 	}
 
-	if (relname)
-		pfree(relname);
-	if (resetcols)
-		pfree(resetcols);
-	if (values)
-		pfree(values);
-	if (nulls)
-		pfree(nulls);
-
 	return PointerGetDatum(rettuple);
 }
 
@@ -245,15 +326,11 @@ orafce_replace_null_strings(PG_FUNCTION_ARGS)
 	TriggerData	   *trigdata = (TriggerData *) fcinfo->context;
 	HeapTuple		rettuple = NULL;
 	TupleDesc		tupdesc;
-	int			   *resetcols = NULL;
-	Datum		   *values = NULL;
-	bool		   *nulls = NULL;
-	Oid				prev_typid = InvalidOid;
-	bool			is_string = false;
+	StringColumnsCache *cache;
+	Datum			empty_string = (Datum) 0;
 	int				nresetcols = 0;
-	int				attnum;
+	int				i;
 	bool			raise_warning = false;
-	char		   *relname = NULL;
 
 	trigger_sanity_check(fcinfo, "replace_null_strings");
 	raise_warning = should_raise_warnings(fcinfo);
@@ -265,56 +342,34 @@ orafce_replace_null_strings(PG_FUNCTION_ARGS)
 		return PointerGetDatum(rettuple);
 
 	tupdesc = trigdata->tg_relation->rd_att;
+	cache = get_string_columns(fcinfo);
 
-	/* iterate over record's fields */
-	for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+	/* iterate over string fields */
+	for (i = 0; i < cache->nstrcols; i++)
 	{
-		Oid typid;
+		int			attnum = cache->strcols[i];
+		bool		isnull;
 
-		/* simple cache - lot of time columns with same type is side by side */
-		typid = SPI_gettypeid(tupdesc, attnum);
-		if (typid != prev_typid)
-		{
-			TYPCATEGORY category;
-			bool		ispreferred;
-			Oid base_typid;
+		/* the NULL bitmap is checked directly, the tuple is not deformed */
+		if (attnum <= (int) HeapTupleHeaderGetNatts(rettuple->t_data))
+			isnull = att_isnull(attnum - 1, rettuple->t_data->t_bits);
+		else
+			(void) heap_getattr(rettuple, attnum, tupdesc, &isnull);
 
-			base_typid = getBaseType(typid);
-			get_type_category_preferred(base_typid, &category, &ispreferred);
+		if (isnull)
+		{
+			if (!empty_string)
+				empty_string = PointerGetDatum(cstring_to_text_with_len("", 0));
 
-			is_string = (category == TYPCATEGORY_STRING);
-			prev_typid = typid;
-		}
+			cache->resetcols[nresetcols] = attnum;
+			cache->values[nresetcols] = empty_string;
+			cache->nulls[nresetcols++] = false;
 
-		if (is_string)
-		{
-			bool		isnull;
-
-			(void) SPI_getbinval(rettuple, tupdesc, attnum, &isnull);
-			if (isnull)
-			{
-				if (!resetcols)
-				{
-					/* lazy allocation of dynamic memory */
-					resetcols = palloc0(tupdesc->natts * sizeof(int));
-					nulls = palloc0(tupdesc->natts * sizeof(bool));
-					values = palloc0(tupdesc->natts * sizeof(Datum));
-				}
-
-				resetcols[nresetcols] = attnum;
-				values[nresetcols] = PointerGetDatum(cstring_to_text_with_len("", 0));
-				nulls[nresetcols++] = false;
-
-				if (raise_warning)
-				{
-					if (!relname)
-						relname = SPI_getrelname(trigdata->tg_relation);
-
-					elog(WARNING,
+			if (raise_warning)
+				elog(WARNING,
 				"Field \"%s\" of table \"%s\" is NULL (replaced by '').",
-								SPI_fname(tupdesc, attnum), relname);
-				}
-			}
+					 NameStr(TupleDescAttr(tupdesc, attnum - 1)->attname),
+					 cache->relname);
 		}
 	}
 
@@ -322,18 +377,9 @@ orafce_replace_null_strings(PG_FUNCTION_ARGS)
 	{
 		/* construct new tuple */
 		rettuple = heap_modify_tuple_by_cols(rettuple, tupdesc,
-											 nresetcols, resetcols,
-											 values, nulls);
+											 nresetcols, cache->resetcols,
+											 cache->values, cache->nulls);
 	}
 
-	if (relname)
-		pfree(relname);
-	if (resetcols)
-		pfree(resetcols);
-	if (values)
-		pfree(values);
-	if (nulls)
-		pfree(nulls);
-
 	return PointerGetDatum(rettuple);
 }
@@ -3,9 +3,20 @@
  * Shared memory control - based on alocating chunks aligned on
  * asize array (fibonachi), and dividing free bigger block.
  *
+ * Every block starts by header with its size and size of previous
+ * block (boundary tags), so both neighbours of freed block are
+ * found in O(1) and free blocks are merged immediately. Free blocks
+ * are in lists by asize classes - bins[i] holds free blocks of size
+ * asize[i] .. asize[i + 1] - 1, so any block from first not empty
+ * bin of requested class can be used. Blocks bigger than MAX_SIZE are
+ * served from the last bin.
+ *
  */
 
 #include "postgres.h"
+#include "access/hash.h"
+#include "utils/timestamp.h"
+#include "utils/memutils.h"
 #include "shmmc.h"
 #include "stdlib.h"
 #include "string.h"
@@ -14,23 +25,8 @@
 #include "stdint.h"
 
 
-#define LIST_ITEMS  512
-
 int context;
 
-typedef struct {
-	size_t size;
-	void* first_byte_ptr;
-	bool dispossible;
-/*	int16 context; */
-} list_item;
-
-typedef struct {
-	int list_c;
-	size_t max_size;
-	vardata data[1];	 /* flexible array member */
-} mem_desc;
-
 #define MAX_SIZE 82688
 
 static size_t asize[] = {
@@ -40,28 +36,44 @@ static size_t asize[] = {
 	2848,   4608,  7456, 12064,
 	19520, 31584, 51104, 82688};
 
+#define NBINS		lengthof(asize)
 
-int *list_c = NULL;
-list_item *list = NULL;
-size_t max_size;
+#define BLOCK_MAGIC		0x4F524146
 
-int cycle = 0;
+typedef struct _block_header {
+	size_t size;						/* size of block with header */
+	size_t prev_size;					/* size of previous block, 0 for first */
+	uint32 magic;
+	bool dispossible;
+	struct _block_header *next_free;	/* valid only for free blocks */
+	struct _block_header *prev_free;
+} block_header;
 
+#define block_header_size		(MAXALIGN(sizeof(block_header)))
+#define block_get_content(b)	(((char *) (b)) + block_header_size)
+#define block_from_content(p)	((block_header *) (((char *) (p)) - block_header_size))
+#define block_next(b)			((block_header *) (((char *) (b)) + (b)->size))
+#define block_prev(b)			((block_header *) (((char *) (b)) - (b)->prev_size))
 
-/* align requested size */
+typedef struct {
+	char *start;				/* first block */
+	char *end;					/* end of managed memory */
+	block_header *bins[NBINS];
+
+	/* statistics, see ora_sstat */
+	int64 allocations;
+	int64 failures;
+	int64 lock_waits;
+	int64 lock_wait_time;
+} mem_desc;
 
-static int
-ptr_comp(const void* a, const void* b)
-{
-	ptrdiff_t d;
+#define mem_desc_size			(MAXALIGN(sizeof(mem_desc)))
 
-	list_item *_a = (list_item*) a;
-	list_item *_b = (list_item*) b;
+static mem_desc *mdesc = NULL;
+static LWLockId alloc_lockid = NULL;	/* protects mdesc and blocks */
 
-	d = (uintptr_t)_a->first_byte_ptr - (uintptr_t)_b->first_byte_ptr;
+int cycle = 0;
 
-	return d > 0 ? 1 : (d < 0 ? -1 : 0);
-}
 
 char *
 ora_sstrcpy(char *str)
@@ -77,7 +89,7 @@ ora_sstrcpy(char *str)
 			(errcode(ERRCODE_OUT_OF_MEMORY),
 			errmsg("out of memory"),
 			errdetail("Failed while allocation block %d bytes in shared memory.", (int) len+1),
-			errhint("Increase SHMEMMSGSZ and recompile package.")));
+			errhint("Increase orafce.pipe_shmem_size configuration parameter.")));
 
 	return result;
 }
@@ -100,218 +112,340 @@ ora_scstring(text *str)
 			(errcode(ERRCODE_OUT_OF_MEMORY),
 			errmsg("out of memory"),
 			errdetail("Failed while allocation block %d bytes in shared memory.", (int) len+1),
-			errhint("Increase SHMEMMSGSZ and recompile package.")));
+			errhint("Increase orafce.pipe_shmem_size configuration parameter.")));
 
 	return result;
 }
 
+/* align requested size */
+
+static size_t
+align_size(size_t size)
+{
+	int i;
+
+	for (i = 0; i < NBINS; i++)
+		if (asize[i] >= size)
+			return asize[i];
+
+	/*
+	 * Blocks larger than MAX_SIZE are not rounded to class. They are
+	 * taken (first fit) from the last bin.
+	 */
+	if (size > MaxAllocSize)
+		ereport(ERROR,
+			   (errcode(ERRCODE_OUT_OF_MEMORY),
+			    errmsg("too much large memory block request"),
+			    errdetail("Failed while allocation block %lu bytes in shared memory.", (unsigned long) size)));
+
+	return MAXALIGN(size);
+}
+
 /*
- * Compact the list of slots, by merging adjacent unused slots into larger
- * slots.
+ * Returns bin of free block - the highest class not bigger than content
+ * of block.
  */
-static void
-defragmentation()
+static int
+bin_index(size_t size)
 {
-	int src, target;
+	int i = NBINS - 1;
 
-	/* Sort the array to pointer order */
-	qsort(list, *list_c, sizeof(list_item), ptr_comp);
+	while (i > 0 && asize[i] > size - block_header_size)
+		i--;
 
-	/* Merge adjacent dispossible slots, and move up other slots */
-	target = 0;
-	for (src = 0; src < *list_c; src++)
-	{
-		if (target > 0 &&
-			list[src].dispossible &&
-			list[target - 1].dispossible)
-		{
-			list[target - 1].size += list[src].size;
-		}
-		else
-		{
-			if (src != target)
-				memcpy(&list[target], &list[src], sizeof(list_item));
-			target++;
-		}
-	}
-	*list_c = target;
+	return i;
 }
 
-static size_t
-align_size(size_t size)
+static void
+bin_insert(block_header *b)
 {
-	int i;
+	int i = bin_index(b->size);
+
+	b->dispossible = true;
+	b->prev_free = NULL;
+	b->next_free = mdesc->bins[i];
+	if (b->next_free != NULL)
+		b->next_free->prev_free = b;
+	mdesc->bins[i] = b;
+}
 
-	/* default, we can allocate max MAX_SIZE memory block */
+static void
+bin_remove(block_header *b)
+{
+	if (b->prev_free != NULL)
+		b->prev_free->next_free = b->next_free;
+	else
+		mdesc->bins[bin_index(b->size)] = b->next_free;
 
-	for (i = 0; i < 17; i++)
-		if (asize[i] >= size)
-			return asize[i];
+	if (b->next_free != NULL)
+		b->next_free->prev_free = b->prev_free;
 
-	ereport(ERROR,
-		   (errcode(ERRCODE_OUT_OF_MEMORY),
-		    errmsg("too much large memory block request"),
-		    errdetail("Failed while allocation block %lu bytes in shared memory.", (unsigned long) size),
-		    errhint("Increase MAX_SIZE constant, fill table a_size and recompile package.")));
+	b->dispossible = false;
+}
 
-	return 0;
+/*
+ * Returns header of used block, raise exception for foreign pointer
+ */
+static block_header *
+get_block(void *ptr)
+{
+	block_header *b = block_from_content(ptr);
+
+	if ((char *) b < mdesc->start || (char *) b >= mdesc->end ||
+		b->magic != BLOCK_MAGIC || b->dispossible)
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("corrupted pointer"),
+				 errdetail("Failed while reallocating memory block in shared memory."),
+				 errhint("Report this bug to autors.")));
+
+	return b;
 }
 
 /*
   initialize shared memory. It works in two modes, create and no create.
   No create is used for mounting shared memory buffer. Top of memory is
-  used for list_item array.
+  used for descriptor with list of free blocks. The allocator functions
+  take lockid, so they can be used under any lock of caller.
 */
 
 void
-ora_sinit(void *ptr, size_t size, bool create)
+ora_sinit(void *ptr, size_t size, bool create, LWLockId lockid)
 {
-	if (list == NULL)
+	if (mdesc == NULL)
 	{
-		mem_desc *m = (mem_desc*)ptr;
-		list = (list_item*)m->data;
-		list_c = &m->list_c;
-		max_size = m->max_size = size;
+		mdesc = (mem_desc *) ptr;
+		alloc_lockid = lockid;
 
 		if (create)
 		{
-			list[0].size = size - sizeof(list_item)*LIST_ITEMS - sizeof(mem_desc);
-			list[0].first_byte_ptr = ((char *) &m->data) + sizeof(list_item)*LIST_ITEMS;
-			list[0].dispossible = true;
-			*list_c = 1;
+			block_header *b;
+			int		i;
+
+			mdesc->start = ((char *) ptr) + mem_desc_size;
+			mdesc->end = ((char *) ptr) + size;
+
+			for (i = 0; i < NBINS; i++)
+				mdesc->bins[i] = NULL;
+
+			mdesc->allocations = 0;
+			mdesc->failures = 0;
+			mdesc->lock_waits = 0;
+			mdesc->lock_wait_time = 0;
+
+			b = (block_header *) mdesc->start;
+			b->size = mdesc->end - mdesc->start;
+			b->prev_size = 0;
+			b->magic = BLOCK_MAGIC;
+
+			bin_insert(b);
 		}
 	}
 }
 
 
-void*
-ora_salloc(size_t size)
+static void*
+alloc_block(size_t size)
 {
 	size_t aligned_size;
-	int repeat_c;
-	void *ptr = NULL;
+	size_t block_size;
+	block_header *b = NULL;
+	int i;
 
 	aligned_size = align_size(size);
+	block_size = aligned_size + block_header_size;
 
-	for (repeat_c = 0; repeat_c < 2; repeat_c++)
+	/*
+	 * Every block in bin of requested class or in higher bins is good
+	 * enough. Only the last bin holds blocks of different sizes.
+	 */
+	for (i = bin_index(block_size); i < NBINS && b == NULL; i++)
 	{
-		size_t	max_min = max_size;
-		int		select = -1;
-		int		i;
+		for (b = mdesc->bins[i]; b != NULL; b = b->next_free)
+			if (b->size >= block_size)
+				break;
+	}
 
-		/* find first good free block */
-		for (i = 0; i < *list_c; i++)
-		{
-			if (list[i].dispossible)
-			{
-				/* If this block is just the right size, return it */
-				if (list[i].size == aligned_size)
-				{
-					list[i].dispossible = false;
-					ptr = list[i].first_byte_ptr;
-					/* list[i].context = context; */
-
-					return ptr;
-				}
-
-				if (list[i].size > aligned_size && list[i].size < max_min)
-				{
-					max_min = list[i].size;
-					select = i;
-				}
-			}
-		}
+	if (b == NULL)
+	{
+		mdesc->failures += 1;
+		return NULL;
+	}
 
-		/* If no suitable free slot found, defragment and try again. */
-		if (select == -1 || *list_c == LIST_ITEMS)
-		{
-			defragmentation();
-			continue;
-		}
+	bin_remove(b);
+	mdesc->allocations += 1;
 
-		/*
-		 * A slot larger than required was found. Divide it to avoid wasting
-		 * space, and return the slot of the right size.
-		 */
-		list[*list_c].size = list[select].size - aligned_size;
-		list[*list_c].first_byte_ptr = (char*)list[select].first_byte_ptr + aligned_size;
-		list[*list_c].dispossible = true;
-		list[select].size = aligned_size;
-		list[select].dispossible = false;
-		/* list[select].context = context; */
-		ptr = list[select].first_byte_ptr;
-		*list_c += 1;
-		break;
+	/*
+	 * A block larger than required was found. Divide it to avoid wasting
+	 * space, and return the block of the right size.
+	 */
+	if (b->size - block_size >= block_header_size + asize[0])
+	{
+		block_header *rest = (block_header *) (((char *) b) + block_size);
+
+		rest->size = b->size - block_size;
+		rest->prev_size = block_size;
+		rest->magic = BLOCK_MAGIC;
+
+		if ((char *) block_next(rest) < mdesc->end)
+			block_next(rest)->prev_size = rest->size;
+
+		b->size = block_size;
+		bin_insert(rest);
 	}
 
-	return ptr;
+	return block_get_content(b);
 }
 
-void
-ora_sfree(void* ptr)
+static void
+free_block(void* ptr)
 {
-	int i;
+	block_header *b = get_block(ptr);
+	block_header *next;
+
+#ifdef CLOBBER_FREED_MEMORY
+
+	memset(block_get_content(b), '#', b->size - block_header_size);
+
+#endif
+
+	/* merge with following free block */
+	next = block_next(b);
+	if ((char *) next < mdesc->end && next->dispossible)
+	{
+		bin_remove(next);
+		b->size += next->size;
+	}
+
+	/* merge with previous free block */
+	if (b->prev_size != 0 && block_prev(b)->dispossible)
+	{
+		block_header *prev = block_prev(b);
+
+		bin_remove(prev);
+		prev->size += b->size;
+		b = prev;
+	}
+
+	next = block_next(b);
+	if ((char *) next < mdesc->end)
+		next->prev_size = b->size;
+
+	bin_insert(b);
+}
 
 /*
-	if (cycle++ % 100 == 0)
+ * The allocator lock is always taken exclusively, so the counters of
+ * waiting can be updated without other protection.
+ */
+static void
+alloc_lock_acquire(void)
+{
+	if (!LWLockConditionalAcquire(alloc_lockid, LW_EXCLUSIVE))
 	{
-		size_t suma = 0;
-		for (i = 0; i < *list_c; i++)
-			if (list[i].dispossible)
-				suma += list[i].size;
-		elog(NOTICE, "=============== FREE MEM REPORT === %10d ================", suma);
+		TimestampTz start = GetCurrentTimestamp();
+
+		LWLockAcquire(alloc_lockid, LW_EXCLUSIVE);
+
+		mdesc->lock_waits += 1;
+		mdesc->lock_wait_time += GetCurrentTimestamp() - start;
 	}
-*/
+}
 
-	for (i = 0; i < *list_c; i++)
-		if (list[i].first_byte_ptr == ptr)
-		{
-			list[i].dispossible = true;
-			/* list[i].context = -1; */
-			memset(list[i].first_byte_ptr, '#', list[i].size);
-			return;
-		}
+void*
+ora_salloc(size_t size)
+{
+	void *result;
 
-	ereport(ERROR,
-			(errcode(ERRCODE_INTERNAL_ERROR),
-			 errmsg("corrupted pointer"),
-			 errdetail("Failed while reallocating memory block in shared memory."),
-			 errhint("Report this bug to autors.")));
+	alloc_lock_acquire();
+	result = alloc_block(size);
+	LWLockRelease(alloc_lockid);
+
+	return result;
 }
 
+void
+ora_sfree(void* ptr)
+{
+	alloc_lock_acquire();
+	free_block(ptr);
+	LWLockRelease(alloc_lockid);
+}
 
 void*
 ora_srealloc(void *ptr, size_t size)
 {
 	void *result;
-	size_t aux_s = 0;
-	int i;
+	block_header *b;
+	size_t aux_s;
 
-	for (i = 0; i < *list_c; i++)
-		if (list[i].first_byte_ptr == ptr)
-		{
-			if (align_size(size) <= list[i].size)
-				return ptr;
-			aux_s = list[i].size;
-		}
+	alloc_lock_acquire();
 
-	if (aux_s == 0)
-		ereport(ERROR,
-			(errcode(ERRCODE_INTERNAL_ERROR),
-			errmsg("corrupted pointer"),
-			errdetail("Failed while reallocating memory block in shared memory."),
-			errhint("Report this bug to autors.")));
+	b = get_block(ptr);
+	aux_s = b->size - block_header_size;
 
-
-	if (NULL != (result = ora_salloc(size)))
+	if (align_size(size) <= aux_s)
+		result = ptr;
+	else if (NULL != (result = alloc_block(size)))
 	{
 		memcpy(result, ptr, aux_s);
-		ora_sfree(ptr);
+		free_block(ptr);
 	}
 
+	LWLockRelease(alloc_lockid);
+
 	return result;
 }
 
+/*
+ * Fill info by current state of allocator. All blocks are walked, so
+ * the function should not be used too often.
+ */
+void
+ora_sstat(ora_sstat_info *info)
+{
+	block_header *b;
+	int		i;
+
+	memset(info, 0, sizeof(ora_sstat_info));
+
+	info->nclasses = NBINS;
+	info->classes = palloc0(NBINS * sizeof(ora_sstat_class));
+	for (i = 0; i < NBINS; i++)
+		info->classes[i].class_size = asize[i];
+
+	alloc_lock_acquire();
+
+	for (b = (block_header *) mdesc->start;
+		 (char *) b < mdesc->end;
+		 b = block_next(b))
+	{
+		ora_sstat_class *c = &info->classes[bin_index(b->size)];
+
+		if (b->dispossible)
+		{
+			c->free_blocks += 1;
+			c->free_bytes += b->size;
+
+			if ((int64) b->size > info->largest_free)
+				info->largest_free = b->size;
+		}
+		else
+		{
+			c->used_blocks += 1;
+			c->used_bytes += b->size;
+		}
+	}
+
+	info->total_bytes = mdesc->end - mdesc->start;
+	info->allocations = mdesc->allocations;
+	info->failures = mdesc->failures;
+	info->lock_waits = mdesc->lock_waits;
+	info->lock_wait_time = mdesc->lock_wait_time;
+
+	LWLockRelease(alloc_lockid);
+}
+
 /*
  *  alloc shared memory, raise exception if not
  */
@@ -326,7 +460,7 @@ salloc(size_t size)
 			(errcode(ERRCODE_OUT_OF_MEMORY),
 			errmsg("out of memory"),
 			errdetail("Failed while allocation block %lu bytes in shared memory.", (unsigned long) size),
-			errhint("Increase SHMEMMSGSZ and recompile package.")));
+			errhint("Increase orafce.pipe_shmem_size configuration parameter.")));
 
 	return result;
 }
@@ -341,7 +475,149 @@ srealloc(void *ptr, size_t size)
 			(errcode(ERRCODE_OUT_OF_MEMORY),
 			errmsg("out of memory"),
 			errdetail("Failed while reallocation block %lu bytes in shared memory.", (unsigned long) size),
-			errhint("Increase SHMEMMSGSZ and recompile package.")));
+			errhint("Increase orafce.pipe_shmem_size configuration parameter.")));
 
 	return result;
 }
+
+static int
+shash_nbuckets(int nslots)
+{
+	int		nbuckets = 1;
+
+	while (nbuckets < nslots)
+		nbuckets <<= 1;
+
+	return nbuckets;
+}
+
+/*
+ * Returns size of memory necessary for hash index of nslots slots
+ */
+size_t
+ora_shash_size(int nslots)
+{
+	return MAXALIGN(sizeof(ora_shash)) +
+		   MAXALIGN(shash_nbuckets(nslots) * sizeof(int)) +
+		   MAXALIGN(nslots * sizeof(int)) +
+		   MAXALIGN(nslots * sizeof(uint32));
+}
+
+/*
+ * Initialize hash index for nslots slots in memory ptr (of size returned
+ * by ora_shash_size). All slots are free.
+ */
+ora_shash *
+ora_shash_init(void *ptr, int nslots)
+{
+	ora_shash *h = (ora_shash *) ptr;
+	char   *p = (char *) ptr + MAXALIGN(sizeof(ora_shash));
+	int		nbuckets = shash_nbuckets(nslots);
+	int		i;
+
+	h->nslots = nslots;
+	h->mask = nbuckets - 1;
+	h->buckets = (int *) p;
+	p += MAXALIGN(nbuckets * sizeof(int));
+	h->next = (int *) p;
+	p += MAXALIGN(nslots * sizeof(int));
+	h->hashes = (uint32 *) p;
+
+	for (i = 0; i < nbuckets; i++)
+		h->buckets[i] = ORA_SHASH_NONE;
+
+	for (i = 0; i < nslots; i++)
+		h->next[i] = i + 1 < nslots ? i + 1 : ORA_SHASH_NONE;
+
+	h->free_slot = nslots > 0 ? 0 : ORA_SHASH_NONE;
+
+	return h;
+}
+
+/*
+ * Returns first used slot with same hash, ORA_SHASH_NONE if there is not
+ * any. The caller has to compare a key of the slot.
+ */
+int
+ora_shash_first(ora_shash *h, uint32 hash)
+{
+	int		slot = h->buckets[hash & h->mask];
+
+	while (slot != ORA_SHASH_NONE && h->hashes[slot] != hash)
+		slot = h->next[slot];
+
+	return slot;
+}
+
+int
+ora_shash_next(ora_shash *h, int slot)
+{
+	uint32	hash = h->hashes[slot];
+
+	slot = h->next[slot];
+	while (slot != ORA_SHASH_NONE && h->hashes[slot] != hash)
+		slot = h->next[slot];
+
+	return slot;
+}
+
+/*
+ * Take a free slot and link it to hash index. Returns ORA_SHASH_NONE
+ * when all slots are used.
+ */
+int
+ora_shash_insert(ora_shash *h, uint32 hash)
+{
+	int		slot = h->free_slot;
+	int		bucket = hash & h->mask;
+
+	if (slot == ORA_SHASH_NONE)
+		return ORA_SHASH_NONE;
+
+	h->free_slot = h->next[slot];
+
+	h->hashes[slot] = hash;
+	h->next[slot] = h->buckets[bucket];
+	h->buckets[bucket] = slot;
+
+	return slot;
+}
+
+/*
+ * Unlink used slot from hash index and returns it to list of free slots.
+ */
+void
+ora_shash_delete(ora_shash *h, int slot)
+{
+	int	   *prev = &h->buckets[h->hashes[slot] & h->mask];
+
+	while (*prev != ORA_SHASH_NONE)
+	{
+		if (*prev == slot)
+		{
+			*prev = h->next[slot];
+			h->next[slot] = h->free_slot;
+			h->free_slot = slot;
+			return;
+		}
+		prev = &h->next[*prev];
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INTERNAL_ERROR),
+			 errmsg("corrupted hash index"),
+			 errdetail("Failed while removing slot %d from hash index in shared memory.", slot),
+			 errhint("Report this bug to autors.")));
+}
+
+uint32
+ora_shash_bytes(const char *str, int len)
+{
+	return DatumGetUInt32(hash_any((const unsigned char *) str, len));
+}
+
+uint32
+ora_shash_int(int value)
+{
+	return DatumGetUInt32(hash_uint32((uint32) value));
+}
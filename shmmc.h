@@ -1,7 +1,9 @@
 #ifndef __SHMMC__
 #define __SHMMC__
 
-void  ora_sinit(void *ptr, size_t size, bool create);
+#include "storage/lwlock.h"
+
+void  ora_sinit(void *ptr, size_t size, bool create, LWLockId lockid);
 void* ora_salloc(size_t size);
 void* ora_srealloc(void *ptr, size_t size);
 void  ora_sfree(void* ptr);
@@ -9,4 +11,54 @@ char* ora_sstrcpy(char *str);
 char* ora_scstring(text *str);
 void* salloc(size_t size);
 void* srealloc(void *ptr,size_t size);
+
+/*
+ * Allocator statistics. Blocks are counted in classes by asize array,
+ * the last class holds all bigger blocks too.
+ */
+typedef struct {
+	size_t class_size;
+	int64 used_blocks;
+	int64 used_bytes;
+	int64 free_blocks;
+	int64 free_bytes;
+} ora_sstat_class;
+
+typedef struct {
+	int64 total_bytes;
+	int64 largest_free;			/* size of the biggest free block */
+	int64 allocations;
+	int64 failures;				/* allocations failed for lack of memory */
+	int64 lock_waits;
+	int64 lock_wait_time;		/* in microseconds */
+	int nclasses;
+	ora_sstat_class *classes;
+} ora_sstat_info;
+
+void ora_sstat(ora_sstat_info *info);
+
+/*
+ * Hash index over an array of nslots slots in shared memory. The index
+ * maintains the list of free slots too, so the caller has not to scan
+ * the array for a free slot.
+ */
+typedef struct {
+	int nslots;
+	int mask;				/* number of buckets - 1 */
+	int free_slot;			/* head of list of free slots */
+	int *buckets;			/* first slot of bucket chain */
+	int *next;				/* next slot in bucket chain or in free list */
+	uint32 *hashes;
+} ora_shash;
+
+#define ORA_SHASH_NONE		-1
+
+size_t ora_shash_size(int nslots);
+ora_shash *ora_shash_init(void *ptr, int nslots);
+int  ora_shash_first(ora_shash *h, uint32 hash);
+int  ora_shash_next(ora_shash *h, int slot);
+int  ora_shash_insert(ora_shash *h, uint32 hash);
+void ora_shash_delete(ora_shash *h, int slot);
+uint32 ora_shash_bytes(const char *str, int len);
+uint32 ora_shash_int(int value);
 #endif
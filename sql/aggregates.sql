@@ -87,3 +87,78 @@ DROP FUNCTION checkMedianDoubleOdd();
 DROP FUNCTION checkMedianDoubleEven();
 
 
+
+-- Tests for the aggregates percentile and quantile
+SELECT percentile(i::float8, 0.25), quantile(i::float8, 0.25) FROM generate_series(1,10) g(i);
+SELECT percentile(i::real, 0.5), median(i::real) FROM generate_series(1,10) g(i);
+SELECT percentile(i::float8, 1), quantile(i::float8, 0) FROM generate_series(1,10) g(i);
+SELECT median(((i * 7919) % 10007)::float8) FROM generate_series(1,10007) g(i);
+SELECT percentile(i::float8, 2) FROM generate_series(1,3) g(i);
+
+-- Tests for the aggregates approx_median and approx_percentile
+SELECT approx_median(i::float8), approx_percentile(i::float8, 0.25) FROM generate_series(1,10) g(i);
+SELECT abs(approx_median(i::float8) - 50000.5) < 500,
+       abs(approx_percentile(i::float8, 0.99, 200) - 99000) < 100
+  FROM generate_series(1,100000) g(i);
+SELECT approx_median(i::float8, 1) FROM generate_series(1,10) g(i);
+
+-- Tests for the exact aggregates spilled to temporary file
+SET work_mem = '64kB';
+SELECT median(i::float8), percentile(i::float8, 0.25), quantile(i::float8, 0.25), median(i::real) FROM generate_series(1,100000) g(i);
+SELECT median(((i * 7919) % 100003)::float8) FROM generate_series(1,100003) g(i);
+RESET work_mem;
+
+-- Tests for the aggregates median, percentile and quantile of integer types
+SELECT median(i), percentile(i, 0.25), quantile(i::bigint, 0.25), median(i::bigint) FROM generate_series(1,10) g(i);
+SELECT median(x), median(y) FROM (VALUES (-1.5::float8, 'NaN'::float8), (-3, 1), (2, 2), (0, 2)) v(x, y);
+SET work_mem = '64kB';
+SELECT median(i), quantile(i::bigint, 0.9) FROM generate_series(1,100000) g(i);
+RESET work_mem;
+
+-- Tests for partial (parallel) aggregation
+CREATE TABLE parallel_test AS SELECT (i * 7919) % 100003 AS v FROM generate_series(1,100000) g(i);
+ALTER TABLE parallel_test SET (parallel_workers = 2);
+ANALYZE parallel_test;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+DO $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'parallel_leader_participation') THEN
+    SET parallel_leader_participation = off;
+  END IF;
+END
+$$;
+EXPLAIN (COSTS OFF)
+SELECT listagg(v::text), listagg(v::text, ','), wm_concat(v::text), median(v), percentile(v::float8, 0.25), quantile(v::real, 0.75) FROM parallel_test;
+SELECT length(l1), length(l2), length(w), (SELECT sum(x::int) FROM unnest(string_to_array(l2, ',')) x), m, p, q
+  FROM (SELECT listagg(v::text) l1, listagg(v::text, ',') l2, wm_concat(v::text) w, median(v) m, percentile(v::float8, 0.25) p, quantile(v::real, 0.75) q
+          FROM parallel_test) s;
+SELECT v % 3, count(*), length(listagg(v::text, ',')), median(v::bigint), percentile(v::float8, 0.25) FROM parallel_test GROUP BY v % 3 ORDER BY 1;
+-- the partial states spilled to file are not passed to leader
+SET work_mem = '64kB';
+\set VERBOSITY terse
+SELECT median(v), median(v::float8), percentile(v::float8, 0.25), quantile(v::real, 0.75) FROM parallel_test;
+\set VERBOSITY default
+RESET work_mem;
+-- same results by serial plan
+SET max_parallel_workers_per_gather = 0;
+EXPLAIN (COSTS OFF)
+SELECT listagg(v::text), listagg(v::text, ','), wm_concat(v::text), median(v), percentile(v::float8, 0.25), quantile(v::real, 0.75) FROM parallel_test;
+SELECT length(l1), length(l2), length(w), (SELECT sum(x::int) FROM unnest(string_to_array(l2, ',')) x), m, p, q
+  FROM (SELECT listagg(v::text) l1, listagg(v::text, ',') l2, wm_concat(v::text) w, median(v) m, percentile(v::float8, 0.25) p, quantile(v::real, 0.75) q
+          FROM parallel_test) s;
+SELECT v % 3, count(*), length(listagg(v::text, ',')), median(v::bigint), percentile(v::float8, 0.25) FROM parallel_test GROUP BY v % 3 ORDER BY 1;
+RESET max_parallel_workers_per_gather;
+RESET min_parallel_table_scan_size;
+RESET parallel_tuple_cost;
+RESET parallel_setup_cost;
+DO $$
+BEGIN
+  IF EXISTS(SELECT * FROM pg_settings WHERE name = 'parallel_leader_participation') THEN
+    RESET parallel_leader_participation;
+  END IF;
+END
+$$;
+DROP TABLE parallel_test;
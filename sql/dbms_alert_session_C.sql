@@ -10,6 +10,16 @@ SELECT dbms_alert.waitone('a1',20);
 /* Test: multisession waitany */
 SELECT dbms_alert.waitany(10);
 
+/* Test: signal of rolled back subtransaction is not sent */
+SELECT dbms_alert.register('c1');
+BEGIN;
+SAVEPOINT s1;
+SELECT dbms_alert.signal('c1','Rolled back');
+ROLLBACK TO s1;
+SELECT dbms_alert.signal('c1','Committed');
+COMMIT;
+SELECT dbms_alert.waitone('c1',1);
+
 /* cleanup */
 SELECT dbms_alert.removeall();
 
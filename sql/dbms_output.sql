@@ -762,3 +762,44 @@ END;
 $$ LANGUAGE plpgsql;
 SELECT dbms_output_test();
 DROP FUNCTION dbms_output_test();
+
+-- GET_LINES as set
+SELECT dbms_output.disable();
+SELECT dbms_output.enable();
+SELECT dbms_output.serveroutput('f');
+DO $$
+BEGIN
+	PERFORM dbms_output.put_line('ORAFCE TEST 1');
+	PERFORM dbms_output.put_line('ORAFCE TEST 2');
+	PERFORM dbms_output.put('ORAFCE ');
+	PERFORM dbms_output.put('TEST 3');
+END;
+$$;
+SELECT * FROM dbms_output.get_lines();
+SELECT * FROM dbms_output.get_lines();
+
+-- ENABLE(NULL) is unlimited
+DO $$
+BEGIN
+	PERFORM dbms_output.disable();
+	PERFORM dbms_output.enable(NULL);
+	PERFORM dbms_output.put_line(repeat('A', 1500000));
+	PERFORM dbms_output.put_line('ORAFCE TEST 1');
+END;
+$$;
+SELECT length(line), status FROM dbms_output.get_line();
+SELECT line, status FROM dbms_output.get_line();
+
+-- SERVEROUTPUT in batches
+SELECT dbms_output.serveroutput('t', 0);
+DO $$
+BEGIN
+	PERFORM dbms_output.serveroutput('t', 2);
+	PERFORM dbms_output.put_line('ORAFCE TEST 1');
+	PERFORM dbms_output.put_line('ORAFCE TEST 2');
+	PERFORM dbms_output.put_line('ORAFCE TEST 3');
+END;
+$$;
+SELECT * FROM dbms_output.get_lines();
+SELECT dbms_output.serveroutput('f');
+SELECT dbms_output.disable();
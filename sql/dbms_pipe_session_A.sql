@@ -204,3 +204,20 @@ DROP FUNCTION bulkSend();
 DROP FUNCTION notifyDropTemp();
 DROP FUNCTION notify(text);
 DROP FUNCTION send(text);
+
+-- Session B waits in receive_messages on a pipe that does not exist yet,
+-- the messages are sent when it is registered as receiver waiter
+DO $$
+BEGIN
+  FOR i IN 1..600 LOOP
+    IF EXISTS(SELECT * FROM dbms_pipe.db_shmem_stats
+               WHERE kind = 'pipe' AND name = 'batch_pipe'
+                 AND stat = 'receivers_waiting' AND value = 1) THEN
+      RETURN;
+    END IF;
+    PERFORM pg_sleep(0.1);
+  END LOOP;
+  RAISE NOTICE 'Timeout';
+END;
+$$;
+SELECT dbms_pipe.send_messages('batch_pipe', array['\x01'::bytea, '\x0203']);
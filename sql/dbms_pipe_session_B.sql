@@ -161,5 +161,9 @@ DROP FUNCTION dropTempTable();
 SELECT dbms_pipe.receive_message('public_pipe_4',2);
 SELECT dbms_pipe.purge('public_pipe_4');
 
+-- Waits in receive_messages before the pipe exists, until session A sends
+SELECT * FROM dbms_pipe.receive_messages('batch_pipe', 10, 60);
+SELECT dbms_pipe.purge('batch_pipe');
+
 SET SESSION AUTHORIZATION DEFAULT;
 DROP USER pipe_test_owner;
@@ -14,3 +14,6 @@ SELECT dbms_random.seed(5);
 SELECT dbms_random.value()::numeric(10, 8);
 SELECT dbms_random.value(10,15)::numeric(10, 8);
 SELECT dbms_random.terminate();
+SELECT dbms_random.seed(1);
+SELECT v::numeric(10, 8) FROM dbms_random.values(3, 5, 10) v;
+SELECT s FROM dbms_random.strings(3, 'U', 6) s;
@@ -130,6 +130,40 @@ DELETE FROM utl_file.utl_file_dir;
 INSERT INTO utl_file.utl_file_dir(dir, dirname) VALUES(utl_file.tmpdir(), 'TMPDIR');
 SELECT gen_file('TMPDIR');
 SELECT read_file('TMPDIR');
+SELECT * FROM utl_file.read_lines('TMPDIR', 'regress_orafce.txt');
+SELECT utl_file.get_lines(utl_file.fopen('TMPDIR', 'regress_orafce.txt', 'r'), 3);
+SELECT utl_file.fclose_all();
+SELECT utl_file.fcopy('TMPDIR', 'regress_orafce.txt', 'TMPDIR', 'regress_orafce2.txt', 2, 3);
+SELECT * FROM utl_file.read_lines('TMPDIR', 'regress_orafce2.txt');
+SELECT utl_file.fremove('TMPDIR', 'regress_orafce2.txt');
+DO $$
+DECLARE
+  f utl_file.file_type;
+BEGIN
+  f := utl_file.fopen('TMPDIR', 'regress_orafce3.txt', 'w', 1024, NULL, 65536, true);
+  PERFORM utl_file.put_lines(f, ARRAY['first', 'second', 'third']);
+  PERFORM utl_file.put_line(f, 'fourth');
+  f := utl_file.fclose(f);
+END
+$$;
+SELECT * FROM utl_file.read_lines('TMPDIR', 'regress_orafce3.txt');
+SELECT utl_file.fremove('TMPDIR', 'regress_orafce3.txt');
+SELECT utl_file.fopen('TMPDIR', 'regress_orafce3.txt', 'w', 1024, NULL, 10);
+SET orafce.utl_file_max_files = 1;
+DO $$
+DECLARE
+  f1 utl_file.file_type;
+  f2 utl_file.file_type;
+BEGIN
+  f1 := utl_file.fopen('TMPDIR', 'regress_orafce.txt', 'r');
+  PERFORM utl_file.fclose(f1);
+  f2 := utl_file.fopen('TMPDIR', 'regress_orafce.txt', 'r');
+  RAISE NOTICE 'is_open = %, %', utl_file.is_open(f1), utl_file.is_open(f2);
+  f1 := utl_file.fopen('TMPDIR', 'regress_orafce.txt', 'r');
+END
+$$;
+SELECT utl_file.fclose_all();
+RESET orafce.utl_file_max_files;
 SELECT utl_file.fremove('TMPDIR', 'regress_orafce.txt');
 
 DROP FUNCTION gen_file(text);
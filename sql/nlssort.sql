@@ -19,3 +19,19 @@ SELECT set_nls_sort('en_US.utf8');
 SELECT * FROM test_sort ORDER BY NLSSORT(name);
 INSERT INTO test_sort VALUES(NULL);
 SELECT * FROM test_sort ORDER BY NLSSORT(name);
+-- locales are switched row by row, long strings force bigger buffers
+CREATE TABLE test_sort_loc (name TEXT, loc TEXT);
+INSERT INTO test_sort_loc VALUES ('red', 'en_US.utf8'), ('red', 'C'), ('red', ''),
+  ('brown', 'en_US.utf8'), ('brown', 'C'), ('brown', ''),
+  ('yellow', 'en_US.utf8'), ('yellow', 'C'), ('yellow', ''),
+  ('Purple', 'en_US.utf8'), ('Purple', 'C'), ('Purple', '');
+SELECT loc, string_agg(name, ',' ORDER BY NLSSORT(name, loc)) AS short,
+       string_agg(name, ',' ORDER BY NLSSORT(repeat('x', 3000) || name, loc)) AS long
+  FROM test_sort_loc GROUP BY loc ORDER BY loc;
+SELECT count(*) FROM test_sort_loc a JOIN test_sort_loc b ON a.loc = b.loc
+ WHERE (NLSSORT(repeat('x', 3000) || a.name, a.loc) < NLSSORT(repeat('x', 3000) || b.name, b.loc))
+       <> (NLSSORT(a.name, a.loc) < NLSSORT(b.name, b.loc));
+SELECT count(*) FROM (SELECT name, i, NLSSORT(repeat(name, i), 'en_US.utf8') AS k
+                        FROM test_sort, generate_series(1, 1000, 100) g(i)
+                       WHERE name IS NOT NULL) s
+ WHERE k <> NLSSORT(repeat(name, i), 'en_US.utf8');
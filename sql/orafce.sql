@@ -160,9 +160,24 @@ select dbms_pipe.send_message('test_int');
 select dbms_pipe.receive_message('test_int');
 select dbms_pipe.next_item_type();
 select dbms_pipe.unpack_message_number();
+
+select dbms_pipe.pack_message(repeat('x', 10000));
+select dbms_pipe.send_message('test_long');
+select dbms_pipe.receive_message('test_long');
+select length(dbms_pipe.unpack_message_text());
+select dbms_pipe.send_messages('test_batch', array['\x01'::bytea, '\x0203', 'abc']);
+select * from dbms_pipe.receive_messages('test_batch', 2, 0);
+select dbms_pipe.receive_message('test_batch', 0);
+select dbms_pipe.unpack_message_bytea();
 select dbms_pipe.purge('bob');
 
 select name, items, "limit", private, owner from dbms_pipe.db_pipes where name = 'bob';
+select dbms_pipe.create_pipe('test_stats');
+select dbms_pipe.send_messages('test_stats', array['\x01'::bytea, '\x0203']);
+select * from dbms_pipe.receive_messages('test_stats', 1, 0);
+select stat, value from dbms_pipe.db_shmem_stats where kind = 'pipe' and name = 'test_stats' and stat not like 'bytes%';
+select dbms_pipe.remove_pipe('test_stats');
+select name, stat from dbms_pipe.db_shmem_stats where kind in ('slots', 'lock') order by name collate "C", stat collate "C";
 
 select PLVstr.betwn('Harry and Sally are very happy', 7, 9);
 select PLVstr.betwn('Harry and Sally are very happy', 7, 9, FALSE);
@@ -182,6 +197,7 @@ select plvsubst.string('My name is %s %s.', 'Pavel|Stěhule','|');
 select plvsubst.string('My name is %s.', 'Stěhule');
 select plvsubst.string('My name is %s.', '');
 select plvsubst.string('My name is empty.', '');
+select t, plvsubst.string(t, ARRAY['1', NULL, 'tři']) from (values('%s-%s-%s'),('<%s|%s>'),('%s-%s-%s'),('žádný')) v(t);
 
 select round(to_date ('22-AUG-03', 'DD-MON-YY'),'YEAR')  =  to_date ('01-JAN-04', 'DD-MON-YY');
 select round(to_date ('22-AUG-03', 'DD-MON-YY'),'Q')  =  to_date ('01-OCT-03', 'DD-MON-YY');
@@ -193,6 +209,16 @@ select trunc(to_date('22-AUG-03', 'DD-MON-YY'), 'Q')  =  to_date ('01-JUL-03', '
 select trunc(to_date('22-AUG-03', 'DD-MON-YY'), 'MONTH') =  to_date ('01-AUG-03', 'DD-MON-YY');
 select trunc(to_date('22-AUG-03', 'DD-MON-YY'), 'DDD')  =  to_date ('22-AUG-03', 'DD-MON-YY');
 select trunc(to_date('22-AUG-03', 'DD-MON-YY'), 'DAY')  =  to_date ('17-AUG-03', 'DD-MON-YY');
+create table trunc_test(d date, v int);
+create index trunc_test_d_idx on trunc_test(d);
+set enable_seqscan to off;
+set enable_bitmapscan to off;
+explain (costs off) select * from trunc_test where trunc(d, 'DD') = date '2003-08-22';
+explain (costs off) select * from trunc_test where trunc(d, 'MM') = date '2003-08-01';
+reset enable_seqscan;
+reset enable_bitmapscan;
+drop table trunc_test;
+select f, trunc(date '2003-08-22', f), round(date '2003-08-22', f) from (values('YEAR'),('Q'),('Q'),('MONTH'),('DDD'),('DAY')) v(f);
 
 select trunc(TIMESTAMP WITH TIME ZONE '2004-10-19 10:23:54+02','YEAR') = '2004-01-01 00:00:00-08';
 select trunc(TIMESTAMP WITH TIME ZONE '2004-10-19 10:23:54+02','Q') = '2004-10-01 00:00:00-07';
@@ -233,6 +259,13 @@ select 0 = instr('abcabcabc', 'abca', -10);
 select 1 = instr('abcabcabc', 'abca', 1, 1);
 select 4 = instr('abcabcabc', 'abca', 1, 2);
 select 0 = instr('abcabcabc', 'abca', 1, 3);
+select 1001 = instr(repeat('x', 1000) || 'hello hello', 'hello');
+select 1007 = instr(repeat('x', 1000) || 'hello hello', 'hello', -1);
+select 1001 = instr(repeat('x', 1000) || 'hello hello', 'hello', -1, 2);
+select 3 = instr(repeat('a', 300), 'aaaa', 1, 3);
+select 296 = instr(repeat('a', 300), 'aaaa', -1, 2);
+select 15 = instr('žluťoučký kůň kůň', 'kůň', -1);
+select 1002 = instr(repeat('ř', 1000) || 'abř', 'bř');
 select oracle.substr('This is a test', 6, 2) = 'is';
 select oracle.substr('This is a test', 6) =  'is a test';
 select oracle.substr('TechOnTheNet', 1, 4) =  'Tech';
@@ -293,6 +326,15 @@ select nvl2(NULL, 2, 3);
 select lnnvl(true);
 select lnnvl(false);
 select lnnvl(NULL);
+-- nvl, nvl2, lnnvl and decode are inlined by planner
+create temp table nvl_test(a int, b bool);
+insert into nvl_test values(1, true), (2, false), (NULL, NULL);
+explain (costs off) select * from nvl_test where nvl(a, 0) = 5;
+explain (costs off) select * from nvl_test where nvl2(a, 1, 2) = 1;
+explain (costs off) select * from nvl_test where lnnvl(b);
+explain (costs off) select * from nvl_test where decode(a, 1, 'one', NULL, 'null', 'other') = 'one';
+select a, b, nvl(a, 0), nvl2(a, 1, 2), lnnvl(b), decode(a, 1, 'one', NULL, 'null', 'other') from nvl_test;
+drop table nvl_test;
 select decode(1, 1, 100, 2, 200);
 select decode(2, 1, 100, 2, 200);
 select decode(3, 1, 100, 2, 200);
@@ -477,6 +519,10 @@ select decode('2012-01-01', '2012-01-01', 'result-1', '2012-02-01'::date, 'resul
 select PLVstr.rvrs ('Jumping Jack Flash') ='hsalF kcaJ gnipmuJ';
 select PLVstr.rvrs ('Jumping Jack Flash', 9) = 'hsalF kcaJ';
 select PLVstr.rvrs ('Jumping Jack Flash', 4, 6) = 'nip';
+select PLVstr.rvrs ('žluťoučký kůň') = 'ňůk ýkčuoťulž';
+select PLVstr.rvrs ('žluťoučký kůň', 5, 9) = 'ýkčuo';
+select PLVstr.rvrs ('žluťoučký kůň', -1, -3) = 'ňůk';
+select PLVstr.rvrs (repeat('ř', 100) || 'abc', 100, 102) = 'bař';
 select PLVstr.rvrs (NULL, 10, 20);
 select PLVstr.rvrs ('alphabet', -2, -5);
 select PLVstr.rvrs ('alphabet', -2);
@@ -974,6 +1020,29 @@ SELECT plvdate.bizdays_between('2016-02-21','2016-02-27');
 SELECT plvdate.include_start(false);
 SELECT plvdate.bizdays_between('2016-02-24','2016-02-26');
 SELECT plvdate.bizdays_between('2016-02-21','2016-02-27');
+SELECT plvdate.default_holidays('Czech');
+SELECT plvdate.add_bizdays('2016-12-20', 5), plvdate.add_bizdays('2016-12-28', -5);
+SELECT plvdate.bizdays_between('2010-01-01', '2019-12-31'), plvdate.bizdays_between('2019-12-31', '2010-01-01');
+SELECT plvdate.isbizday('2016-03-28'), plvdate.isbizday('2016-03-25'), plvdate.isbizday('2015-04-03'), plvdate.next_bizday('2016-03-24');
+SELECT plvdate.set_nonbizday('2016-12-27'::date);
+SELECT plvdate.add_bizdays('2016-12-20', 5);
+SELECT plvdate.unset_nonbizday('2016-12-27'::date);
+SELECT plvdate.add_bizdays('2016-12-20', 5);
+DO $$ BEGIN FOR i IN 0..89 LOOP PERFORM plvdate.set_nonbizday('2030-01-01'::date + i); END LOOP; END $$;
+SELECT plvdate.add_bizdays('2029-12-31', 1), plvdate.bizdays_between('2030-01-01', '2030-03-31');
+SELECT plvdate.default_holidays('Czech');
+SELECT plvdate.save_calendar('czech');
+SELECT name, nonbizdays, use_easter, use_great_friday, country, array_length(holidays, 1), exceptions FROM plvdate.calendars;
+SELECT plvdate.default_holidays('usa');
+SELECT plvdate.isbizday('2016-12-26');
+SELECT plvdate.use_calendar('czech');
+SELECT plvdate.isbizday('2016-12-26');
+SELECT plvdate.default_holidays('usa');
+SET orafce.plvdate_calendar = 'czech';
+SELECT plvdate.isbizday('2016-12-26'), plvdate.using_easter();
+RESET orafce.plvdate_calendar;
+SELECT plvdate.use_calendar('unknown');
+DELETE FROM plvdate.calendars;
 
 SELECT oracle.round(1.234::double precision, 2), oracle.trunc(1.234::double precision, 2);
 SELECT oracle.round(1.234::float, 2), oracle.trunc(1.234::float, 2);
@@ -989,6 +1058,7 @@ select plunit.assert_not_equals(1,2,3);
 -- lexer text
 --
 SELECT pos, token, class, mod FROM plvlex.tokens('select * from a.b.c join d on x=y', true, true);
+SELECT pos, length(token), class, mod FROM plvlex.tokens('select ''' || repeat('x', 5000) || '''', true, true);
 
 --
 -- trigger functions
@@ -1018,4 +1088,9 @@ INSERT INTO trg_test VALUES('AHOJ', NULL, NULL, '2020-01-01', 100);
 
 SELECT * FROM trg_test;
 
+ALTER TABLE trg_test ADD COLUMN f text;
+ALTER TABLE trg_test DROP COLUMN e;
+INSERT INTO trg_test VALUES(NULL, 1, NULL, NULL, NULL), ('X', 2, 'Y', NULL, NULL);
+SELECT * FROM trg_test WHERE b < 3;
+
 DROP TABLE trg_test;
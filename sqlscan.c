@@ -967,7 +967,7 @@ static char *scanbuf;
 
 int orafce_sql_yylex(void);
 
-void orafce_sql_scanner_init(const char *str);
+void orafce_sql_scanner_init(const char *str, int slen);
 void orafce_sql_scanner_finish(void);
 
 /*
@@ -3212,13 +3212,12 @@ orafce_sql_yyerror(List **result, const char *message)
 
 
 /*
- * Called before any actual parsing is done
+ * Called before any actual parsing is done. The string need not be
+ * zero terminated.
  */
 void
-orafce_sql_scanner_init(const char *str)
+orafce_sql_scanner_init(const char *str, int slen)
 {
-	Size	slen = strlen(str);
-
 	/*
 	 * Might be left over after ereport()
 	 */